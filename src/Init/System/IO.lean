@@ -93,6 +93,22 @@ set_option compiler.extract_closed false in
 @[extern "lean_io_timeit"] opaque timeit (msg : @& String) (fn : IO α) : IO α
 @[extern "lean_io_allocprof"] opaque allocprof (msg : @& String) (fn : IO α) : IO α
 
+/--
+Starts sampling on average one out of `sampleRate` small object allocations, discarding any
+previously collected allocation profile. If `backtraces` is true, the backtrace of each sampled
+allocation is recorded as well. `setAllocSampling 0 false` stops sampling but keeps the current
+profile. Unlike `allocprof`, this does not require compiling Lean with `RUNTIME_STATS=ON`.
+-/
+@[extern "lean_io_set_alloc_sampling"] opaque setAllocSampling (sampleRate : UInt32) (backtraces : Bool) : BaseIO Unit
+
+/--
+Returns the allocation profile collected since the last `setAllocSampling` as a JSON object with
+the fields `sample_rate`, `sizes` (samples per object size), `tags` (samples per `lean_ptr_tag`),
+`non_objects` (samples of blocks that are not Lean objects, such as `mpz` limbs), and `backtraces`. Each entry contains the number of `allocated`, `freed`, and still `live` samples;
+multiply by `sample_rate` to estimate the actual number of objects.
+-/
+@[extern "lean_io_get_alloc_samples"] opaque getAllocSamples : BaseIO String
+
 /-- Programs can execute IO actions during initialization that occurs before
    the `main` function is executed. The attribute `[init <action>]` specifies
    which IO action is executed to set the value of an opaque constant.
@@ -268,6 +284,15 @@ from a snapshot.
 -/
 @[extern "lean_io_add_heartbeats"] opaque addHeartbeats (count : UInt64) : BaseIO Unit
 
+/--
+Returns memory of the small object allocator that is no longer in use to the operating system.
+This is useful for long-running processes such as the language server after a large amount of
+memory has been freed, e.g. after closing a file. Memory of other threads is returned the next time
+they allocate. Independently of this function, each thread returns unused memory exceeding the
+high-water mark set by the `LEAN_HEAP_HIGH_WATERMARK` environment variable (in megabytes, default 64).
+-/
+@[extern "lean_io_trim_heap"] opaque trimHeap : BaseIO Unit
+
 /--
 The mode of a file handle (i.e., a set of `open` flags and an `fdopen` mode).
 
@@ -332,6 +357,15 @@ inductive FS.Mode where
 
 opaque FS.Handle : Type := Unit
 
+/--
+  The read-only contents of a file. Where possible, the file is mapped into memory instead of being read, so
+  opening a large file does not copy it, and only the parts that are accessed are loaded by the operating system.
+  The mapping is released when the `MappedFile` is no longer referenced.
+
+  The file should not be modified while it is mapped: the contents returned by the functions in `FS.MappedFile`
+  may change, and truncating the file may crash the process. -/
+opaque FS.MappedFile : Type := Unit
+
 /--
   A pure-Lean abstraction of POSIX streams. We use `Stream`s for the standard streams stdin/stdout/stderr so we can
   capture output of `#eval` commands into memory. -/
@@ -427,14 +461,39 @@ Note that EOF does not actually close a handle, so further reads may block and r
 
 /--
 Read text up to (including) the next line break from the handle.
+The line is truncated at its first `'\x00'` character.
 If the returned string is empty, an end-of-file marker has been reached.
 Note that EOF does not actually close a handle, so further reads may block and return more data.
 -/
 @[extern "lean_io_prim_handle_get_line"] opaque getLine (h : @& Handle) : IO String
+/--
+Read the remaining lines of the handle, without the line breaks.
+On Windows, a carriage return preceding a line break is removed as well.
+As with `getLine`, a line is truncated at its first `'\x00'` character, but reading continues with the next
+line. The `IO.FS.lines` implementation based on `getLine` used to stop reading at such a line instead.
+-/
+@[extern "lean_io_prim_handle_lines"] opaque lines (h : @& Handle) : IO (Array String)
 @[extern "lean_io_prim_handle_put_str"] opaque putStr (h : @& Handle) (s : @& String) : IO Unit
 
 end Handle
 
+namespace MappedFile
+
+/-- Opens the file `fn` for reading and maps its contents into memory. See `FS.MappedFile`. -/
+@[extern "lean_io_prim_mapped_file_mk"] opaque mk (fn : @& FilePath) : IO MappedFile
+/-- Size of the file in bytes. -/
+@[extern "lean_io_mapped_file_size"] opaque size (m : @& MappedFile) : Nat
+@[extern "lean_io_mapped_file_uget"] opaque uget (m : @& MappedFile) (i : USize) (h : i.toNat < m.size) : UInt8
+/-- Returns the byte at position `i`. Panics and returns `0` if `i` is out of bounds. -/
+@[extern "lean_io_mapped_file_get"] opaque get! (m : @& MappedFile) (i : @& Nat) : UInt8
+/-- Copies the bytes from position `start` (inclusive) to `stop` (exclusive) into a new `ByteArray`. -/
+@[extern "lean_io_mapped_file_extract"] opaque extract (m : @& MappedFile) (start stop : @& Nat) : ByteArray
+
+def toByteArray (m : MappedFile) : ByteArray :=
+  m.extract 0 m.size
+
+end MappedFile
+
 @[extern "lean_io_realpath"] opaque realPath (fname : FilePath) : IO FilePath
 @[extern "lean_io_remove_file"] opaque removeFile (fname : @& FilePath) : IO Unit
 /-- Remove given directory. Fails if not empty; see also `IO.FS.removeDirAll`. -/
@@ -486,23 +545,23 @@ def readBinFile (fname : FilePath) : IO ByteArray := do
   let h ← Handle.mk fname Mode.read
   h.readBinToEnd
 
+/--
+Maps the contents of `fname` into memory without copying them. See `FS.MappedFile`.
+-/
+def readBinFileMapped (fname : FilePath) : IO MappedFile :=
+  MappedFile.mk fname
+
 def readFile (fname : FilePath) : IO String := do
   let h ← Handle.mk fname Mode.read
   h.readToEnd
 
-partial def lines (fname : FilePath) : IO (Array String) := do
+/--
+Read the lines of the given file, without the line breaks (see `Handle.lines`).
+Lines are truncated at their first `'\x00'` character.
+-/
+def lines (fname : FilePath) : IO (Array String) := do
   let h ← Handle.mk fname Mode.read
-  let rec read (lines : Array String) := do
-    let line ← h.getLine
-    if line.length == 0 then
-      pure lines
-    else if line.back == '\n' then
-      let line := line.dropRight 1
-      let line := if System.Platform.isWindows && line.back == '\x0d' then line.dropRight 1 else line
-      read <| lines.push line
-    else
-      pure <| lines.push line
-  read #[]
+  h.lines
 
 def writeBinFile (fname : FilePath) (content : ByteArray) : IO Unit := do
   let h ← Handle.mk fname Mode.write
@@ -710,6 +769,12 @@ structure Child (cfg : StdioConfig) where
   stdout : cfg.stdout.toHandleType
   stderr : cfg.stderr.toHandleType
 
+/--
+Start a new child process.
+A missing executable or working directory makes `spawn` throw an exception on Windows and on Linux with glibc 2.29
+or newer, where the process is created using `posix_spawn`. On other platforms, the child process exits with
+code 255 instead.
+-/
 @[extern "lean_io_process_spawn"] opaque spawn (args : SpawnArgs) : IO (Child args.toStdioConfig)
 
 @[extern "lean_io_process_child_wait"] opaque Child.wait {cfg : @& StdioConfig} : @& Child cfg → IO UInt32
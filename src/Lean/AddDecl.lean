@@ -18,6 +18,8 @@ def Environment.addDecl (env : Environment) (opts : Options) (decl : Declaration
     (cancelTk? : Option IO.CancelToken := none) : Except KernelException Environment :=
   if debug.skipKernelTC.get opts then
     addDeclWithoutChecking env decl
+  else if profiler.get opts && profiler.kernel.get opts then
+    addDeclProfiled env (Core.getMaxHeartbeats opts).toUSize decl cancelTk? (profiler.threshold.getSecs opts)
   else
     addDeclCore env (Core.getMaxHeartbeats opts).toUSize decl cancelTk?
 
@@ -55,9 +55,11 @@ def utf16PosToCodepointPos (s : String) (pos : Nat) : Nat :=
   utf16PosToCodepointPosFrom s pos 0
 
 /-- Starting at `utf8pos`, finds the UTF-8 offset of the `p`-th codepoint. -/
-def codepointPosToUtf8PosFrom (s : String) : String.Pos → Nat → String.Pos
-  | utf8pos, 0 => utf8pos
-  | utf8pos, p+1 => codepointPosToUtf8PosFrom s (s.next utf8pos) p
+@[extern "lean_string_codepoint_pos_to_utf8_pos_from"]
+def codepointPosToUtf8PosFrom (s : @& String) (utf8pos : @& String.Pos) (p : @& Nat) : String.Pos :=
+  match p with
+  | 0 => utf8pos
+  | p+1 => codepointPosToUtf8PosFrom s (s.next utf8pos) p
 
 end String
 
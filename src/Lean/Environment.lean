@@ -204,6 +204,18 @@ private def isQuotInit (env : Environment) : Bool :=
 private def getTrustLevel (env : Environment) : UInt32 :=
   env.header.trustLevel
 
+/--
+Map of imported constants. Environments derived from the same imports share it, so the kernel uses it
+to identify the imports of an environment.
+-/
+@[export lean_environment_imported_constants]
+private def importedConstants (env : Environment) : HashMap Name ModuleIdx :=
+  env.const2ModIdx
+
+@[export lean_environment_is_imported_constant]
+private def isImportedConstant (env : Environment) (n : Name) : Bool :=
+  env.const2ModIdx.contains n
+
 def getModuleIdxFor? (env : Environment) (declName : Name) : Option ModuleIdx :=
   env.const2ModIdx.find? declName
 
@@ -251,6 +263,14 @@ Type check given declaration and add it to the environment
 opaque addDeclCore (env : Environment) (maxHeartbeats : USize) (decl : @& Declaration)
   (cancelTk? : @& Option IO.CancelToken) : Except KernelException Environment
 
+/--
+Like `addDeclCore`, but also prints a JSON breakdown of the time the kernel spent checking the
+declaration to stderr if it took at least `threshold` seconds. See option `profiler.kernel`.
+-/
+@[extern "lean_add_decl_profiled"]
+opaque addDeclProfiled (env : Environment) (maxHeartbeats : USize) (decl : @& Declaration)
+  (cancelTk? : @& Option IO.CancelToken) (threshold : Float) : Except KernelException Environment
+
 /--
 Add declaration to kernel without type checking it.
 **WARNING** This function is meant for temporarily working around kernel performance issues.
@@ -260,6 +280,19 @@ and the kernel will not catch it if the new option is set to true.
 @[extern "lean_add_decl_without_checking"]
 opaque addDeclWithoutChecking (env : Environment) (decl : @& Declaration) : Except KernelException Environment
 
+private instance : Nonempty (Environment × Array (Name × Nat)) := ⟨(Classical.ofNonempty, #[])⟩
+
+/--
+Type check the given declarations and add them to the environment.
+The declarations are added in dependency order, and the values of theorems are checked in parallel.
+`maxHeartbeats` is applied to each declaration separately.
+Returns the new environment and the time spent checking each declaration, in nanoseconds.
+The declarations are not profiled by `profiler.kernel`.
+-/
+@[extern "lean_add_decls_parallel"]
+opaque addDeclsParallel (env : Environment) (maxHeartbeats : USize) (decls : @& Array Declaration) :
+  Except KernelException (Environment × Array (Name × Nat))
+
 end Environment
 
 namespace ConstantInfo
@@ -678,6 +711,13 @@ opaque saveModuleData (fname : @& System.FilePath) (mod : @& Name) (data : @& Mo
 @[extern "lean_read_module_data"]
 opaque readModuleData (fname : @& System.FilePath) : IO (ModuleData × CompactedRegion)
 
+/--
+  Clears the kernel caches that are shared across declarations (see `LEAN_KERNEL_SHARED_CACHE`)
+  and the kernel hash-cons table (see `LEAN_KERNEL_HASH_CONS`).
+  They may reference objects in compacted regions. -/
+@[extern "lean_kernel_clear_shared_caches"]
+opaque Kernel.clearSharedCaches : IO Unit
+
 /--
   Free compacted regions of imports. No live references to imported objects may exist at the time of invocation; in
   particular, `env` should be the last reference to any `Environment` derived from these imports. -/
@@ -698,7 +738,7 @@ unsafe def Environment.freeRegions (env : Environment) : IO Unit :=
     ```
 
     TODO: statically check for this. -/
-  env.header.regions.forM CompactedRegion.free
+  Kernel.clearSharedCaches *> env.header.regions.forM CompactedRegion.free
 
 def mkModuleData (env : Environment) : IO ModuleData := do
   let pExts ← persistentEnvExtensionsRef.get
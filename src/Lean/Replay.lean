@@ -61,6 +61,19 @@ def addDecl (d : Declaration) : M Unit := do
   | .ok env => modify fun s => { s with env := env }
   | .error ex => throwKernelException ex
 
+/--
+Add declarations with `Environment.addDeclsParallel`, possibly throwing a `KernelException`.
+Returns the time spent checking each declaration, in nanoseconds.
+-/
+def addDecls (decls : Array Declaration) (maxHeartbeats : Nat) : M (Array (Name × Nat)) := do
+  match (← get).env.addDeclsParallel maxHeartbeats.toUSize decls with
+  | .ok (env, times) =>
+    modify fun s => { s with env := env }
+    return times
+  | .error ex =>
+    throwKernelException ex
+    return #[]
+
 mutual
 /--
 Check if a `Name` still needs to be processed (i.e. is in `remaining`).
@@ -169,3 +182,48 @@ def replay (newConstants : HashMap Name ConstantInfo) (env : Environment) : IO E
       checkPostponedConstructors
       checkPostponedRecursors
   return s.env
+
+/--
+Like `replay`, but all constants are sent to the kernel in a single batch,
+which adds them in dependency order and checks the values of theorems in parallel.
+
+Returns the new environment and the time spent checking each declaration, in nanoseconds.
+-/
+def replayParallel (newConstants : HashMap Name ConstantInfo) (env : Environment)
+    (maxHeartbeats : Nat := 0) : IO (Environment × Array (Name × Nat)) := do
+  let mut decls : Array Declaration := #[]
+  let mut postponedConstructors : NameSet := {}
+  let mut postponedRecursors : NameSet := {}
+  for (_, ci) in newConstants.toList do
+    -- As in `replay`, we skip unsafe and partial constants.
+    if ci.isUnsafe || ci.isPartial then
+      continue
+    match ci with
+    | .defnInfo   info => decls := decls.push (.defnDecl info)
+    | .thmInfo    info => decls := decls.push (.thmDecl info)
+    | .axiomInfo  info => decls := decls.push (.axiomDecl info)
+    | .opaqueInfo info => decls := decls.push (.opaqueDecl info)
+    | .inductInfo info =>
+      -- Send each mutual block once, when visiting its first inductive type.
+      if info.all.head? == some info.name then
+        let types ← info.all.mapM fun n => do
+          let some (.inductInfo val) := newConstants.find? n
+            | throw <| IO.userError s!"No such inductive {n}"
+          let ctors ← val.ctors.mapM fun c => do
+            let some ctor := newConstants.find? c
+              | throw <| IO.userError s!"No such constructor {c}"
+            pure ({ name := ctor.name, type := ctor.type } : Constructor)
+          pure ({ name := val.name, type := val.type, ctors } : InductiveType)
+        decls := decls.push (.inductDecl info.levelParams info.numParams types false)
+    | .ctorInfo   info => postponedConstructors := postponedConstructors.insert info.name
+    | .recInfo    info => postponedRecursors := postponedRecursors.insert info.name
+    | .quotInfo   info =>
+      if info.name == ``Quot then
+        decls := decls.push .quotDecl
+  let (times, s) ← StateRefT'.run (s := { env, postponedConstructors, postponedRecursors }) do
+    ReaderT.run (r := { newConstants }) do
+      let times ← addDecls decls maxHeartbeats
+      checkPostponedConstructors
+      checkPostponedRecursors
+      pure times
+  return (s.env, times)
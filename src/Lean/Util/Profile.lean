@@ -23,6 +23,15 @@ register_builtin_option profiler.threshold : Nat := {
   descr    := "threshold in milliseconds, profiling times under threshold will not be reported individually"
 }
 
+register_builtin_option profiler.kernel : Bool := {
+  defValue := false
+  group    := "profiler"
+  descr    := "when `profiler` is set, also print a JSON breakdown of the kernel type checking time of each declaration \
+    above `profiler.threshold`: time in `whnf`, definitional equality checking, lazy delta reduction, \
+    recursor and `Nat` literal reduction, cache hit rates, and the most frequently unfolded constants. \
+    Declarations checked in parallel by `Environment.addDeclsParallel` are not profiled"
+}
+
 @[export lean_get_profiler]
 private def get_profiler (o : Options) : Bool :=
   profiler.get o
@@ -0,0 +1,11 @@
+if (ZSTD_INCLUDE_DIR AND ZSTD_LIBRARIES)
+  # Already in cache, be silent
+  set(ZSTD_FIND_QUIETLY TRUE)
+endif (ZSTD_INCLUDE_DIR AND ZSTD_LIBRARIES)
+
+find_path(ZSTD_INCLUDE_DIR NAMES zstd.h )
+find_library(ZSTD_LIBRARIES NAMES zstd libzstd REQUIRED)
+
+include(FindPackageHandleStandardArgs)
+FIND_PACKAGE_HANDLE_STANDARD_ARGS(ZSTD DEFAULT_MSG ZSTD_INCLUDE_DIR ZSTD_LIBRARIES)
+mark_as_advanced(ZSTD_INCLUDE_DIR ZSTD_LIBRARIES)
@@ -259,7 +259,9 @@ typedef struct {
    * Finished
      * condition: m_value != nullptr
      * invariant: m_imp == nullptr
-     * transition: RC becomes 0 ==> freed (`deactivate_task` lock) */
+     * setting `m_value` is the last access of the task manager to the task, and waiters are woken up by
+       `task_parking_lot` without taking the `deactivate_task` lock
+     * transition: RC becomes 0 ==> freed (`deactivate_task`, no lock) */
 typedef struct lean_task {
     lean_object            m_header;
     _Atomic(lean_object *) m_value;
@@ -1032,6 +1034,7 @@ static inline lean_obj_res lean_string_utf8_next_fast(b_lean_obj_arg s, b_lean_o
 }
 
 LEAN_EXPORT lean_obj_res lean_string_utf8_prev(b_lean_obj_arg s, b_lean_obj_arg i);
+LEAN_EXPORT lean_obj_res lean_string_codepoint_pos_to_utf8_pos_from(b_lean_obj_arg s, b_lean_obj_arg i, b_lean_obj_arg n);
 LEAN_EXPORT lean_obj_res lean_string_utf8_set(lean_obj_arg s, b_lean_obj_arg i, uint32_t c);
 static inline uint8_t lean_string_utf8_at_end(b_lean_obj_arg s, b_lean_obj_arg i) {
     return !lean_is_scalar(i) || lean_unbox(i) >= lean_string_size(s) - 1;
@@ -1085,8 +1088,17 @@ static inline lean_obj_res lean_thunk_get_own(b_lean_obj_arg t) {
 
 /* Tasks */
 
+/* Task scheduler implementations. The global queue scheduler keeps all queued tasks in a single queue protected by
+   the task manager lock. The work-stealing scheduler gives every worker its own queue and lets idle workers steal
+   from the other queues, which reduces lock contention when many small tasks are spawned.
+   `lean_init_task_manager` and `lean_init_task_manager_using` select the scheduler from the `LEAN_TASK_SCHEDULER`
+   environment variable (`work_stealing` or `global`, the default). */
+#define LEAN_TASK_SCHEDULER_GLOBAL_QUEUE  0
+#define LEAN_TASK_SCHEDULER_WORK_STEALING 1
+
 LEAN_EXPORT void lean_init_task_manager(void);
 LEAN_EXPORT void lean_init_task_manager_using(unsigned num_workers);
+LEAN_EXPORT void lean_init_task_manager_using_scheduler(unsigned num_workers, unsigned scheduler);
 LEAN_EXPORT void lean_finalize_task_manager(void);
 
 LEAN_EXPORT lean_obj_res lean_task_spawn_core(lean_obj_arg c, unsigned prio, bool keep_alive);
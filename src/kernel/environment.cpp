@@ -7,6 +7,10 @@ Author: Leonardo de Moura
 #include <utility>
 #include <vector>
 #include <limits>
+#include <chrono>
+#include <unordered_map>
+#include <unordered_set>
+#include <sstream>
 #include "runtime/sstream.h"
 #include "runtime/thread.h"
 #include "util/map_foreach.h"
@@ -14,6 +18,9 @@ Author: Leonardo de Moura
 #include "kernel/environment.h"
 #include "kernel/kernel_exception.h"
 #include "kernel/type_checker.h"
+#include "kernel/for_each_fn.h"
+#include "kernel/profiler.h"
+#include "kernel/trace.h"
 #include "kernel/quot.h"
 
 namespace lean {
@@ -215,18 +222,27 @@ environment environment::add_definition(declaration const & d, bool check) const
     }
 }
 
+static void check_theorem_header(environment const & env, theorem_val const & v, type_checker & checker) {
+    if (!checker.is_prop(v.get_type()))
+        throw theorem_type_is_not_prop(env, v.get_name(), v.get_type());
+    check_constant_val(env, v.to_constant_val(), checker);
+}
+
+static void check_theorem_value(environment const & env, declaration const & d, type_checker & checker) {
+    theorem_val const & v = d.to_theorem_val();
+    check_no_metavar_no_fvar(env, v.get_name(), v.get_value());
+    expr val_type = checker.check(v.get_value(), v.get_lparams());
+    if (!checker.is_def_eq(val_type, v.get_type()))
+        throw definition_type_mismatch_exception(env, d, val_type);
+}
+
 environment environment::add_theorem(declaration const & d, bool check) const {
     scoped_diagnostics diag(*this, check);
     theorem_val const & v = d.to_theorem_val();
     if (check) {
         type_checker checker(*this, diag.get());
-        if (!checker.is_prop(v.get_type()))
-            throw theorem_type_is_not_prop(*this, v.get_name(), v.get_type());
-        check_constant_val(*this, v.to_constant_val(), checker);
-        check_no_metavar_no_fvar(*this, v.get_name(), v.get_value());
-        expr val_type = checker.check(v.get_value(), v.get_lparams());
-        if (!checker.is_def_eq(val_type, v.get_type()))
-            throw definition_type_mismatch_exception(*this, d, val_type);
+        check_theorem_header(*this, v, checker);
+        check_theorem_value(*this, d, checker);
     }
     return diag.update(add(constant_info(d)));
 }
@@ -310,6 +326,266 @@ extern "C" LEAN_EXPORT object * lean_add_decl_without_checking(object * env, obj
         });
 }
 
+/* Names of the constants added to the environment by \c d. */
+static void get_decl_names(declaration const & d, buffer<name> & r) {
+    switch (d.kind()) {
+    case declaration_kind::Axiom:      r.push_back(d.to_axiom_val().get_name()); break;
+    case declaration_kind::Definition: r.push_back(d.to_definition_val().get_name()); break;
+    case declaration_kind::Theorem:    r.push_back(d.to_theorem_val().get_name()); break;
+    case declaration_kind::Opaque:     r.push_back(d.to_opaque_val().get_name()); break;
+    case declaration_kind::MutualDefinition:
+        for (definition_val const & v : d.to_definition_vals())
+            r.push_back(v.get_name());
+        break;
+    case declaration_kind::Quot:
+        r.push_back(name("Quot"));
+        r.push_back(name({"Quot", "mk"}));
+        r.push_back(name({"Quot", "lift"}));
+        r.push_back(name({"Quot", "ind"}));
+        break;
+    case declaration_kind::Inductive:
+        for (inductive_type const & t : inductive_decl(d).get_types()) {
+            r.push_back(t.get_name());
+            r.push_back(name(t.get_name(), "rec"));
+            for (constructor const & c : t.get_cnstrs())
+                r.push_back(constructor_name(c));
+        }
+        break;
+    }
+}
+
+/*
+addDeclProfiled (env : Environment) (maxHeartbeats : USize) (decl : @& Declaration)
+  (cancelTk? : @& Option IO.CancelToken) (threshold : Float) : Except KernelException Environment
+*/
+extern "C" LEAN_EXPORT object * lean_add_decl_profiled(object * env, size_t max_heartbeat, object * decl,
+    object * opt_cancel_tk, double threshold) {
+    kernel_profiler prof;
+    auto start = std::chrono::steady_clock::now();
+    object * r;
+    {
+        scope_kernel_profiler s(&prof);
+        r = lean_add_decl(env, max_heartbeat, decl, opt_cancel_tk);
+    }
+    double total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (total >= threshold) {
+        buffer<name> ns;
+        get_decl_names(declaration(decl, true), ns);
+        std::ostringstream out;
+        prof.display_json(out, ns.empty() ? name() : ns[0], total);
+        tout() << out.str();
+    }
+    return r;
+}
+
+/* Adds a batch of declarations to an environment. The declarations are added in dependency
+   order, which does not need to match the order in which they are given. Theorems are added
+   as soon as their header has been checked, and their values are checked by tasks running
+   on the task manager against the environment preceding them. This is sound because the result
+   is only returned if all tasks succeed, and each task checks exactly what `add_theorem` would
+   have checked at that point. */
+class add_decls_parallel_fn {
+    environment                               m_env;
+    size_t                                    m_max_heartbeat;
+    std::vector<declaration>                  m_decls;
+    /* Time spent checking each declaration, in nanoseconds. */
+    std::vector<usize>                        m_times;
+    /* Pending value checks: declaration index and task. */
+    std::vector<std::pair<unsigned, object_ref>> m_tasks;
+    std::unordered_map<name, unsigned, name_hash_fn, name_eq_fn> m_decl_of;
+
+    static void get_exprs(declaration const & d, buffer<expr> & r) {
+        switch (d.kind()) {
+        case declaration_kind::Axiom:
+            r.push_back(d.to_axiom_val().get_type());
+            break;
+        case declaration_kind::Definition:
+            r.push_back(d.to_definition_val().get_type());
+            r.push_back(d.to_definition_val().get_value());
+            break;
+        case declaration_kind::Theorem:
+            r.push_back(d.to_theorem_val().get_type());
+            r.push_back(d.to_theorem_val().get_value());
+            break;
+        case declaration_kind::Opaque:
+            r.push_back(d.to_opaque_val().get_type());
+            r.push_back(d.to_opaque_val().get_value());
+            break;
+        case declaration_kind::MutualDefinition:
+            for (definition_val const & v : d.to_definition_vals()) {
+                r.push_back(v.get_type());
+                r.push_back(v.get_value());
+            }
+            break;
+        case declaration_kind::Quot:
+            r.push_back(mk_constant("Eq"));
+            break;
+        case declaration_kind::Inductive:
+            for (inductive_type const & t : inductive_decl(d).get_types()) {
+                r.push_back(t.get_type());
+                for (constructor const & c : t.get_cnstrs())
+                    r.push_back(constructor_type(c));
+            }
+            break;
+        }
+    }
+
+    optional<unsigned> find_decl(name const & n) const {
+        auto it = m_decl_of.find(n);
+        if (it != m_decl_of.end())
+            return optional<unsigned>(it->second);
+        /* Auxiliary recursors of nested inductives, e.g., `T.rec_1`. */
+        if (!n.is_atomic()) {
+            it = m_decl_of.find(n.get_prefix());
+            if (it != m_decl_of.end() && m_decls[it->second].is_inductive())
+                return optional<unsigned>(it->second);
+        }
+        return optional<unsigned>();
+    }
+
+    void get_deps(unsigned i, std::vector<unsigned> & deps) const {
+        buffer<expr> es;
+        get_exprs(m_decls[i], es);
+        std::unordered_set<unsigned> visited;
+        for (expr const & e : es) {
+            for_each(e, [&](expr const & c, unsigned) {
+                    if (is_constant(c)) {
+                        if (auto j = find_decl(const_name(c))) {
+                            if (*j != i && visited.insert(*j).second)
+                                deps.push_back(*j);
+                        }
+                    }
+                    return true;
+                });
+        }
+    }
+
+    /* Store in `order` the declarations sorted by dependencies. We use an explicit stack since
+       dependency chains can be very long. */
+    void sort(std::vector<unsigned> & order) const {
+        enum class status { Todo, Visiting, Done };
+        std::vector<status> st(m_decls.size(), status::Todo);
+        struct frame { unsigned m_idx; std::vector<unsigned> m_deps; unsigned m_next; };
+        std::vector<frame> todo;
+        for (unsigned root = 0; root < m_decls.size(); root++) {
+            if (st[root] != status::Todo)
+                continue;
+            st[root] = status::Visiting;
+            todo.push_back(frame{root, {}, 0});
+            get_deps(root, todo.back().m_deps);
+            while (!todo.empty()) {
+                frame & f = todo.back();
+                if (f.m_next < f.m_deps.size()) {
+                    unsigned j = f.m_deps[f.m_next++];
+                    /* Cycles are ignored, checking will fail with an unknown constant. */
+                    if (st[j] == status::Todo) {
+                        st[j] = status::Visiting;
+                        todo.push_back(frame{j, {}, 0});
+                        get_deps(j, todo.back().m_deps);
+                    }
+                } else {
+                    st[f.m_idx] = status::Done;
+                    order.push_back(f.m_idx);
+                    todo.pop_back();
+                }
+            }
+        }
+    }
+
+    /* Task body: `Except KernelException Nat` with the time spent checking the value. */
+    static obj_res check_theorem_value_task(obj_arg max_heartbeat, obj_arg env, obj_arg decl, obj_arg) {
+        size_t max = unbox_size_t(max_heartbeat);
+        dec(max_heartbeat);
+        environment e(env);
+        declaration d(decl);
+        return catch_kernel_exceptions<object*>([&]() {
+                scope_heartbeat s1(0);
+                scope_max_heartbeat s2(max);
+                auto start = std::chrono::steady_clock::now();
+                type_checker checker(e);
+                check_theorem_value(e, d, checker);
+                auto end = std::chrono::steady_clock::now();
+                return usize_to_nat(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+            });
+    }
+
+    environment add_decls() {
+        std::vector<unsigned> order;
+        sort(order);
+        environment env = m_env;
+        for (unsigned i : order) {
+            declaration const & d = m_decls[i];
+            scope_heartbeat s1(0);
+            scope_max_heartbeat s2(m_max_heartbeat);
+            auto start = std::chrono::steady_clock::now();
+            if (d.is_theorem()) {
+                type_checker checker(env);
+                check_theorem_header(env, d.to_theorem_val(), checker);
+                object * c = alloc_closure(reinterpret_cast<void *>(check_theorem_value_task), 4, 3);
+                closure_set(c, 0, box_size_t(m_max_heartbeat));
+                closure_set(c, 1, env.to_obj_arg());
+                closure_set(c, 2, d.to_obj_arg());
+                m_tasks.emplace_back(i, object_ref(task_spawn(c)));
+                env = env.add(constant_info(d));
+            } else {
+                env = env.add(d);
+            }
+            auto end = std::chrono::steady_clock::now();
+            m_times[i] += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+        }
+        return env;
+    }
+
+public:
+    add_decls_parallel_fn(environment const & env, size_t max_heartbeat, b_obj_arg decls):
+        m_env(env), m_max_heartbeat(max_heartbeat) {
+        size_t sz = array_size(decls);
+        for (size_t i = 0; i < sz; i++)
+            m_decls.push_back(declaration(array_get(decls, i), true));
+        m_times.resize(sz, 0);
+        for (unsigned i = 0; i < m_decls.size(); i++) {
+            buffer<name> ns;
+            get_decl_names(m_decls[i], ns);
+            for (name const & n : ns)
+                m_decl_of.insert(mk_pair(n, i));
+        }
+    }
+
+    /* Return `Except KernelException (Environment × Array (Name × Nat))`. */
+    object * operator()() {
+        object * r = catch_kernel_exceptions<environment>([&]() { return add_decls(); });
+        if (cnstr_tag(r) == 0)
+            return r;
+        for (auto const & t : m_tasks) {
+            b_obj_arg v = task_get(t.second.raw());
+            if (cnstr_tag(v) == 0) {
+                dec(r);
+                inc(v);
+                return v;
+            }
+            m_times[t.first] += usize_of_nat(cnstr_get(v, 0));
+        }
+        object * times = alloc_array(m_decls.size(), m_decls.size());
+        for (unsigned i = 0; i < m_decls.size(); i++) {
+            buffer<name> ns;
+            get_decl_names(m_decls[i], ns);
+            name n = ns.empty() ? name() : ns[0];
+            array_set(times, i, mk_cnstr(0, n, nat(usize_to_nat(m_times[i]))).steal());
+        }
+        environment new_env(cnstr_get(r, 0), true);
+        dec(r);
+        return mk_cnstr(1, mk_cnstr(0, new_env, object_ref(times))).steal();
+    }
+};
+
+/*
+addDeclsParallel (env : Environment) (maxHeartbeats : USize) (decls : @& Array Declaration) :
+  Except KernelException (Environment × Array (Name × Nat))
+*/
+extern "C" LEAN_EXPORT object * lean_add_decls_parallel(object * env, size_t max_heartbeat, object * decls) {
+    return add_decls_parallel_fn(environment(env), max_heartbeat, decls)();
+}
+
 void environment::for_each_constant(std::function<void(constant_info const & d)> const & f) const {
     smap_foreach(cnstr_get(raw(), 1), [&](object *, object * v) {
             constant_info cinfo(v, true);
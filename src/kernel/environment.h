@@ -61,6 +61,7 @@ public:
 
 class environment : public object_ref {
     friend class add_inductive_fn;
+    friend class add_decls_parallel_fn;
 
     void check_name(name const & n) const;
     void check_duplicated_univ_params(names ls) const;
@@ -10,43 +10,46 @@ Author: Leonardo de Moura
 #include "runtime/thread.h"
 #include "kernel/expr.h"
 #include "kernel/expr_sets.h"
+#include "kernel/growable_cache.h"
 
 #ifndef LEAN_EQ_CACHE_CAPACITY
 #define LEAN_EQ_CACHE_CAPACITY 1024*8
 #endif
 
 namespace lean {
+static growable_cache_stats g_eq_cache_stats("eq");
+
 struct eq_cache {
     struct entry {
         object * m_a;
         object * m_b;
+        unsigned m_hash;
         entry():m_a(nullptr), m_b(nullptr) {}
+        bool empty() const { return m_a == nullptr; }
+        void reset() { m_a = nullptr; }
     };
-    unsigned              m_capacity;
-    std::vector<entry>    m_cache;
-    std::vector<unsigned> m_used;
-    eq_cache():m_capacity(LEAN_EQ_CACHE_CAPACITY), m_cache(LEAN_EQ_CACHE_CAPACITY) {}
+    growable_cache<entry> m_cache;
+    eq_cache():m_cache(LEAN_EQ_CACHE_CAPACITY, g_eq_cache_stats) {}
 
     bool check(expr const & a, expr const & b) {
         if (!is_shared(a) || !is_shared(b))
             return false;
-        unsigned i = hash(hash(a), hash(b)) % m_capacity;
-        if (m_cache[i].m_a == a.raw() && m_cache[i].m_b == b.raw()) {
+        unsigned h = hash(hash(a), hash(b));
+        entry const & r = m_cache.get(h);
+        if (r.m_a == a.raw() && r.m_b == b.raw()) {
+            m_cache.record_hit();
             return true;
         } else {
-            if (m_cache[i].m_a == nullptr)
-                m_used.push_back(i);
-            m_cache[i].m_a = a.raw();
-            m_cache[i].m_b = b.raw();
+            entry n;
+            n.m_a    = a.raw();
+            n.m_b    = b.raw();
+            n.m_hash = h;
+            m_cache.insert(std::move(n));
             return false;
         }
     }
 
-    void clear() {
-        for (unsigned i : m_used)
-            m_cache[i].m_a = nullptr;
-        m_used.clear();
-    }
+    void clear() { m_cache.clear(); }
 };
 
 /* CACHE_RESET: No */
@@ -0,0 +1,135 @@
+/*
+Copyright (c) 2026 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: agent
+*/
+#pragma once
+#include <vector>
+#include <utility>
+#include "runtime/optional.h"
+#include "kernel/expr.h"
+
+namespace lean {
+struct expr_key_ops {
+    static unsigned hash(expr const & e) { return lean::hash(e); }
+    static bool eq(expr const & a, expr const & b) { return is_eqp(a, b) || a == b; }
+};
+
+struct expr_pair_key_ops {
+    static unsigned hash(expr_pair const & p) { return lean::hash(lean::hash(p.first), lean::hash(p.second)); }
+    static bool eq(expr_pair const & a, expr_pair const & b) {
+        return expr_key_ops::eq(a.first, b.first) && expr_key_ops::eq(a.second, b.second);
+    }
+};
+
+/** \brief Hash map using open addressing with linear probing, for the caches of the kernel type checker.
+
+    The slots are stored in a single array, and each slot stores the hash code of its key. Thus, inserting
+    does not allocate unless the table grows, and a probe only dereferences keys whose hash code matches.
+    Keys are compared using pointer equality first, and structural equality otherwise.
+
+    Entries cannot be removed individually. The interface is the subset of `std::unordered_map` used by
+    the caches: `find` returns a pointer to the entry, or `end()` (`nullptr`) if there is none. */
+template<typename Key, typename T, typename KeyOps>
+class open_hash_map {
+public:
+    struct entry {
+        Key first;
+        T   second;
+        entry(Key const & k, T const & v):first(k), second(v) {}
+    };
+    typedef entry * iterator;
+    typedef entry const * const_iterator;
+private:
+    struct slot {
+        unsigned        m_hash;
+        optional<entry> m_entry;
+    };
+    static constexpr size_t initial_capacity = 64;
+    std::vector<slot> m_slots;
+    size_t            m_size = 0;
+
+    size_t mask() const { return m_slots.size() - 1; }
+    /* The hash codes of expressions are good enough to be used without additional mixing, but we fold the
+       high bits since small tables only use the low ones. */
+    static size_t index_of(unsigned h) { return h ^ (h >> 16); }
+
+    void grow() {
+        std::vector<slot> old;
+        old.swap(m_slots);
+        m_slots.resize(old.empty() ? initial_capacity : 2 * old.size());
+        for (slot & s : old) {
+            if (s.m_entry) {
+                size_t i = index_of(s.m_hash) & mask();
+                while (m_slots[i].m_entry)
+                    i = (i + 1) & mask();
+                m_slots[i].m_hash = s.m_hash;
+                m_slots[i].m_entry = std::move(s.m_entry);
+            }
+        }
+    }
+
+    slot const * find_slot(Key const & k, unsigned h) const {
+        if (m_size == 0)
+            return nullptr;
+        size_t i = index_of(h) & mask();
+        while (true) {
+            slot const & s = m_slots[i];
+            if (!s.m_entry)
+                return nullptr;
+            if (s.m_hash == h && KeyOps::eq(s.m_entry->first, k))
+                return &s;
+            i = (i + 1) & mask();
+        }
+    }
+public:
+    iterator end() { return nullptr; }
+    const_iterator end() const { return nullptr; }
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    const_iterator find(Key const & k) const {
+        slot const * s = find_slot(k, KeyOps::hash(k));
+        return s ? &*s->m_entry : nullptr;
+    }
+
+    iterator find(Key const & k) {
+        return const_cast<iterator>(static_cast<open_hash_map const *>(this)->find(k));
+    }
+
+    std::pair<iterator, bool> insert(std::pair<Key, T> const & p) {
+        unsigned h = KeyOps::hash(p.first);
+        if (slot const * s = find_slot(p.first, h))
+            return mk_pair(const_cast<iterator>(&*s->m_entry), false);
+        /* Keep the load factor at most 1/2. */
+        if (2 * (m_size + 1) > m_slots.size())
+            grow();
+        size_t i = index_of(h) & mask();
+        while (m_slots[i].m_entry)
+            i = (i + 1) & mask();
+        m_slots[i].m_hash = h;
+        m_slots[i].m_entry.emplace(p.first, p.second);
+        m_size++;
+        return mk_pair(&*m_slots[i].m_entry, true);
+    }
+
+    void clear() {
+        m_slots.clear();
+        m_size = 0;
+    }
+};
+
+template<typename T>
+using expr_open_map = open_hash_map<expr, T, expr_key_ops>;
+
+/** \brief Set of pairs of expressions based on `open_hash_map`. */
+class expr_pair_open_set {
+    open_hash_map<expr_pair, bool, expr_pair_key_ops> m_map;
+public:
+    bool contains(expr_pair const & p) const { return m_map.find(p) != m_map.end(); }
+    void insert(expr_pair const & p) { m_map.insert(mk_pair(p, true)); }
+    size_t size() const { return m_map.size(); }
+    void clear() { m_map.clear(); }
+};
+}
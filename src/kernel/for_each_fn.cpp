@@ -11,41 +11,44 @@ Author: Leonardo de Moura
 #include "runtime/flet.h"
 #include "kernel/for_each_fn.h"
 #include "kernel/cache_stack.h"
+#include "kernel/growable_cache.h"
 
 #ifndef LEAN_DEFAULT_FOR_EACH_CACHE_CAPACITY
 #define LEAN_DEFAULT_FOR_EACH_CACHE_CAPACITY 1024*8
 #endif
 
 namespace lean {
+static growable_cache_stats g_for_each_cache_stats("for_each");
+
 struct for_each_cache {
     struct entry {
         object const *    m_cell;
         unsigned          m_offset;
+        unsigned          m_hash;
         entry():m_cell(nullptr) {}
+        bool empty() const { return m_cell == nullptr; }
+        void reset() { m_cell = nullptr; }
     };
-    unsigned              m_capacity;
-    std::vector<entry>    m_cache;
-    std::vector<unsigned> m_used;
-    for_each_cache(unsigned c):m_capacity(c), m_cache(c) {}
+    growable_cache<entry> m_cache;
+    for_each_cache(unsigned c):m_cache(c, g_for_each_cache_stats) {}
 
     bool visited(expr const & e, unsigned offset) {
-        unsigned i = hash(hash(e), offset) % m_capacity;
-        if (m_cache[i].m_cell == e.raw() && m_cache[i].m_offset == offset) {
+        unsigned h = hash(hash(e), offset);
+        entry const & r = m_cache.get(h);
+        if (r.m_cell == e.raw() && r.m_offset == offset) {
+            m_cache.record_hit();
             return true;
         } else {
-            if (m_cache[i].m_cell == nullptr)
-                m_used.push_back(i);
-            m_cache[i].m_cell   = e.raw();
-            m_cache[i].m_offset = offset;
+            entry n;
+            n.m_cell   = e.raw();
+            n.m_offset = offset;
+            n.m_hash   = h;
+            m_cache.insert(std::move(n));
             return false;
         }
     }
 
-    void clear() {
-        for (unsigned i : m_used)
-            m_cache[i].m_cell = nullptr;
-        m_used.clear();
-    }
+    void clear() { m_cache.clear(); }
 };
 
 /* CACHE_RESET: NO */
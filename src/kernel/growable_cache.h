@@ -0,0 +1,134 @@
+/*
+Copyright (c) 2026 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: agent
+*/
+#pragma once
+#include <vector>
+#include <iostream>
+#include "runtime/int64.h"
+#include "runtime/thread.h"
+
+#ifndef LEAN_MAX_GROWABLE_CACHE_CAPACITY
+#define LEAN_MAX_GROWABLE_CACHE_CAPACITY (1u << 22)
+#endif
+
+/* Minimum number of evictions per hit above which a `growable_cache` does not grow. */
+#ifndef LEAN_GROWABLE_CACHE_EVICTIONS_PER_HIT
+#define LEAN_GROWABLE_CACHE_EVICTIONS_PER_HIT 8
+#endif
+
+namespace lean {
+/** \brief Counters for a kind of `growable_cache`. They are reported on exit in builds with `LEAN_RUNTIME_STATS`. */
+struct growable_cache_stats {
+    char const *   m_name;
+    atomic<uint64> m_evictions{0};
+    atomic<uint64> m_growths{0};
+    growable_cache_stats(char const * name):m_name(name) {}
+#ifdef LEAN_RUNTIME_STATS
+    ~growable_cache_stats() {
+        std::cerr << m_name << " cache evictions: " << m_evictions << "\n";
+        std::cerr << m_name << " cache growths:   " << m_growths << "\n";
+    }
+#endif
+};
+
+/** \brief Direct-mapped cache used to avoid visiting shared subterms more than once during a traversal.
+
+    Inserting an entry evicts the entry stored in the same slot. On terms with a lot of sharing, evicting the
+    entries of shared subterms may make the traversal exponential, so the capacity is doubled when the number
+    of evictions since the cache was last cleared or grown exceeds half of the capacity, up to
+    `LEAN_MAX_GROWABLE_CACHE_CAPACITY` entries. Evictions alone do not indicate sharing: all subterms of terms
+    in compacted regions are "shared", even if the term is a tree. Thus, the users of the cache report hits
+    using `record_hit`, and the cache only grows if there was at least one hit per
+    `LEAN_GROWABLE_CACHE_EVICTIONS_PER_HIT` evictions. `clear` restores the initial capacity, releasing the
+    memory used for large terms.
+
+    `Entry` must be default constructible, and provide the field `m_hash` and the methods `empty()` and `reset()`. */
+template<typename Entry>
+class growable_cache {
+    unsigned               m_initial_capacity;
+    unsigned               m_capacity;
+    std::vector<Entry>     m_cache;
+    std::vector<unsigned>  m_used;
+    /* Evictions and hits since the cache was last cleared or grown. */
+    unsigned               m_evictions = 0;
+    unsigned               m_hits = 0;
+    /* Evictions and growths not yet added to `m_stats`. We only update the shared counters in `clear`. */
+    unsigned               m_pending_evictions = 0;
+    unsigned               m_pending_growths = 0;
+    growable_cache_stats & m_stats;
+
+    void grow() {
+        std::vector<Entry> old(2 * m_capacity);
+        old.swap(m_cache);
+        m_capacity *= 2;
+        std::vector<unsigned> old_used;
+        old_used.swap(m_used);
+        for (unsigned i : old_used) {
+            Entry & e = old[i];
+            unsigned j = e.m_hash % m_capacity;
+            if (m_cache[j].empty()) {
+                m_used.push_back(j);
+                m_cache[j] = std::move(e);
+            }
+        }
+        m_evictions = 0;
+        m_hits = 0;
+        m_pending_growths++;
+    }
+
+    void flush_stats() {
+        if (m_pending_evictions > 0) {
+            m_stats.m_evictions += m_pending_evictions;
+            m_stats.m_growths   += m_pending_growths;
+            m_pending_evictions = 0;
+            m_pending_growths   = 0;
+        }
+    }
+public:
+    growable_cache(unsigned capacity, growable_cache_stats & stats):
+        m_initial_capacity(capacity), m_capacity(capacity), m_cache(capacity), m_stats(stats) {}
+    ~growable_cache() { flush_stats(); }
+
+    /** \brief Return the slot for hash code \c h. The caller must check whether it contains the expected key. */
+    Entry & get(unsigned h) { return m_cache[h % m_capacity]; }
+
+    /** \brief Report that the slot returned by `get` contained the expected key. */
+    void record_hit() { m_hits++; }
+
+    unsigned capacity() const { return m_capacity; }
+
+    void insert(Entry && e) {
+        unsigned i = e.m_hash % m_capacity;
+        if (m_cache[i].empty()) {
+            m_used.push_back(i);
+        } else {
+            m_pending_evictions++;
+            if (++m_evictions > m_capacity / 2 && 2 * m_capacity <= LEAN_MAX_GROWABLE_CACHE_CAPACITY &&
+                static_cast<uint64>(m_hits) * LEAN_GROWABLE_CACHE_EVICTIONS_PER_HIT >= m_evictions) {
+                grow();
+                i = e.m_hash % m_capacity;
+                if (m_cache[i].empty())
+                    m_used.push_back(i);
+            }
+        }
+        m_cache[i] = std::move(e);
+    }
+
+    void clear() {
+        if (m_capacity != m_initial_capacity) {
+            m_cache = std::vector<Entry>(m_initial_capacity);
+            m_capacity = m_initial_capacity;
+        } else {
+            for (unsigned i : m_used)
+                m_cache[i].reset();
+        }
+        m_used.clear();
+        m_evictions = 0;
+        m_hits = 0;
+        flush_stats();
+    }
+};
+}
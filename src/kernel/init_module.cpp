@@ -13,6 +13,9 @@ Author: Leonardo de Moura
 #include "kernel/inductive.h"
 #include "kernel/quot.h"
 #include "kernel/trace.h"
+#include "kernel/shared_cache.h"
+#include "kernel/max_sharing.h"
+#include "kernel/reduce_lit.h"
 
 namespace lean {
 void initialize_kernel_module() {
@@ -25,9 +28,15 @@ void initialize_kernel_module() {
     initialize_inductive();
     initialize_quot();
     initialize_trace();
+    initialize_shared_cache();
+    initialize_max_sharing();
+    initialize_reduce_lit();
 }
 
 void finalize_kernel_module() {
+    finalize_reduce_lit();
+    finalize_max_sharing();
+    finalize_shared_cache();
     finalize_trace();
     finalize_quot();
     finalize_inductive();
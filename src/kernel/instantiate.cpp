@@ -6,11 +6,19 @@ Author: Leonardo de Moura
 */
 #include <algorithm>
 #include <limits>
+#include <vector>
+#include <iostream>
+#include "runtime/hash.h"
+#include "runtime/thread.h"
 #include "kernel/replace_fn.h"
 #include "kernel/declaration.h"
 #include "kernel/kernel_exception.h"
 #include "kernel/instantiate.h"
 
+#ifndef LEAN_INST_LPARAMS_CACHE_CAPACITY
+#define LEAN_INST_LPARAMS_CACHE_CAPACITY 1024*4
+#endif
+
 namespace lean {
 expr instantiate(expr const & a, unsigned s, unsigned n, expr const * subst) {
     if (s >= get_loose_bvar_range(a) || n == 0)
@@ -229,6 +237,48 @@ expr instantiate_lparams(expr const & e, names const & lps, levels const & ls) {
         });
 }
 
+#ifdef LEAN_RUNTIME_STATS
+static atomic<uint64> g_inst_lparams_hits(0);
+static atomic<uint64> g_inst_lparams_misses(0);
+struct inst_lparams_stats {
+    ~inst_lparams_stats() {
+        std::cerr << "inst. lparams cache hits:   " << g_inst_lparams_hits << "\n";
+        std::cerr << "inst. lparams cache misses: " << g_inst_lparams_misses << "\n";
+    }
+};
+static inst_lparams_stats g_inst_lparams_stats;
+#endif
+
+static unsigned inst_lparams_hash(name const & n, levels const & ls, bool value) {
+    uint64 h = n.hash();
+    for (level const & l : ls)
+        h = ::lean::hash(h, static_cast<uint64>(::lean::hash(l)));
+    return static_cast<unsigned>(h) + value;
+}
+
+expr inst_lparams_cache::instantiate(constant_info const & info, expr const & src, levels const & ls, bool value) {
+    if (m_cache.empty())
+        m_cache.resize(LEAN_INST_LPARAMS_CACHE_CAPACITY);
+    entry & e = m_cache[inst_lparams_hash(info.get_name(), ls, value) % LEAN_INST_LPARAMS_CACHE_CAPACITY];
+    if (e.m_src && is_eqp(*e.m_src, src) && e.m_name == info.get_name() &&
+        e.m_ls == ls && e.m_lps == info.get_lparams()) {
+#ifdef LEAN_RUNTIME_STATS
+        g_inst_lparams_hits++;
+#endif
+        return e.m_result;
+    }
+#ifdef LEAN_RUNTIME_STATS
+    g_inst_lparams_misses++;
+#endif
+    expr r = instantiate_lparams(src, info.get_lparams(), ls);
+    e.m_src    = src;
+    e.m_name   = info.get_name();
+    e.m_lps    = info.get_lparams();
+    e.m_ls     = ls;
+    e.m_result = r;
+    return r;
+}
+
 expr instantiate_type_lparams(constant_info const & info, levels const & ls) {
     if (info.get_num_lparams() != length(ls))
         lean_internal_panic("#universes mismatch at instantiateTypeLevelParams");
@@ -247,4 +297,21 @@ expr instantiate_value_lparams(constant_info const & info, levels const & ls) {
     return instantiate_lparams(info.get_value(), info.get_lparams(), ls);
 }
 
+expr instantiate_type_lparams(constant_info const & info, levels const & ls, inst_lparams_cache & cache) {
+    if (info.get_num_lparams() != length(ls))
+        lean_internal_panic("#universes mismatch at instantiateTypeLevelParams");
+    if (is_nil(ls) || !has_param_univ(info.get_type()))
+        return info.get_type();
+    return cache.instantiate(info, info.get_type(), ls, false);
+}
+
+expr instantiate_value_lparams(constant_info const & info, levels const & ls, inst_lparams_cache & cache) {
+    if (info.get_num_lparams() != length(ls))
+        lean_internal_panic("#universes mismatch at instantiateValueLevelParams");
+    if (!info.has_value())
+        lean_internal_panic("definition/theorem expected at instantiateValueLevelParams");
+    if (is_nil(ls) || !has_param_univ(info.get_value()))
+        return info.get_value();
+    return cache.instantiate(info, info.get_value(), ls, true);
+}
 }
@@ -6,6 +6,7 @@ Author: Leonardo de Moura
 */
 #pragma once
 #include <functional>
+#include <vector>
 #include "kernel/expr.h"
 
 namespace lean {
@@ -42,4 +43,35 @@ expr instantiate_type_lparams(constant_info const & info, levels const & ls);
 /** \brief Instantiate the universe level parameters of the value of the given constant.
     \pre d.get_num_lparams() == length(ls) */
 expr instantiate_value_lparams(constant_info const & info, levels const & ls);
+
+/** \brief Cache for `instantiate_type_lparams` and `instantiate_value_lparams`. The same constant is often
+    used with the same universe levels many times (e.g., in universe polymorphic algebraic hierarchies),
+    and we want to avoid traversing its type/value again. It also makes sure the results are shared.
+
+    Entries are keyed by the constant name and universe levels. We also store the uninstantiated
+    type/value, which must be pointer equal on lookup, and the universe parameter names. Thus, we never
+    return a result for a different constant with the same name (e.g., from a different environment).
+
+    The cache is owned by its client (e.g., the type checker state) and must not outlive the environment
+    whose constants it stores, since they may live in compacted regions.
+
+    \warning `instantiate` overwrites any entry with the same hash code. */
+class inst_lparams_cache {
+    struct entry {
+        optional<expr> m_src;
+        name           m_name;
+        names          m_lps;
+        levels         m_ls;
+        expr           m_result;
+    };
+    /* Allocated on first use, most type checker states never unfold a universe polymorphic constant. */
+    std::vector<entry> m_cache;
+public:
+    expr instantiate(constant_info const & info, expr const & src, levels const & ls, bool value);
+};
+
+/** \brief Similar to `instantiate_type_lparams(info, ls)`, but reuses results stored in `cache`. */
+expr instantiate_type_lparams(constant_info const & info, levels const & ls, inst_lparams_cache & cache);
+/** \brief Similar to `instantiate_value_lparams(info, ls)`, but reuses results stored in `cache`. */
+expr instantiate_value_lparams(constant_info const & info, levels const & ls, inst_lparams_cache & cache);
 }
@@ -0,0 +1,294 @@
+/*
+Copyright (c) 2013 Microsoft Corporation. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Leonardo de Moura
+*/
+#include <tuple>
+#include <algorithm>
+#include <unordered_set>
+#include <unordered_map>
+#include <functional>
+#include <cstdlib>
+#include <iostream>
+#include "runtime/interrupt.h"
+#include "runtime/buffer.h"
+#include "runtime/thread.h"
+#include "kernel/max_sharing.h"
+
+#ifndef LEAN_HASH_CONS_NUM_SHARDS
+#define LEAN_HASH_CONS_NUM_SHARDS 64
+#endif
+
+namespace lean {
+/**
+   \brief Implementation of the functional object for creating expressions with maximally
+   shared sub-expressions.
+*/
+struct max_sharing_fn::imp {
+    typedef typename std::unordered_set<expr, expr_hash, is_bi_equal_proc> expr_cache;
+    typedef typename std::unordered_set<level, level_hash>                 level_cache;
+    expr_cache  m_expr_cache;
+    level_cache m_lvl_cache;
+
+    level apply(level const & l) {
+        auto r = m_lvl_cache.find(l);
+        if (r != m_lvl_cache.end())
+            return *r;
+        level res;
+        switch (l.kind()) {
+        case level_kind::Zero:   case level_kind::Param:
+        case level_kind::MVar:
+            res = l;
+            break;
+        case level_kind::Succ:
+            res = update_succ(l, apply(succ_of(l)));
+            break;
+        case level_kind::Max:
+            res = update_max(l, apply(max_lhs(l)), apply(max_rhs(l)));
+            break;
+        case level_kind::IMax:
+            res = update_max(l, apply(imax_lhs(l)), apply(imax_rhs(l)));
+            break;
+        }
+        m_lvl_cache.insert(res);
+        return res;
+    }
+
+    expr apply(expr const & a) {
+        check_system("max_sharing");
+        auto r = m_expr_cache.find(a);
+        if (r != m_expr_cache.end())
+            return *r;
+        expr res;
+        switch (a.kind()) {
+        case expr_kind::BVar: case expr_kind::Lit:
+        case expr_kind::MVar: case expr_kind::FVar:
+            res = a;
+            break;
+        case expr_kind::Const:
+            res = update_constant(a, map(const_levels(a), [&](level const & l) { return apply(l); }));
+            break;
+        case expr_kind::Sort:
+            res = update_sort(a, apply(sort_level(a)));
+            break;
+        case expr_kind::MData: {
+            expr new_e = apply(mdata_expr(a));
+            res = update_mdata(a, new_e);
+            break;
+        }
+        case expr_kind::Proj: {
+            expr new_e = apply(proj_expr(a));
+            res = update_proj(a, new_e);
+            break;
+        }
+        case expr_kind::App: {
+            expr new_f = apply(app_fn(a));
+            expr new_a = apply(app_arg(a));
+            res = update_app(a, new_f, new_a);
+            break;
+        }
+        case expr_kind::Lambda: case expr_kind::Pi: {
+            expr new_d = apply(binding_domain(a));
+            expr new_b = apply(binding_body(a));
+            res = update_binding(a, new_d, new_b);
+            break;
+        }
+        case expr_kind::Let: {
+            expr new_t = apply(let_type(a));
+            expr new_v = apply(let_value(a));
+            expr new_b = apply(let_body(a));
+            res = update_let(a, new_t, new_v, new_b);
+            break;
+        }
+        }
+        m_expr_cache.insert(res);
+        return res;
+    }
+
+    expr operator()(expr const & a) {
+        return apply(a);
+    }
+
+    bool already_processed(expr const & a) const {
+        auto r = m_expr_cache.find(a);
+        return r != m_expr_cache.end() && is_eqp(*r, a);
+    }
+};
+
+max_sharing_fn::max_sharing_fn():m_ptr(new imp) {}
+max_sharing_fn::~max_sharing_fn() {}
+expr max_sharing_fn::operator()(expr const & a) { return (*m_ptr)(a); }
+void max_sharing_fn::clear() { m_ptr->m_expr_cache.clear(); }
+bool max_sharing_fn::already_processed(expr const & a) const { return m_ptr->already_processed(a); }
+
+expr max_sharing(expr const & a) {
+    return max_sharing_fn::imp()(a);
+}
+
+/* Global table for `hash_cons`. It is split into shards, each one protected by its own mutex.
+   All expressions in the table are marked as multi-threaded, and their subterms are also in the table,
+   unless a shard has been flushed.
+   Remark: `is_bi_equal` also compares binder names and binder infos, so the representative returned for a term
+   never changes the names shown in kernel error messages. */
+class hash_cons_table {
+    typedef std::unordered_set<expr, expr_hash, is_bi_equal_proc> expr_set;
+    struct shard {
+        mutex    m_mutex;
+        expr_set m_set;
+    };
+    size_t         m_shard_capacity;
+    shard          m_shards[LEAN_HASH_CONS_NUM_SHARDS];
+    atomic<uint64> m_hits{0};
+    atomic<uint64> m_inserts{0};
+    atomic<uint64> m_flushes{0};
+
+    shard & get_shard(expr const & e) { return m_shards[hash(e) % LEAN_HASH_CONS_NUM_SHARDS]; }
+public:
+    hash_cons_table(size_t capacity):
+        m_shard_capacity(std::max(static_cast<size_t>(1), capacity / LEAN_HASH_CONS_NUM_SHARDS)) {}
+
+    optional<expr> find(expr const & e) {
+        shard & s = get_shard(e);
+        lock_guard<mutex> _(s.m_mutex);
+        auto it = s.m_set.find(e);
+        if (it == s.m_set.end())
+            return none_expr();
+        m_hits++;
+        return some_expr(*it);
+    }
+
+    /* Return the representative of `e`, inserting it if needed. */
+    expr intern(expr const & e) {
+        shard & s = get_shard(e);
+        lock_guard<mutex> _(s.m_mutex);
+        auto it = s.m_set.find(e);
+        if (it != s.m_set.end()) {
+            m_hits++;
+            return *it;
+        }
+        if (s.m_set.size() >= m_shard_capacity) {
+            s.m_set.clear();
+            m_flushes++;
+        }
+        /* Only new entries need to be marked. The subterms produced by `hash_cons_fn` are already
+           in the table, so `lean_mark_mt` usually stops at the children of `e`. */
+        if (lean_is_st(e.raw()))
+            mark_mt(e.raw());
+        s.m_set.insert(e);
+        m_inserts++;
+        return e;
+    }
+
+    void clear() {
+        for (shard & s : m_shards) {
+            lock_guard<mutex> _(s.m_mutex);
+            s.m_set.clear();
+        }
+    }
+
+    void display_stats(std::ostream & out) const {
+        out << "kernel hash-cons table: " << m_hits.load() << " hits, " << m_inserts.load() << " inserts, "
+            << m_flushes.load() << " flushed shards\n";
+    }
+};
+
+static hash_cons_table * g_hash_cons_table = nullptr;
+
+bool is_hash_cons_enabled() {
+    return g_hash_cons_table != nullptr;
+}
+
+/* Intern an expression and its subterms. We stop at subterms that are already in the table,
+   since their own subterms are in the table too. */
+class hash_cons_fn {
+    hash_cons_table &                 m_table;
+    std::unordered_map<object *, expr> m_cache;
+
+    expr visit(expr const & a) {
+        switch (a.kind()) {
+        case expr_kind::BVar: case expr_kind::Lit:
+        case expr_kind::MVar: case expr_kind::FVar:
+        case expr_kind::Sort: case expr_kind::Const:
+            return m_table.intern(a);
+        default:
+            break;
+        }
+        bool shared = is_shared(a);
+        if (shared) {
+            auto it = m_cache.find(a.raw());
+            if (it != m_cache.end())
+                return it->second;
+        }
+        check_system("hash_cons");
+        expr res;
+        if (optional<expr> r = m_table.find(a)) {
+            res = *r;
+        } else {
+            switch (a.kind()) {
+            case expr_kind::MData:
+                res = update_mdata(a, visit(mdata_expr(a)));
+                break;
+            case expr_kind::Proj:
+                res = update_proj(a, visit(proj_expr(a)));
+                break;
+            case expr_kind::App: {
+                expr new_f = visit(app_fn(a));
+                expr new_a = visit(app_arg(a));
+                res = update_app(a, new_f, new_a);
+                break;
+            }
+            case expr_kind::Lambda: case expr_kind::Pi: {
+                expr new_d = visit(binding_domain(a));
+                expr new_b = visit(binding_body(a));
+                res = update_binding(a, new_d, new_b);
+                break;
+            }
+            case expr_kind::Let: {
+                expr new_t = visit(let_type(a));
+                expr new_v = visit(let_value(a));
+                expr new_b = visit(let_body(a));
+                res = update_let(a, new_t, new_v, new_b);
+                break;
+            }
+            default:
+                lean_unreachable();
+            }
+            res = m_table.intern(res);
+        }
+        if (shared)
+            m_cache.insert(mk_pair(a.raw(), res));
+        return res;
+    }
+public:
+    hash_cons_fn(hash_cons_table & t):m_table(t) {}
+    expr operator()(expr const & a) { return visit(a); }
+};
+
+expr hash_cons(expr const & a) {
+    lean_assert(g_hash_cons_table);
+    return hash_cons_fn(*g_hash_cons_table)(a);
+}
+
+void clear_hash_cons_table() {
+    if (g_hash_cons_table)
+        g_hash_cons_table->clear();
+}
+
+void initialize_max_sharing() {
+    if (char const * s = std::getenv("LEAN_KERNEL_HASH_CONS")) {
+        size_t capacity = static_cast<size_t>(std::strtoull(s, nullptr, 10));
+        if (capacity > 0)
+            g_hash_cons_table = new hash_cons_table(capacity);
+    }
+}
+
+void finalize_max_sharing() {
+    if (g_hash_cons_table) {
+        if (std::getenv("LEAN_KERNEL_HASH_CONS_STATS"))
+            g_hash_cons_table->display_stats(std::cerr);
+        delete g_hash_cons_table;
+        g_hash_cons_table = nullptr;
+    }
+}
+}
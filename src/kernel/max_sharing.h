@@ -0,0 +1,63 @@
+/*
+Copyright (c) 2013 Microsoft Corporation. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: Leonardo de Moura
+*/
+#pragma once
+#include <memory>
+#include "kernel/expr.h"
+
+namespace lean {
+/**
+   \brief Functional object for creating expressions with maximally
+   shared sub-expressions.
+*/
+class max_sharing_fn {
+    struct imp;
+    friend expr max_sharing(expr const & a);
+    std::unique_ptr<imp> m_ptr;
+public:
+    max_sharing_fn();
+    ~max_sharing_fn();
+
+    expr operator()(expr const & a);
+
+    /** \brief Return true iff \c a was already processed by this object. */
+    bool already_processed(expr const & a) const;
+
+    /** \brief Clear the cache. */
+    void clear();
+};
+
+/**
+   \brief The resultant expression is structurally identical to the input one, but
+   it uses maximally shared sub-expressions.
+*/
+expr max_sharing(expr const & a);
+
+/** \brief Return true if the kernel hash-consing mode is enabled.
+
+    The mode is disabled by default. It is enabled by setting the environment variable
+    `LEAN_KERNEL_HASH_CONS` to the maximum number of expressions in the hash-cons table.
+    Statistics are printed to `stderr` on exit when `LEAN_KERNEL_HASH_CONS_STATS` is set. */
+bool is_hash_cons_enabled();
+
+/** \brief Return an expression structurally equal to \c a that is interned in a global concurrent
+    table. Thus, the results of `hash_cons` on structurally equal expressions are pointer equal,
+    and so are their subterms.
+
+    \remark When the table is full, part of it is flushed. Pointer equality is an optimization, and
+    it is never required for correctness.
+
+    \pre is_hash_cons_enabled() */
+expr hash_cons(expr const & a);
+
+/** \brief Remove all expressions from the hash-cons table. The table may reference objects in the
+    compacted regions of imported modules, so `Kernel.clearSharedCaches` invokes this function before
+    `Environment.freeRegions` frees them. */
+void clear_hash_cons_table();
+
+void initialize_max_sharing();
+void finalize_max_sharing();
+}
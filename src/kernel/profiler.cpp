@@ -0,0 +1,78 @@
+/*
+Copyright (c) 2026 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: agent
+*/
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include "runtime/thread.h"
+#include "kernel/profiler.h"
+
+#ifndef LEAN_KERNEL_PROFILER_TOP_UNFOLDS
+#define LEAN_KERNEL_PROFILER_TOP_UNFOLDS 10
+#endif
+
+namespace lean {
+LEAN_THREAD_PTR(kernel_profiler, g_kernel_profiler);
+
+kernel_profiler * get_kernel_profiler() {
+    return g_kernel_profiler;
+}
+
+scope_kernel_profiler::scope_kernel_profiler(kernel_profiler * prof):flet<kernel_profiler *>(g_kernel_profiler, prof) {}
+
+static void display_json_string(std::ostream & out, std::string const & s) {
+    static char const hex[] = "0123456789abcdef";
+    out << '"';
+    for (char c : s) {
+        unsigned char u = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (u < 0x20) {
+            out << "\\u00" << hex[u >> 4] << hex[u & 0xf];
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+void kernel_profiler::display_json(std::ostream & out, name const & decl_name, double total_secs) const {
+    static char const * phase_names[num_phases] = {
+        "whnf", "is_def_eq_core", "lazy_delta_reduction_step", "reduce_recursor", "reduce_nat" };
+    static char const * cache_names[num_caches] = { "whnf", "infer_type", "failure" };
+    out << "{\"declaration\":";
+    display_json_string(out, decl_name.to_string());
+    out << ",\"total\":" << total_secs;
+    out << ",\"phases\":{";
+    for (unsigned i = 0; i < num_phases; i++) {
+        if (i > 0) out << ",";
+        out << "\"" << phase_names[i] << "\":" << std::chrono::duration<double>(m_time[i]).count();
+    }
+    out << "},\"caches\":{";
+    for (unsigned i = 0; i < num_caches; i++) {
+        if (i > 0) out << ",";
+        uint64 total = m_hits[i] + m_misses[i];
+        out << "\"" << cache_names[i] << "\":{\"hits\":" << m_hits[i] << ",\"misses\":" << m_misses[i]
+            << ",\"hit_rate\":" << (total > 0 ? static_cast<double>(m_hits[i]) / total : 0.0) << "}";
+    }
+    out << "},\"top_unfolded\":[";
+    std::vector<std::pair<name, uint64>> unfolds(m_unfolds.begin(), m_unfolds.end());
+    size_t n = std::min<size_t>(unfolds.size(), LEAN_KERNEL_PROFILER_TOP_UNFOLDS);
+    std::partial_sort(unfolds.begin(), unfolds.begin() + n, unfolds.end(),
+                      [](std::pair<name, uint64> const & a, std::pair<name, uint64> const & b) {
+                          if (a.second != b.second)
+                              return a.second > b.second;
+                          return quick_cmp(a.first, b.first) < 0;
+                      });
+    for (size_t i = 0; i < n; i++) {
+        if (i > 0) out << ",";
+        out << "{\"name\":";
+        display_json_string(out, unfolds[i].first.to_string());
+        out << ",\"count\":" << unfolds[i].second << "}";
+    }
+    out << "]}\n";
+}
+}
@@ -0,0 +1,78 @@
+/*
+Copyright (c) 2026 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: agent
+*/
+#pragma once
+#include <chrono>
+#include <iosfwd>
+#include <unordered_map>
+#include "runtime/flet.h"
+#include "util/name.h"
+
+namespace lean {
+/** \brief Breakdown of the time spent by the kernel type checker on a single declaration.
+
+    A profiler is installed for the current thread using `scope_kernel_profiler`, and it is
+    picked up by all type checkers created in that scope. See the `profiler.kernel` option.
+
+    \remark Profilers are not propagated to other threads, so declarations checked in tasks
+    (e.g., by `add_decls_parallel_fn`) are not profiled. */
+class kernel_profiler {
+public:
+    enum class phase { Whnf, IsDefEqCore, LazyDeltaReductionStep, ReduceRecursor, ReduceNat };
+    enum class cache { Whnf, InferType, Failure };
+private:
+    typedef std::chrono::steady_clock clock;
+    static constexpr unsigned num_phases = 5;
+    static constexpr unsigned num_caches = 3;
+    unsigned                  m_depth[num_phases] = {};
+    clock::time_point         m_start[num_phases];
+    clock::duration           m_time[num_phases] = {};
+    uint64                    m_hits[num_caches] = {};
+    uint64                    m_misses[num_caches] = {};
+    std::unordered_map<name, uint64, name_hash_fn, name_eq_fn> m_unfolds;
+public:
+    /* Phases may be reentered, e.g., `whnf` invokes `whnf` recursively. Only the outermost
+       invocation is timed so that the reported times are not counted twice. */
+    void enter(phase p) {
+        unsigned i = static_cast<unsigned>(p);
+        if (m_depth[i]++ == 0)
+            m_start[i] = clock::now();
+    }
+    void exit(phase p) {
+        unsigned i = static_cast<unsigned>(p);
+        if (--m_depth[i] == 0)
+            m_time[i] += clock::now() - m_start[i];
+    }
+    void record_cache(cache c, bool hit) {
+        unsigned i = static_cast<unsigned>(c);
+        if (hit) m_hits[i]++; else m_misses[i]++;
+    }
+    void record_unfold(name const & n) { m_unfolds[n]++; }
+    /** \brief Display the profile as a single-line JSON object. */
+    void display_json(std::ostream & out, name const & decl_name, double total_secs) const;
+};
+
+/** \brief Time the execution of a phase when \c prof is not null. */
+class kernel_profiler_scope {
+    kernel_profiler *        m_prof;
+    kernel_profiler::phase   m_phase;
+public:
+    kernel_profiler_scope(kernel_profiler * prof, kernel_profiler::phase p):m_prof(prof), m_phase(p) {
+        if (m_prof) m_prof->enter(m_phase);
+    }
+    ~kernel_profiler_scope() {
+        if (m_prof) m_prof->exit(m_phase);
+    }
+};
+
+/** \brief Return the profiler installed for the current thread, if any. */
+kernel_profiler * get_kernel_profiler();
+
+class scope_kernel_profiler : flet<kernel_profiler *> {
+public:
+    scope_kernel_profiler(kernel_profiler * prof);
+};
+}
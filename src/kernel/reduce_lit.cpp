@@ -0,0 +1,356 @@
+/*
+Copyright (c) 2026 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: agent
+*/
+#include <unordered_map>
+#include "util/nat.h"
+#include "kernel/reduce_lit.h"
+
+#ifndef LEAN_REDUCE_LIT_MAX_EXP
+#define LEAN_REDUCE_LIT_MAX_EXP (1u << 24)
+#endif
+
+namespace lean {
+enum class lit_ext_kind { Int, Fin, UInt, BitVec };
+enum class lit_ext_op { Add, Sub, Mul, Neg, Div, Mod, EDiv, EMod, Pow, Land, Lor, Xor, ShiftLeft, ShiftRight };
+
+/* Entry of the extension table. The arguments of an operation are:
+   - `Int`:    the operands, where the exponent of `Int.pow` is a `Nat`.
+   - `Fin`:    the bound `n`, and the operands.
+   - `UInt`:   the operands.
+   - `BitVec`: the width `w`, and the operands, where the shift amount is a `Nat`. */
+struct lit_ext_entry {
+    lit_ext_kind m_kind;
+    lit_ext_op   m_op;
+    unsigned     m_nargs;
+    /* Number of bits and constructor of `UIntN`. */
+    unsigned     m_bits;
+    name         m_mk;
+};
+
+typedef std::unordered_map<name, lit_ext_entry, name_hash_fn, name_eq_fn> lit_ext_table;
+static lit_ext_table * g_lit_ext_table = nullptr;
+
+static name * g_nat         = nullptr;
+static name * g_nat_zero    = nullptr;
+static name * g_nat_dec_lt  = nullptr;
+static name * g_inst_lt_nat = nullptr;
+static name * g_lt          = nullptr;
+static name * g_bool        = nullptr;
+static name * g_bool_true   = nullptr;
+static name * g_eq_refl     = nullptr;
+static name * g_of_decide_eq_true = nullptr;
+static name * g_int_of_nat  = nullptr;
+static name * g_int_neg_succ = nullptr;
+static name * g_fin_mk      = nullptr;
+static name * g_bitvec_of_fin = nullptr;
+
+typedef std::function<expr(expr const &)> whnf_fn;
+
+static bool is_app_of(expr const & e, name const & c, unsigned nargs) {
+    expr const & f = get_app_fn(e);
+    return is_constant(f) && const_name(f) == c && get_app_num_args(e) == nargs;
+}
+
+static optional<nat> get_nat_val(expr const & e) {
+    if (is_nat_lit(e))
+        return optional<nat>(lit_value(e).get_nat());
+    if (is_constant(e) && const_name(e) == *g_nat_zero)
+        return optional<nat>(nat());
+    return optional<nat>();
+}
+
+/* `Int.ofNat v` or `Int.negSucc v`, as an `Int` runtime object. */
+static optional<object_ref> get_int_val(expr const & e, whnf_fn const & whnf) {
+    expr v = whnf(e);
+    bool neg;
+    if (is_app_of(v, *g_int_of_nat, 1)) {
+        neg = false;
+    } else if (is_app_of(v, *g_int_neg_succ, 1)) {
+        neg = true;
+    } else {
+        return optional<object_ref>();
+    }
+    optional<nat> n = get_nat_val(whnf(app_arg(v)));
+    if (!n) return optional<object_ref>();
+    return optional<object_ref>(object_ref(neg ? lean_int_neg_succ_of_nat(n->to_obj_arg()) : lean_nat_to_int(n->to_obj_arg())));
+}
+
+/* `Fin.mk n v h` */
+static optional<nat> get_fin_val(expr const & e, whnf_fn const & whnf) {
+    expr v = whnf(e);
+    if (!is_app_of(v, *g_fin_mk, 3)) return optional<nat>();
+    return get_nat_val(whnf(app_arg(app_fn(v))));
+}
+
+/* `UIntN.mk (Fin.mk n v h)` */
+static optional<nat> get_uint_val(expr const & e, name const & mk, whnf_fn const & whnf) {
+    expr v = whnf(e);
+    if (!is_app_of(v, mk, 1)) return optional<nat>();
+    return get_fin_val(app_arg(v), whnf);
+}
+
+/* `BitVec.ofFin w (Fin.mk n v h)` */
+static optional<nat> get_bitvec_val(expr const & e, whnf_fn const & whnf) {
+    expr v = whnf(e);
+    if (!is_app_of(v, *g_bitvec_of_fin, 2)) return optional<nat>();
+    return get_fin_val(app_arg(v), whnf);
+}
+
+/* Cheap test performed on the arguments of an operation before using `whnf` on them. Literal values, and the closed
+   terms that usually reduce to them (e.g., `OfNat.ofNat Int 7 inst` or `Int.add a b`), are applications of a constant
+   or literals. We give up on anything else, in particular on terms containing free variables. They are common during
+   lazy delta reduction, and putting them in weak head normal form would be wasted work. */
+static bool is_lit_val_candidate(expr const & e) {
+    if (has_fvar(e) || has_loose_bvars(e)) return false;
+    expr const & f = get_app_fn(e);
+    return is_constant(f) || is_lit(f);
+}
+
+static expr mk_nat_lit(nat const & v) { return mk_lit(literal(v)); }
+
+static expr mk_int_val(object_ref const & i) {
+    if (lean_int_lt(i.raw(), lean_box(0))) {
+        nat abs(lean_nat_abs(i.raw()));
+        return mk_app(mk_const(*g_int_neg_succ), mk_nat_lit(abs - nat(1u)));
+    } else {
+        return mk_app(mk_const(*g_int_of_nat), mk_nat_lit(nat(lean_nat_abs(i.raw()))));
+    }
+}
+
+/* `Fin.mk m r (of_decide_eq_true (Eq.refl true) : r < m)`, or `none` if `r < m` does not hold or the
+   constants used in the proof are not available. */
+static optional<expr> mk_fin_val(environment const & env, nat const & m, nat const & r) {
+    if (!(r < m) || !env.find(*g_of_decide_eq_true) || !env.find(*g_nat_dec_lt))
+        return none_expr();
+    expr m_lit = mk_nat_lit(m);
+    expr r_lit = mk_nat_lit(r);
+    expr lt    = mk_app({mk_const(*g_lt, levels(mk_level_zero())), mk_const(*g_nat), mk_const(*g_inst_lt_nat), r_lit, m_lit});
+    expr dec   = mk_app(mk_const(*g_nat_dec_lt), r_lit, m_lit);
+    expr rfl   = mk_app(mk_const(*g_eq_refl, levels(mk_level_one())), mk_const(*g_bool), mk_const(*g_bool_true));
+    expr h     = mk_app(mk_const(*g_of_decide_eq_true), lt, dec, rfl);
+    return some_expr(mk_app(mk_const(*g_fin_mk), m_lit, r_lit, h));
+}
+
+static optional<expr> reduce_int(lit_ext_op op, buffer<expr> const & args, whnf_fn const & whnf) {
+    optional<object_ref> a = get_int_val(args[0], whnf);
+    if (!a) return none_expr();
+    if (op == lit_ext_op::Neg)
+        return some_expr(mk_int_val(object_ref(lean_int_neg(a->raw()))));
+    if (op == lit_ext_op::Pow) {
+        optional<nat> k = get_nat_val(whnf(args[1]));
+        if (!k || *k > nat(LEAN_REDUCE_LIT_MAX_EXP)) return none_expr();
+        nat abs(lean_nat_abs(a->raw()));
+        object_ref r(lean_nat_to_int(nat_pow(abs.raw(), k->raw())));
+        if (lean_int_lt(a->raw(), lean_box(0)) && !(*k % nat(2u)).is_zero())
+            r = object_ref(lean_int_neg(r.raw()));
+        return some_expr(mk_int_val(r));
+    }
+    optional<object_ref> b = get_int_val(args[1], whnf);
+    if (!b) return none_expr();
+    bool b_zero = lean_int_eq(b->raw(), lean_box(0));
+    switch (op) {
+    case lit_ext_op::Add:  return some_expr(mk_int_val(object_ref(lean_int_add(a->raw(), b->raw()))));
+    case lit_ext_op::Sub:  return some_expr(mk_int_val(object_ref(lean_int_sub(a->raw(), b->raw()))));
+    case lit_ext_op::Mul:  return some_expr(mk_int_val(object_ref(lean_int_mul(a->raw(), b->raw()))));
+    /* Division by zero is handled here: the runtime only supports it when both arguments are small. */
+    case lit_ext_op::Div:
+        if (b_zero) return some_expr(mk_int_val(object_ref(lean_box(0))));
+        return some_expr(mk_int_val(object_ref(lean_int_div(a->raw(), b->raw()))));
+    case lit_ext_op::EDiv:
+        if (b_zero) return some_expr(mk_int_val(object_ref(lean_box(0))));
+        return some_expr(mk_int_val(object_ref(lean_int_ediv(a->raw(), b->raw()))));
+    case lit_ext_op::Mod:
+        if (b_zero) return some_expr(mk_int_val(*a));
+        return some_expr(mk_int_val(object_ref(lean_int_mod(a->raw(), b->raw()))));
+    case lit_ext_op::EMod:
+        if (b_zero) return some_expr(mk_int_val(*a));
+        return some_expr(mk_int_val(object_ref(lean_int_emod(a->raw(), b->raw()))));
+    default:
+        return none_expr();
+    }
+}
+
+/* Value of a `Fin`, `UIntN` or `BitVec` operation with modulus `m`, following the definitions in `Init`. */
+static optional<nat> eval_mod_op(lit_ext_entry const & d, nat const & m, nat const & a, nat const & b) {
+    bool bv = d.m_kind == lit_ext_kind::BitVec;
+    switch (d.m_op) {
+    case lit_ext_op::Add:  return optional<nat>((a + b) % m);
+    case lit_ext_op::Sub:  return optional<nat>(((m - b) + a) % m);
+    case lit_ext_op::Mul:  return optional<nat>((a * b) % m);
+    case lit_ext_op::Neg:  return optional<nat>((m - a) % m);
+    case lit_ext_op::Div:  return optional<nat>(a / b);
+    case lit_ext_op::Mod:  return optional<nat>(a % b);
+    case lit_ext_op::Land: { nat r(nat_land(a.raw(), b.raw())); return optional<nat>(bv ? r : r % m); }
+    case lit_ext_op::Lor:  { nat r(nat_lor(a.raw(), b.raw()));  return optional<nat>(bv ? r : r % m); }
+    case lit_ext_op::Xor:  { nat r(nat_lxor(a.raw(), b.raw())); return optional<nat>(bv ? r : r % m); }
+    case lit_ext_op::ShiftLeft: case lit_ext_op::ShiftRight: {
+        /* `UIntN` shifts take the shift amount modulo `N`. */
+        nat s = bv ? b : b % nat(d.m_bits);
+        if (s > nat(LEAN_REDUCE_LIT_MAX_EXP)) return optional<nat>();
+        if (d.m_op == lit_ext_op::ShiftLeft)
+            return optional<nat>(nat(lean_nat_shiftl(a.raw(), s.raw())) % m);
+        nat r(lean_nat_shiftr(a.raw(), s.raw()));
+        return optional<nat>(bv ? r : r % m);
+    }
+    default:
+        return optional<nat>();
+    }
+}
+
+optional<expr> reduce_lit_ext(environment const & env, expr const & e, whnf_fn const & whnf) {
+    expr const & fn = get_app_fn(e);
+    if (!is_constant(fn)) return none_expr();
+    auto it = g_lit_ext_table->find(const_name(fn));
+    if (it == g_lit_ext_table->end()) return none_expr();
+    lit_ext_entry const & d = it->second;
+    if (get_app_num_args(e) != d.m_nargs) return none_expr();
+    buffer<expr> args;
+    get_app_args(e, args);
+    for (expr const & a : args) {
+        if (!is_lit_val_candidate(a))
+            return none_expr();
+    }
+    switch (d.m_kind) {
+    case lit_ext_kind::Int:
+        return reduce_int(d.m_op, args, whnf);
+    case lit_ext_kind::Fin: {
+        optional<nat> m = get_nat_val(whnf(args[0]));
+        if (!m) return none_expr();
+        optional<nat> a = get_fin_val(args[1], whnf);
+        if (!a) return none_expr();
+        optional<nat> b = get_fin_val(args[2], whnf);
+        if (!b) return none_expr();
+        optional<nat> r = eval_mod_op(d, *m, *a, *b);
+        if (!r) return none_expr();
+        return mk_fin_val(env, *m, *r);
+    }
+    case lit_ext_kind::UInt: {
+        optional<nat> a = get_uint_val(args[0], d.m_mk, whnf);
+        if (!a) return none_expr();
+        optional<nat> b = get_uint_val(args[1], d.m_mk, whnf);
+        if (!b) return none_expr();
+        nat m(nat_pow(nat(2u).raw(), nat(d.m_bits).raw()));
+        optional<nat> r = eval_mod_op(d, m, *a, *b);
+        if (!r) return none_expr();
+        if (optional<expr> v = mk_fin_val(env, m, *r))
+            return some_expr(mk_app(mk_const(d.m_mk), *v));
+        return none_expr();
+    }
+    case lit_ext_kind::BitVec: {
+        optional<nat> w = get_nat_val(whnf(args[0]));
+        if (!w || *w > nat(LEAN_REDUCE_LIT_MAX_EXP)) return none_expr();
+        optional<nat> a = get_bitvec_val(args[1], whnf);
+        if (!a) return none_expr();
+        optional<nat> b;
+        if (d.m_op == lit_ext_op::ShiftLeft || d.m_op == lit_ext_op::ShiftRight)
+            b = get_nat_val(whnf(args[2]));
+        else if (d.m_op == lit_ext_op::Neg)
+            b = nat();
+        else
+            b = get_bitvec_val(args[2], whnf);
+        if (!b) return none_expr();
+        nat m(nat_pow(nat(2u).raw(), w->raw()));
+        optional<nat> r = eval_mod_op(d, m, *a, *b);
+        if (!r) return none_expr();
+        if (optional<expr> v = mk_fin_val(env, m, *r))
+            return some_expr(mk_app(mk_const(*g_bitvec_of_fin), mk_nat_lit(*w), *v));
+        return none_expr();
+    }
+    }
+    lean_unreachable();
+}
+
+static void add_lit_ext(name const & n, lit_ext_kind k, lit_ext_op op, unsigned nargs, unsigned bits = 0, name const & mk = name()) {
+    g_lit_ext_table->insert(mk_pair(n, lit_ext_entry{k, op, nargs, bits, mk}));
+}
+
+static name * new_persistent_name(name const & n) {
+    name * r = new name(n);
+    mark_persistent(r->raw());
+    return r;
+}
+
+void initialize_reduce_lit() {
+    g_nat          = new_persistent_name("Nat");
+    g_nat_zero     = new_persistent_name({"Nat", "zero"});
+    g_nat_dec_lt   = new_persistent_name({"Nat", "decLt"});
+    g_inst_lt_nat  = new_persistent_name("instLTNat");
+    g_lt           = new_persistent_name({"LT", "lt"});
+    g_bool         = new_persistent_name("Bool");
+    g_bool_true    = new_persistent_name({"Bool", "true"});
+    g_eq_refl      = new_persistent_name({"Eq", "refl"});
+    g_of_decide_eq_true = new_persistent_name("of_decide_eq_true");
+    g_int_of_nat   = new_persistent_name({"Int", "ofNat"});
+    g_int_neg_succ = new_persistent_name({"Int", "negSucc"});
+    g_fin_mk       = new_persistent_name({"Fin", "mk"});
+    g_bitvec_of_fin = new_persistent_name({"BitVec", "ofFin"});
+
+    g_lit_ext_table = new lit_ext_table();
+    add_lit_ext({"Int", "add"},  lit_ext_kind::Int, lit_ext_op::Add,  2);
+    add_lit_ext({"Int", "sub"},  lit_ext_kind::Int, lit_ext_op::Sub,  2);
+    add_lit_ext({"Int", "mul"},  lit_ext_kind::Int, lit_ext_op::Mul,  2);
+    add_lit_ext({"Int", "neg"},  lit_ext_kind::Int, lit_ext_op::Neg,  1);
+    add_lit_ext({"Int", "div"},  lit_ext_kind::Int, lit_ext_op::Div,  2);
+    add_lit_ext({"Int", "mod"},  lit_ext_kind::Int, lit_ext_op::Mod,  2);
+    add_lit_ext({"Int", "ediv"}, lit_ext_kind::Int, lit_ext_op::EDiv, 2);
+    add_lit_ext({"Int", "emod"}, lit_ext_kind::Int, lit_ext_op::EMod, 2);
+    add_lit_ext({"Int", "pow"},  lit_ext_kind::Int, lit_ext_op::Pow,  2);
+
+    add_lit_ext({"Fin", "add"}, lit_ext_kind::Fin, lit_ext_op::Add,  3);
+    add_lit_ext({"Fin", "sub"}, lit_ext_kind::Fin, lit_ext_op::Sub,  3);
+    add_lit_ext({"Fin", "mul"}, lit_ext_kind::Fin, lit_ext_op::Mul,  3);
+    add_lit_ext({"Fin", "div"}, lit_ext_kind::Fin, lit_ext_op::Div,  3);
+    add_lit_ext({"Fin", "mod"}, lit_ext_kind::Fin, lit_ext_op::Mod,  3);
+    add_lit_ext({"Fin", "land"}, lit_ext_kind::Fin, lit_ext_op::Land, 3);
+    add_lit_ext({"Fin", "lor"}, lit_ext_kind::Fin, lit_ext_op::Lor,  3);
+    add_lit_ext({"Fin", "xor"}, lit_ext_kind::Fin, lit_ext_op::Xor,  3);
+
+    /* `USize` is not included because its size depends on the platform. */
+    for (unsigned bits : {8u, 16u, 32u, 64u}) {
+        name t(std::string("UInt") + std::to_string(bits));
+        name mk(t, "mk");
+        add_lit_ext(name(t, "add"),  lit_ext_kind::UInt, lit_ext_op::Add,  2, bits, mk);
+        add_lit_ext(name(t, "sub"),  lit_ext_kind::UInt, lit_ext_op::Sub,  2, bits, mk);
+        add_lit_ext(name(t, "mul"),  lit_ext_kind::UInt, lit_ext_op::Mul,  2, bits, mk);
+        add_lit_ext(name(t, "div"),  lit_ext_kind::UInt, lit_ext_op::Div,  2, bits, mk);
+        add_lit_ext(name(t, "mod"),  lit_ext_kind::UInt, lit_ext_op::Mod,  2, bits, mk);
+        add_lit_ext(name(t, "land"), lit_ext_kind::UInt, lit_ext_op::Land, 2, bits, mk);
+        add_lit_ext(name(t, "lor"),  lit_ext_kind::UInt, lit_ext_op::Lor,  2, bits, mk);
+        add_lit_ext(name(t, "xor"),  lit_ext_kind::UInt, lit_ext_op::Xor,  2, bits, mk);
+        add_lit_ext(name(t, "shiftLeft"),  lit_ext_kind::UInt, lit_ext_op::ShiftLeft,  2, bits, mk);
+        add_lit_ext(name(t, "shiftRight"), lit_ext_kind::UInt, lit_ext_op::ShiftRight, 2, bits, mk);
+    }
+
+    add_lit_ext({"BitVec", "add"},  lit_ext_kind::BitVec, lit_ext_op::Add,  3);
+    add_lit_ext({"BitVec", "sub"},  lit_ext_kind::BitVec, lit_ext_op::Sub,  3);
+    add_lit_ext({"BitVec", "mul"},  lit_ext_kind::BitVec, lit_ext_op::Mul,  3);
+    add_lit_ext({"BitVec", "neg"},  lit_ext_kind::BitVec, lit_ext_op::Neg,  2);
+    add_lit_ext({"BitVec", "udiv"}, lit_ext_kind::BitVec, lit_ext_op::Div,  3);
+    add_lit_ext({"BitVec", "umod"}, lit_ext_kind::BitVec, lit_ext_op::Mod,  3);
+    add_lit_ext({"BitVec", "and"},  lit_ext_kind::BitVec, lit_ext_op::Land, 3);
+    add_lit_ext({"BitVec", "or"},   lit_ext_kind::BitVec, lit_ext_op::Lor,  3);
+    add_lit_ext({"BitVec", "xor"},  lit_ext_kind::BitVec, lit_ext_op::Xor,  3);
+    add_lit_ext({"BitVec", "shiftLeft"},   lit_ext_kind::BitVec, lit_ext_op::ShiftLeft,  3);
+    add_lit_ext({"BitVec", "ushiftRight"}, lit_ext_kind::BitVec, lit_ext_op::ShiftRight, 3);
+}
+
+void finalize_reduce_lit() {
+    delete g_lit_ext_table;
+    delete g_nat;
+    delete g_nat_zero;
+    delete g_nat_dec_lt;
+    delete g_inst_lt_nat;
+    delete g_lt;
+    delete g_bool;
+    delete g_bool_true;
+    delete g_eq_refl;
+    delete g_of_decide_eq_true;
+    delete g_int_of_nat;
+    delete g_int_neg_succ;
+    delete g_fin_mk;
+    delete g_bitvec_of_fin;
+}
+}
@@ -0,0 +1,31 @@
+/*
+Copyright (c) 2026 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: agent
+*/
+#pragma once
+#include <functional>
+#include "kernel/environment.h"
+
+namespace lean {
+/** \brief Trusted reductions for `Int`, `Fin`, `UIntN` and `BitVec` operations on literal values.
+
+    They complement the `Nat` literal reductions performed by the type checker. Given an application `f a_1 ... a_n`
+    of one of the operations in the extension table whose arguments are closed applications of constants or literals,
+    the arguments are put in weak head normal form using `whnf`, and if all of them are literal values, i.e.,
+    - `Int.ofNat v` or `Int.negSucc v`,
+    - `Fin.mk n v h`,
+    - `UIntN.mk (Fin.mk n v h)`,
+    - `BitVec.ofFin w (Fin.mk n v h)`,
+    where `v` is a `Nat` literal, the result is computed using GMP and returned in the same form. The proof
+    `h` in the resulting `Fin.mk n v h` is `of_decide_eq_true (Eq.refl true)`. Like all results of reductions, it
+    is not type checked by the kernel. It is well-typed because it is only built when `v < n` holds.
+
+    Return `none` if the application is not in the table, or if some argument is not a literal value. In this case,
+    the type checker falls back to unfolding the operation. */
+optional<expr> reduce_lit_ext(environment const & env, expr const & e, std::function<expr(expr const &)> const & whnf);
+
+void initialize_reduce_lit();
+void finalize_reduce_lit();
+}
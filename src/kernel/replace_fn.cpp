@@ -8,48 +8,48 @@ Author: Leonardo de Moura
 #include <memory>
 #include "kernel/replace_fn.h"
 #include "kernel/cache_stack.h"
+#include "kernel/growable_cache.h"
 
 #ifndef LEAN_DEFAULT_REPLACE_CACHE_CAPACITY
 #define LEAN_DEFAULT_REPLACE_CACHE_CAPACITY 1024*8
 #endif
 
 namespace lean {
+static growable_cache_stats g_replace_cache_stats("replace");
+
 struct replace_cache {
     struct entry {
         object  *  m_cell;
         unsigned   m_offset;
+        unsigned   m_hash;
         expr       m_result;
         entry():m_cell(nullptr) {}
+        bool empty() const { return m_cell == nullptr; }
+        void reset() { m_cell = nullptr; m_result = expr(); }
     };
-    unsigned              m_capacity;
-    std::vector<entry>    m_cache;
-    std::vector<unsigned> m_used;
-    replace_cache(unsigned c):m_capacity(c), m_cache(c) {}
+    growable_cache<entry> m_cache;
+    replace_cache(unsigned c):m_cache(c, g_replace_cache_stats) {}
 
     expr * find(expr const & e, unsigned offset) {
-        unsigned i = hash(hash(e), offset) % m_capacity;
-        if (m_cache[i].m_cell == e.raw() && m_cache[i].m_offset == offset)
-            return &m_cache[i].m_result;
-        else
+        entry & r = m_cache.get(hash(hash(e), offset));
+        if (r.m_cell == e.raw() && r.m_offset == offset) {
+            m_cache.record_hit();
+            return &r.m_result;
+        } else {
             return nullptr;
+        }
     }
 
     void insert(expr const & e, unsigned offset, expr const & v) {
-        unsigned i = hash(hash(e), offset) % m_capacity;
-        if (m_cache[i].m_cell == nullptr)
-            m_used.push_back(i);
-        m_cache[i].m_cell   = e.raw();
-        m_cache[i].m_offset = offset;
-        m_cache[i].m_result = v;
+        entry r;
+        r.m_cell   = e.raw();
+        r.m_offset = offset;
+        r.m_hash   = hash(hash(e), offset);
+        r.m_result = v;
+        m_cache.insert(std::move(r));
     }
 
-    void clear() {
-        for (unsigned i : m_used) {
-            m_cache[i].m_cell   = nullptr;
-            m_cache[i].m_result = expr();
-        }
-        m_used.clear();
-    }
+    void clear() { m_cache.clear(); }
 };
 
 /* CACHE_RESET: NO */
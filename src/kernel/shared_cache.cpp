@@ -0,0 +1,157 @@
+/*
+Copyright (c) 2026 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: agent
+*/
+#include <cstdlib>
+#include <iostream>
+#include "runtime/thread.h"
+#include "runtime/io.h"
+#include "kernel/expr_open_map.h"
+#include "kernel/max_sharing.h"
+#include "kernel/shared_cache.h"
+
+namespace lean {
+/* Bounded cache using two generations: when the current generation reaches half of the
+   capacity, it replaces the previous one, which is discarded. Hits in the previous
+   generation are promoted to the current one. */
+class shared_cache {
+    struct entry_map {
+        expr_open_map<expr> m_curr;
+        expr_open_map<expr> m_prev;
+        uint64         m_hits{0};
+        uint64         m_misses{0};
+        uint64         m_inserts{0};
+        uint64         m_evictions{0};
+    };
+    mutex              m_mutex;
+    size_t             m_capacity;
+    object_ref         m_lineage;
+    uint64             m_flushes{0};
+    entry_map          m_maps[2];
+
+    entry_map & get(shared_cache_kind k) { return m_maps[static_cast<unsigned>(k)]; }
+
+    void display(std::ostream & out, char const * kind, entry_map const & m) const {
+        uint64 total = m.m_hits + m.m_misses;
+        out << "kernel shared cache (" << kind << "): " << m.m_hits << " hits, " << m.m_misses << " misses";
+        if (total > 0)
+            out << " (" << (100.0 * m.m_hits / total) << "% hit rate)";
+        out << ", " << m.m_inserts << " inserts, " << m.m_evictions << " evicted entries\n";
+    }
+public:
+    shared_cache(size_t capacity):m_capacity(capacity < 2 ? 2 : capacity) {}
+
+    optional<expr> find(shared_cache_kind k, object_ref const & lineage, expr const & e) {
+        lock_guard<mutex> _(m_mutex);
+        entry_map & m = get(k);
+        if (lineage.raw() == m_lineage.raw()) {
+            auto it = m.m_curr.find(e);
+            if (it != m.m_curr.end()) {
+                m.m_hits++;
+                return optional<expr>(it->second);
+            }
+            it = m.m_prev.find(e);
+            if (it != m.m_prev.end()) {
+                m.m_hits++;
+                expr r = it->second;
+                m.m_curr.insert(mk_pair(it->first, r));
+                return optional<expr>(r);
+            }
+        }
+        m.m_misses++;
+        return none_expr();
+    }
+
+    void insert(shared_cache_kind k, object_ref const & lineage, expr const & e, expr const & r) {
+        /* The cache may outlive the current thread. */
+        mark_mt(e.raw());
+        mark_mt(r.raw());
+        lock_guard<mutex> _(m_mutex);
+        if (lineage.raw() != m_lineage.raw()) {
+            mark_mt(lineage.raw());
+            for (entry_map & m : m_maps) {
+                m.m_curr.clear();
+                m.m_prev.clear();
+            }
+            m_lineage = lineage;
+            m_flushes++;
+        }
+        entry_map & m = get(k);
+        if (2 * m.m_curr.size() >= m_capacity) {
+            m.m_evictions += m.m_prev.size();
+            m.m_prev = std::move(m.m_curr);
+            m.m_curr = expr_open_map<expr>();
+        }
+        if (m.m_curr.insert(mk_pair(e, r)).second)
+            m.m_inserts++;
+    }
+
+    void clear() {
+        lock_guard<mutex> _(m_mutex);
+        for (entry_map & m : m_maps) {
+            m.m_curr.clear();
+            m.m_prev.clear();
+        }
+        m_lineage = object_ref();
+    }
+
+    void display_stats(std::ostream & out) {
+        lock_guard<mutex> _(m_mutex);
+        display(out, "whnf", get(shared_cache_kind::Whnf));
+        display(out, "infer", get(shared_cache_kind::Infer));
+        out << "kernel shared cache: " << m_flushes << " lineage changes\n";
+    }
+};
+
+static shared_cache * g_shared_cache = nullptr;
+
+bool is_shared_cache_enabled() {
+    return g_shared_cache != nullptr;
+}
+
+extern "C" object * lean_environment_imported_constants(object * env);
+extern "C" uint8 lean_environment_is_imported_constant(object * env, object * n);
+
+object_ref get_shared_cache_lineage(environment const & env) {
+    return object_ref(lean_environment_imported_constants(env.to_obj_arg()));
+}
+
+bool is_imported_constant(environment const & env, name const & n) {
+    return lean_environment_is_imported_constant(env.to_obj_arg(), n.to_obj_arg()) != 0;
+}
+
+optional<expr> shared_cache_find(shared_cache_kind k, object_ref const & lineage, expr const & e) {
+    return g_shared_cache->find(k, lineage, e);
+}
+
+void shared_cache_insert(shared_cache_kind k, object_ref const & lineage, expr const & e, expr const & r) {
+    g_shared_cache->insert(k, lineage, e, r);
+}
+
+/* Kernel.clearSharedCaches : IO Unit */
+extern "C" LEAN_EXPORT obj_res lean_kernel_clear_shared_caches(obj_arg) {
+    if (g_shared_cache)
+        g_shared_cache->clear();
+    clear_hash_cons_table();
+    return io_result_mk_ok(box(0));
+}
+
+void initialize_shared_cache() {
+    if (char const * s = std::getenv("LEAN_KERNEL_SHARED_CACHE")) {
+        size_t capacity = static_cast<size_t>(std::strtoull(s, nullptr, 10));
+        if (capacity > 0)
+            g_shared_cache = new shared_cache(capacity);
+    }
+}
+
+void finalize_shared_cache() {
+    if (g_shared_cache) {
+        if (std::getenv("LEAN_KERNEL_SHARED_CACHE_STATS"))
+            g_shared_cache->display_stats(std::cerr);
+        delete g_shared_cache;
+        g_shared_cache = nullptr;
+    }
+}
+}
@@ -0,0 +1,41 @@
+/*
+Copyright (c) 2026 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: agent
+*/
+#pragma once
+#include "kernel/environment.h"
+
+namespace lean {
+/** \brief Process-wide cache for `whnf` and `infer_type` results shared by all kernel type checkers.
+
+    The cache is disabled by default. It is enabled by setting the environment variable
+    `LEAN_KERNEL_SHARED_CACHE` to the maximum number of entries per kind. Statistics are printed
+    to `stderr` on exit when `LEAN_KERNEL_SHARED_CACHE_STATS` is set.
+
+    Only closed terms (no free variables, metavariables, or loose bound variables) whose
+    constants are all imported may be cached. Imported declarations are never overwritten,
+    so such results depend only on the set of imported constants. Entries are tagged with the
+    imported constant map they were computed against (the "lineage"); a type checker working
+    on an environment with a different lineage flushes the cache before inserting into it.
+
+    Cached terms may point into the compacted regions of imported modules, so the cache is cleared by
+    `Kernel.clearSharedCaches`, which `Environment.freeRegions` invokes before freeing the regions. */
+enum class shared_cache_kind { Whnf, Infer };
+
+/** \brief Return true if the shared cache has been enabled. */
+bool is_shared_cache_enabled();
+
+/** \brief Return the lineage of \c env, i.e., its map of imported constants. */
+object_ref get_shared_cache_lineage(environment const & env);
+
+/** \brief Return true iff \c n is an imported constant in \c env. */
+bool is_imported_constant(environment const & env, name const & n);
+
+optional<expr> shared_cache_find(shared_cache_kind k, object_ref const & lineage, expr const & e);
+void shared_cache_insert(shared_cache_kind k, object_ref const & lineage, expr const & e, expr const & r);
+
+void initialize_shared_cache();
+void finalize_shared_cache();
+}
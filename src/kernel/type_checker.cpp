@@ -19,6 +19,8 @@ Author: Leonardo de Moura
 #include "kernel/for_each_fn.h"
 #include "kernel/quot.h"
 #include "kernel/inductive.h"
+#include "kernel/shared_cache.h"
+#include "kernel/reduce_lit.h"
 
 namespace lean {
 static name * g_kernel_fresh = nullptr;
@@ -109,7 +111,7 @@ expr type_checker::infer_constant(expr const & e, bool infer_only) {
             check_level(l);
         }
     }
-    return instantiate_type_lparams(info, ls);
+    return share(instantiate_type_lparams(info, ls, m_st->m_inst_lparams));
 }
 
 expr type_checker::infer_lambda(expr const & _e, bool infer_only) {
@@ -162,7 +164,7 @@ expr type_checker::infer_app(expr const & e, bool infer_only) {
         if (!is_def_eq(a_type, d_type)) {
             throw app_type_mismatch_exception(env(), m_lctx, e, f_type, a_type);
         }
-        return instantiate(binding_body(f_type), app_arg(e));
+        return share(instantiate(binding_body(f_type), app_arg(e)));
     } else {
         buffer<expr> args;
         expr const & f = get_app_args(e, args);
@@ -179,7 +181,7 @@ expr type_checker::infer_app(expr const & e, bool infer_only) {
                 j = i;
             }
         }
-        return instantiate_rev(f_type, nargs-j, args.data()+j);
+        return share(instantiate_rev(f_type, nargs-j, args.data()+j));
     }
 }
 
@@ -258,7 +260,7 @@ expr type_checker::infer_proj(expr const & e, bool infer_only) {
         throw invalid_proj_exception(env(), m_lctx, e);
 
     constant_info c_info = env().get(head(I_val.get_cnstrs()));
-    expr r = instantiate_type_lparams(c_info, const_levels(I));
+    expr r = instantiate_type_lparams(c_info, const_levels(I), m_st->m_inst_lparams);
     for (unsigned i = 0; i < I_val.get_nparams(); i++) {
         lean_assert(i < args.size());
         r = whnf(r);
@@ -285,6 +287,60 @@ expr type_checker::infer_proj(expr const & e, bool infer_only) {
     return r;
 }
 
+/** \brief Return true if results may be looked up in and stored into the shared cache.
+    We do not share results computed in unsafe or partial mode, nor when diagnostics
+    (e.g., unfolding counters) are being collected. */
+bool type_checker::use_shared_cache() const {
+    return is_shared_cache_enabled() && m_definition_safety == definition_safety::safe && m_diag == nullptr;
+}
+
+bool type_checker::is_shareable_core(expr const & e) {
+    switch (e.kind()) {
+    case expr_kind::BVar: case expr_kind::Sort: case expr_kind::Lit:
+        return true;
+    case expr_kind::FVar: case expr_kind::MVar:
+        return false;
+    default:
+        break;
+    }
+    auto it = m_st->m_shareable.find(e);
+    if (it != m_st->m_shareable.end())
+        return it->second;
+    bool r = false;
+    switch (e.kind()) {
+    case expr_kind::Const:
+        r = is_imported_constant(env(), const_name(e));
+        break;
+    case expr_kind::App:
+        r = is_shareable_core(app_fn(e)) && is_shareable_core(app_arg(e));
+        break;
+    case expr_kind::Lambda: case expr_kind::Pi:
+        r = is_shareable_core(binding_domain(e)) && is_shareable_core(binding_body(e));
+        break;
+    case expr_kind::Let:
+        r = is_shareable_core(let_type(e)) && is_shareable_core(let_value(e)) && is_shareable_core(let_body(e));
+        break;
+    case expr_kind::MData:
+        r = is_shareable_core(mdata_expr(e));
+        break;
+    case expr_kind::Proj:
+        r = is_imported_constant(env(), proj_sname(e)) && is_shareable_core(proj_expr(e));
+        break;
+    default:
+        lean_unreachable();
+    }
+    m_st->m_shareable.insert(mk_pair(e, r));
+    return r;
+}
+
+/** \brief Return true iff \c e is a closed term that only uses imported constants.
+    See `kernel/shared_cache.h`. */
+bool type_checker::is_shareable(expr const & e) {
+    if (has_fvar(e) || has_mvar(e) || has_loose_bvars(e))
+        return false;
+    return is_shareable_core(e);
+}
+
 /** \brief Return type of expression \c e, if \c infer_only is false, then it also check whether \c e is type correct or not.
     \pre closed(e) */
 expr type_checker::infer_type_core(expr const & e, bool infer_only) {
@@ -295,9 +351,21 @@ expr type_checker::infer_type_core(expr const & e, bool infer_only) {
     check_system("type checker", /* do_check_interrupted */ true);
 
     auto it = m_st->m_infer_type[infer_only].find(e);
+    if (m_prof)
+        m_prof->record_cache(kernel_profiler::cache::InferType, it != m_st->m_infer_type[infer_only].end());
     if (it != m_st->m_infer_type[infer_only].end())
         return it->second;
 
+    object_ref lineage;
+    bool shared = infer_only && use_shared_cache() && is_shareable(e);
+    if (shared) {
+        lineage = get_shared_cache_lineage(env());
+        if (auto r = shared_cache_find(shared_cache_kind::Infer, lineage, e)) {
+            m_st->m_infer_type[infer_only].insert(mk_pair(e, *r));
+            return *r;
+        }
+    }
+
     expr r;
     switch (e.kind()) {
     case expr_kind::Lit:      r = lit_type(lit_value(e)); break;
@@ -319,6 +387,8 @@ expr type_checker::infer_type_core(expr const & e, bool infer_only) {
     }
 
     m_st->m_infer_type[infer_only].insert(mk_pair(e, r));
+    if (shared)
+        shared_cache_insert(shared_cache_kind::Infer, lineage, e, r);
     return r;
 }
 
@@ -352,6 +422,7 @@ bool type_checker::is_prop(expr const & e) {
 /** \brief Apply normalizer extensions to \c e.
     If `cheap == true`, then we don't perform delta-reduction when reducing major premise. */
 optional<expr> type_checker::reduce_recursor(expr const & e, bool cheap_rec, bool cheap_proj) {
+    kernel_profiler_scope prof_scope(m_prof, kernel_profiler::phase::ReduceRecursor);
     if (env().is_quot_initialized()) {
         if (optional<expr> r = quot_reduce_rec(e, [&](expr const & e) { return whnf(e); })) {
             return r;
@@ -473,7 +544,7 @@ expr type_checker::whnf_core(expr const & e, bool cheap_rec, bool cheap_proj) {
                 m++;
             }
             lean_assert(m <= num_args);
-            r = whnf_core(mk_rev_app(instantiate(binding_body(f), m, args.data() + (num_args - m)), num_args - m, args.data()),
+            r = whnf_core(mk_rev_app(share(instantiate(binding_body(f), m, args.data() + (num_args - m))), num_args - m, args.data()),
                           cheap_rec, cheap_proj);
         } else if (f == f0) {
             if (auto r = reduce_recursor(e, cheap_rec, cheap_proj)) {
@@ -493,10 +564,11 @@ expr type_checker::whnf_core(expr const & e, bool cheap_rec, bool cheap_proj) {
         break;
     }
     case expr_kind::Let:
-        r = whnf_core(instantiate(let_body(e), let_value(e)), cheap_rec, cheap_proj);
+        r = whnf_core(share(instantiate(let_body(e), let_value(e))), cheap_rec, cheap_proj);
         break;
     }
 
+    r = share(r);
     if (!cheap_rec && !cheap_proj) {
         m_st->m_whnf_core.insert(mk_pair(e, r));
     }
@@ -522,7 +594,10 @@ optional<expr> type_checker::unfold_definition_core(expr const & e) {
                 if (m_diag) {
                     m_diag->record_unfold(d->get_name());
                 }
-                return some_expr(instantiate_value_lparams(*d, const_levels(e)));
+                if (m_prof) {
+                    m_prof->record_unfold(d->get_name());
+                }
+                return some_expr(share(instantiate_value_lparams(*d, const_levels(e), m_st->m_inst_lparams)));
             }
         }
     }
@@ -619,6 +694,7 @@ template<typename F> optional<expr> type_checker::reduce_bin_nat_pred(F const &
 
 optional<expr> type_checker::reduce_nat(expr const & e) {
     if (has_fvar(e)) return none_expr();
+    kernel_profiler_scope prof_scope(m_prof, kernel_profiler::phase::ReduceNat);
     unsigned nargs = get_app_num_args(e);
     if (nargs == 1) {
         expr const & f = app_fn(e);
@@ -646,7 +722,7 @@ optional<expr> type_checker::reduce_nat(expr const & e) {
         if (f == *g_nat_shiftLeft) return reduce_bin_nat_op(lean_nat_shiftl, e);
         if (f == *g_nat_shiftRight) return reduce_bin_nat_op(lean_nat_shiftr, e);
     }
-    return none_expr();
+    return reduce_lit_ext(env(), e, [&](expr const & a) { return whnf(a); });
 }
 
 /** \brief Put expression \c t in weak head normal form */
@@ -668,25 +744,43 @@ expr type_checker::whnf(expr const & e) {
         break;
     }
 
+    kernel_profiler_scope prof_scope(m_prof, kernel_profiler::phase::Whnf);
     // check cache
     auto it = m_st->m_whnf.find(e);
+    if (m_prof)
+        m_prof->record_cache(kernel_profiler::cache::Whnf, it != m_st->m_whnf.end());
     if (it != m_st->m_whnf.end())
         return it->second;
 
+    object_ref lineage;
+    bool shared = use_shared_cache() && is_shareable(e);
+    if (shared) {
+        lineage = get_shared_cache_lineage(env());
+        if (auto r = shared_cache_find(shared_cache_kind::Whnf, lineage, e)) {
+            m_st->m_whnf.insert(mk_pair(e, *r));
+            return *r;
+        }
+    }
+
     expr t = e;
     while (true) {
         expr t1 = whnf_core(t);
         if (auto v = reduce_native(env(), t1)) {
+            /* Results of native reduction are not shared, they depend on compiled code. */
             m_st->m_whnf.insert(mk_pair(e, *v));
             return *v;
         } else if (auto v = reduce_nat(t1)) {
             m_st->m_whnf.insert(mk_pair(e, *v));
+            if (shared)
+                shared_cache_insert(shared_cache_kind::Whnf, lineage, e, *v);
             return *v;
         } else if (auto next_t = unfold_definition(t1)) {
             t = *next_t;
         } else {
             auto r = t1;
             m_st->m_whnf.insert(mk_pair(e, r));
+            if (shared)
+                shared_cache_insert(shared_cache_kind::Whnf, lineage, e, r);
             return r;
         }
     }
@@ -724,8 +818,8 @@ bool type_checker::is_def_eq_binding(expr t, expr s) {
         t = binding_body(t);
         s = binding_body(s);
     } while (t.kind() == k && s.kind() == k);
-    return is_def_eq(instantiate_rev(t, subst.size(), subst.data()),
-                     instantiate_rev(s, subst.size(), subst.data()));
+    return is_def_eq(share(instantiate_rev(t, subst.size(), subst.data())),
+                     share(instantiate_rev(s, subst.size(), subst.data())));
 }
 
 bool type_checker::is_def_eq(level const & l1, level const & l2) {
@@ -855,14 +949,23 @@ lbool type_checker::is_def_eq_proof_irrel(expr const & t, expr const & s) {
 }
 
 bool type_checker::failed_before(expr const & t, expr const & s) const {
+    if (m_prof) {
+        bool r = failed_before_core(t, s);
+        m_prof->record_cache(kernel_profiler::cache::Failure, r);
+        return r;
+    }
+    return failed_before_core(t, s);
+}
+
+bool type_checker::failed_before_core(expr const & t, expr const & s) const {
     if (hash(t) < hash(s)) {
-        return m_st->m_failure.find(mk_pair(t, s)) != m_st->m_failure.end();
+        return m_st->m_failure.contains(mk_pair(t, s));
     } else if (hash(t) > hash(s)) {
-        return m_st->m_failure.find(mk_pair(s, t)) != m_st->m_failure.end();
+        return m_st->m_failure.contains(mk_pair(s, t));
     } else {
         return
-            m_st->m_failure.find(mk_pair(t, s)) != m_st->m_failure.end() ||
-            m_st->m_failure.find(mk_pair(s, t)) != m_st->m_failure.end();
+            m_st->m_failure.contains(mk_pair(t, s)) ||
+            m_st->m_failure.contains(mk_pair(s, t));
     }
 }
 
@@ -894,6 +997,7 @@ optional<expr> type_checker::try_unfold_proj_app(expr const & e) {
 
      \remark t_n, s_n and cs are updated. */
 auto type_checker::lazy_delta_reduction_step(expr & t_n, expr & s_n) -> reduction_status {
+    kernel_profiler_scope prof_scope(m_prof, kernel_profiler::phase::LazyDeltaReductionStep);
     auto d_t = is_delta(t_n);
     auto d_s = is_delta(s_n);
     if (!d_t && !d_s) {
@@ -1065,6 +1169,7 @@ bool type_checker::is_def_eq_unit_like(expr const & t, expr const & s) {
 }
 
 bool type_checker::is_def_eq_core(expr const & t, expr const & s) {
+    kernel_profiler_scope prof_scope(m_prof, kernel_profiler::phase::IsDefEqCore);
     check_system("is_definitionally_equal", /* do_check_interrupted */ true);
     bool use_hash = true;
     lbool r = quick_is_def_eq(t, s, use_hash);
@@ -1170,17 +1275,17 @@ expr type_checker::eta_expand(expr const & e) {
 }
 
 type_checker::type_checker(environment const & env, local_ctx const & lctx, diagnostics * diag, definition_safety ds):
-    m_st_owner(true), m_st(new state(env)), m_diag(diag),
+    m_st_owner(true), m_st(new state(env)), m_diag(diag), m_prof(get_kernel_profiler()),
     m_lctx(lctx), m_definition_safety(ds), m_lparams(nullptr) {
 }
 
 type_checker::type_checker(state & st, local_ctx const & lctx, definition_safety ds):
-    m_st_owner(false), m_st(&st), m_diag(nullptr), m_lctx(lctx),
+    m_st_owner(false), m_st(&st), m_diag(nullptr), m_prof(get_kernel_profiler()), m_lctx(lctx),
     m_definition_safety(ds), m_lparams(nullptr) {
 }
 
 type_checker::type_checker(type_checker && src):
-    m_st_owner(src.m_st_owner), m_st(src.m_st), m_diag(src.m_diag), m_lctx(std::move(src.m_lctx)),
+    m_st_owner(src.m_st_owner), m_st(src.m_st), m_diag(src.m_diag), m_prof(src.m_prof), m_lctx(std::move(src.m_lctx)),
     m_definition_safety(src.m_definition_safety), m_lparams(src.m_lparams) {
     src.m_st_owner = false;
 }
@@ -15,7 +15,11 @@ Author: Leonardo de Moura
 #include "kernel/environment.h"
 #include "kernel/local_ctx.h"
 #include "kernel/expr_maps.h"
+#include "kernel/expr_open_map.h"
 #include "kernel/equiv_manager.h"
+#include "kernel/instantiate.h"
+#include "kernel/max_sharing.h"
+#include "kernel/profiler.h"
 
 namespace lean {
 /** \brief Lean Type Checker. It can also be used to infer types, check whether a
@@ -23,15 +27,17 @@ namespace lean {
 class type_checker {
 public:
     class state {
-        typedef expr_map<expr> infer_cache;
-        typedef std::unordered_set<expr_pair, expr_pair_hash, expr_pair_eq> expr_pair_set;
+        typedef expr_open_map<expr> infer_cache;
         environment               m_env;
         name_generator            m_ngen;
         infer_cache               m_infer_type[2];
-        expr_map<expr>            m_whnf_core;
-        expr_map<expr>            m_whnf;
+        expr_open_map<expr>       m_whnf_core;
+        expr_open_map<expr>       m_whnf;
         equiv_manager             m_eqv_manager;
-        expr_pair_set             m_failure;
+        expr_pair_open_set        m_failure;
+        /* Memoizes `is_shareable_core`, only used when the shared cache is enabled. */
+        expr_open_map<bool>       m_shareable;
+        inst_lparams_cache        m_inst_lparams;
         friend type_checker;
     public:
         state(environment const & env);
@@ -43,6 +49,8 @@ private:
     bool                      m_st_owner;
     state *                   m_st;
     diagnostics *             m_diag;
+    /* Profiler installed for the current thread when the type checker was created, see `scope_kernel_profiler`. */
+    kernel_profiler *         m_prof;
     local_ctx                 m_lctx;
     definition_safety         m_definition_safety;
     /* When `m_lparams != nullptr, the `check` method makes sure all level parameters
@@ -61,6 +69,12 @@ private:
     expr infer_let(expr const & e, bool infer_only);
     expr infer_type_core(expr const & e, bool infer_only);
     expr infer_type(expr const & e);
+    /** \brief Return \c e interned in the hash-cons table if the hash-consing mode is enabled,
+        and \c e otherwise. See `hash_cons`. */
+    expr share(expr const & e) const { return is_hash_cons_enabled() ? hash_cons(e) : e; }
+    bool use_shared_cache() const;
+    bool is_shareable_core(expr const & e);
+    bool is_shareable(expr const & e);
 
     enum class reduction_status { Continue, DefUnknown, DefEqual, DefDiff };
     optional<expr> reduce_recursor(expr const & e, bool cheap_rec, bool cheap_proj);
@@ -89,6 +103,7 @@ private:
     bool is_def_eq_app(expr const & t, expr const & s);
     lbool is_def_eq_proof_irrel(expr const & t, expr const & s);
     bool is_def_eq_unit_like(expr const & t, expr const & s);
+    bool failed_before_core(expr const & t, expr const & s) const;
     bool failed_before(expr const & t, expr const & s) const;
     void cache_failure(expr const & t, expr const & s);
     reduction_status lazy_delta_reduction_step(expr & t_n, expr & s_n);
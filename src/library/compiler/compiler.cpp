@@ -9,7 +9,7 @@ Author: Leonardo de Moura
 #include "kernel/type_checker.h"
 #include "kernel/kernel_exception.h"
 #include "kernel/trace.h"
-#include "library/max_sharing.h"
+#include "kernel/max_sharing.h"
 #include "library/time_task.h"
 #include "library/compiler/util.h"
 #include "library/compiler/lcnf.h"
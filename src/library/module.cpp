@@ -13,6 +13,7 @@ Authors: Leonardo de Moura, Gabriel Ebner, Sebastian Ullrich
 #include <sstream>
 #include <fstream>
 #include <algorithm>
+#include <cstdlib>
 #include <sys/stat.h>
 #include "runtime/thread.h"
 #include "runtime/interrupt.h"
@@ -33,6 +34,7 @@ Authors: Leonardo de Moura, Gabriel Ebner, Sebastian Ullrich
 #include <windows.h>
 #else
 #include <sys/mman.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <fcntl.h>
 #endif
@@ -43,13 +45,18 @@ Authors: Leonardo de Moura, Gabriel Ebner, Sebastian Ullrich
 #endif
 #endif
 
+#ifdef LEAN_USE_ZSTD
+#include <zstd.h>
+#endif
+
 namespace lean {
 
 /** On-disk format of a .olean file. */
 struct olean_header {
     // 5 bytes: magic number
     char marker[5] = {'o', 'l', 'e', 'a', 'n'};
-    // 1 byte: version, currently always `1`
+    // 1 byte: version, `1` for uncompressed files and `2` if `data` is a single zstd frame containing the compacted
+    // object graph (see `LEAN_OLEAN_COMPRESSION`)
     uint8_t version = 1;
     // 42 bytes: build githash, padded with `\0` to the right
     char githash[42];
@@ -61,16 +68,71 @@ struct olean_header {
 // make sure we don't have any padding bytes, which also ensures `data` is properly aligned
 static_assert(sizeof(olean_header) == 5 + 1 + 42 + sizeof(size_t), "olean_header must be packed");
 
+#define LEAN_OLEAN_ZSTD_VERSION 2
+
+/* Number of threads used for compacting .olean files, see `object_compactor::operator()(o, num_threads)`.
+   The output does not depend on it. */
+static unsigned get_compactor_threads() {
+    if (char const * s = std::getenv("LEAN_COMPACTOR_THREADS")) {
+        unsigned n = atoi(s);
+        return n == 0 ? hardware_concurrency() : n;
+    }
+    return 1;
+}
+
+#ifdef LEAN_USE_ZSTD
+/* zstd compression level for .olean files, or 0 for uncompressed files. */
+static int get_olean_compression_level() {
+    if (char const * s = std::getenv("LEAN_OLEAN_COMPRESSION"))
+        return atoi(s);
+    return 0;
+}
+#endif
+
+#ifndef LEAN_WINDOWS
+/* Write all `iovcnt` buffers to `fd`, using a single `writev` call unless it is interrupted or only partially succeeds. */
+static bool write_all(int fd, struct iovec * iov, int iovcnt) {
+    while (iovcnt > 0) {
+        ssize_t n = writev(fd, iov, iovcnt);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        while (iovcnt > 0 && static_cast<size_t>(n) >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = static_cast<char *>(iov->iov_base) + n;
+            iov->iov_len -= n;
+        }
+    }
+    return true;
+}
+#endif
+
 extern "C" LEAN_EXPORT object * lean_save_module_data(b_obj_arg fname, b_obj_arg mod, b_obj_arg mdata, object *) {
     std::string olean_fn(string_cstr(fname));
     // we first write to a temp file and then move it to the correct path (possibly deleting an older file)
     // so that we neither expose partially-written files nor modify possibly memory-mapped files
     std::string olean_tmp_fn = olean_fn + ".tmp";
+#ifndef LEAN_WINDOWS
+    int fd = -1;
+#endif
     try {
+#ifdef LEAN_WINDOWS
         std::ofstream out(olean_tmp_fn, std::ios_base::binary);
         if (out.fail()) {
             return io_result_mk_error((sstream() << "failed to create file '" << olean_fn << "'").str());
         }
+#else
+        fd = open(olean_tmp_fn.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (fd < 0) {
+            return io_result_mk_error((sstream() << "failed to create file '" << olean_fn << "'").str());
+        }
+#endif
 
         // Derive a base address that is uniformly distributed by deterministic, and should most likely
         // work for `mmap` on all interesting platforms
@@ -91,15 +153,44 @@ extern "C" LEAN_EXPORT object * lean_save_module_data(b_obj_arg fname, b_obj_arg
         base_addr = base_addr & ~((1LL<<16) - 1);
 
         object_compactor compactor(reinterpret_cast<void *>(base_addr + offsetof(olean_header, data)));
-        compactor(mdata);
+        compactor(mdata, get_compactor_threads());
 
         // see/sync with file format description above
         olean_header header = {};
         header.base_addr = base_addr;
         strncpy(header.githash, LEAN_GITHASH, sizeof(header.githash));
+        void const * data = compactor.data();
+        size_t data_size  = compactor.size();
+#ifdef LEAN_USE_ZSTD
+        std::vector<char> compressed;
+        if (int level = get_olean_compression_level()) {
+            compressed.resize(ZSTD_compressBound(data_size));
+            size_t r = ZSTD_compress(compressed.data(), compressed.size(), data, data_size, level);
+            if (ZSTD_isError(r))
+                throw exception(sstream() << "zstd compression failed: " << ZSTD_getErrorName(r));
+            header.version = LEAN_OLEAN_ZSTD_VERSION;
+            data      = compressed.data();
+            data_size = r;
+        }
+#endif
+#ifdef LEAN_WINDOWS
         out.write(reinterpret_cast<char *>(&header), sizeof(header));
-        out.write(static_cast<char const *>(compactor.data()), compactor.size());
+        out.write(static_cast<char const *>(data), data_size);
         out.close();
+#else
+        struct iovec iov[2] = {
+            { &header, sizeof(header) },
+            { const_cast<void *>(data), data_size }
+        };
+        // save `errno` right away, `close` may overwrite it
+        int errnum = write_all(fd, iov, 2) ? 0 : errno;
+        if (close(fd) != 0 && errnum == 0)
+            errnum = errno;
+        fd = -1;
+        if (errnum != 0) {
+            return io_result_mk_error((sstream() << "failed to write '" << olean_fn << "': " << errnum << " " << strerror(errnum)).str());
+        }
+#endif
         while (std::rename(olean_tmp_fn.c_str(), olean_fn.c_str()) != 0) {
 #ifdef LEAN_WINDOWS
             if (errno == EEXIST) {
@@ -122,10 +213,91 @@ extern "C" LEAN_EXPORT object * lean_save_module_data(b_obj_arg fname, b_obj_arg
         }
         return io_result_mk_ok(box(0));
     } catch (exception & ex) {
+#ifndef LEAN_WINDOWS
+        if (fd >= 0)
+            close(fd);
+#endif
         return io_result_mk_error((sstream() << "failed to write '" << olean_fn << "': " << ex.what()).str());
     }
 }
 
+/* Return the module data stored in `region` together with the region. */
+static object * read_module_data(compacted_region * region) {
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer)
+    // do not report as leak
+    __lsan_ignore_object(region);
+#endif
+#endif
+    object * mod = region->read();
+    object * mod_region = alloc_cnstr(0, 2, 0);
+    cnstr_set(mod_region, 0, mod);
+    cnstr_set(mod_region, 1, box_size_t(reinterpret_cast<size_t>(region)));
+    return io_result_mk_ok(mod_region);
+}
+
+#ifdef LEAN_USE_ZSTD
+/* Decompress the payload of a compressed .olean file of `size` bytes following the header already read from `in`.
+   We decompress in a streaming fashion directly into memory allocated at the file's base address if possible, in which
+   case, like for `mmap`ed files, no relocation is necessary. */
+static compacted_region * read_compressed_module_data(std::ifstream & in, size_t size, char * base_addr) {
+    std::vector<char> in_buf(ZSTD_DStreamInSize());
+    ZSTD_inBuffer input = { in_buf.data(), 0, 0 };
+    auto read_input = [&]() {
+        in.read(in_buf.data(), std::min(in_buf.size(), size));
+        input.size = in.gcount();
+        input.pos  = 0;
+        size -= input.size;
+        if (input.size == 0)
+            throw exception("unexpected end of file");
+    };
+    read_input();
+    unsigned long long data_size = ZSTD_getFrameContentSize(input.src, input.size);
+    if (data_size == ZSTD_CONTENTSIZE_UNKNOWN || data_size == ZSTD_CONTENTSIZE_ERROR)
+        throw exception("invalid zstd frame");
+    size_t alloc_size = sizeof(olean_header) + data_size;
+    char * buffer;
+    std::function<void()> free_data;
+#if defined(LEAN_WINDOWS)
+    buffer = static_cast<char *>(VirtualAlloc(base_addr, alloc_size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+    if (!buffer)
+        buffer = static_cast<char *>(VirtualAlloc(nullptr, alloc_size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+    if (!buffer)
+        throw exception(sstream() << "failed to allocate " << alloc_size << " bytes");
+    free_data = [=]() { lean_always_assert(VirtualFree(buffer, 0, MEM_RELEASE)); };
+#elif defined(LEAN_MMAP)
+    // like for uncompressed files, `base_addr` is only a hint
+    buffer = static_cast<char *>(mmap(base_addr, alloc_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (buffer == MAP_FAILED)
+        throw exception(sstream() << "failed to allocate " << alloc_size << " bytes: " << strerror(errno));
+    free_data = [=]() { lean_always_assert(munmap(buffer, alloc_size) == 0); };
+#else
+    buffer = static_cast<char *>(malloc(alloc_size));
+    free_data = [=]() { free(buffer); };
+#endif
+    // the region takes ownership of the buffer, so it is freed even if decompression fails
+    std::unique_ptr<compacted_region> region(
+        new compacted_region(data_size, buffer + sizeof(olean_header), base_addr + sizeof(olean_header), false, free_data));
+
+    std::unique_ptr<ZSTD_DStream, size_t (*)(ZSTD_DStream *)> stream(ZSTD_createDStream(), ZSTD_freeDStream);
+    ZSTD_outBuffer output = { buffer + sizeof(olean_header), data_size, 0 };
+    while (true) {
+        size_t r = ZSTD_decompressStream(stream.get(), &output, &input);
+        if (ZSTD_isError(r))
+            throw exception(sstream() << "zstd decompression failed: " << ZSTD_getErrorName(r));
+        if (r == 0)
+            break;
+        if (output.pos == output.size)
+            throw exception("zstd frame is larger than its declared content size");
+        if (input.pos == input.size)
+            read_input();
+    }
+    if (output.pos != data_size || input.pos != input.size || size != 0)
+        throw exception("unexpected data after zstd frame");
+    return region.release();
+}
+#endif
+
 extern "C" LEAN_EXPORT object * lean_read_module_data(object * fname, object *) {
     std::string olean_fn(string_cstr(fname));
     try {
@@ -143,8 +315,16 @@ extern "C" LEAN_EXPORT object * lean_read_module_data(object * fname, object *)
         if (!in.read(reinterpret_cast<char *>(&header), sizeof(header))) {
             return io_result_mk_error((sstream() << "failed to read file '" << olean_fn << "', invalid header").str());
         }
+        bool is_compressed = memcmp(header.marker, default_header.marker, sizeof(header.marker)) == 0
+            && header.version == LEAN_OLEAN_ZSTD_VERSION;
+#ifndef LEAN_USE_ZSTD
+        if (is_compressed) {
+            return io_result_mk_error((sstream() << "failed to read file '" << olean_fn
+                << "', file is compressed using zstd, which is not supported by this build of Lean (see `USE_ZSTD`)").str());
+        }
+#endif
         if (memcmp(header.marker, default_header.marker, sizeof(header.marker)) != 0
-            || header.version != default_header.version
+            || (header.version != default_header.version && !is_compressed)
 #ifdef LEAN_CHECK_OLEAN_VERSION
             || strncmp(header.githash, LEAN_GITHASH, sizeof(header.githash)) != 0
 #endif
@@ -155,6 +335,10 @@ extern "C" LEAN_EXPORT object * lean_read_module_data(object * fname, object *)
         char * buffer = nullptr;
         bool is_mmap = false;
         std::function<void()> free_data;
+#ifdef LEAN_USE_ZSTD
+        if (is_compressed)
+            return read_module_data(read_compressed_module_data(in, size - sizeof(olean_header), base_addr));
+#endif
 #ifdef LEAN_WINDOWS
         // `FILE_SHARE_DELETE` is necessary to allow the file to (be marked to) be deleted while in use
         HANDLE h_olean_fn = CreateFile(olean_fn.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
@@ -206,19 +390,8 @@ extern "C" LEAN_EXPORT object * lean_read_module_data(object * fname, object *)
         }
         in.close();
 
-        compacted_region * region =
-          new compacted_region(size - sizeof(olean_header), buffer, base_addr + sizeof(olean_header), is_mmap, free_data);
-#if defined(__has_feature)
-#if __has_feature(address_sanitizer)
-        // do not report as leak
-        __lsan_ignore_object(region);
-#endif
-#endif
-        object * mod = region->read();
-        object * mod_region = alloc_cnstr(0, 2, 0);
-        cnstr_set(mod_region, 0, mod);
-        cnstr_set(mod_region, 1, box_size_t(reinterpret_cast<size_t>(region)));
-        return io_result_mk_ok(mod_region);
+        return read_module_data(
+          new compacted_region(size - sizeof(olean_header), buffer, base_addr + sizeof(olean_header), is_mmap, free_data));
     } catch (exception & ex) {
         return io_result_mk_error((sstream() << "failed to read '" << olean_fn << "': " << ex.what()).str());
     }
@@ -5,16 +5,18 @@ Released under Apache 2.0 license as described in the file LICENSE.
 Author: Leonardo de Moura
 */
 #include <vector>
+#include <cstdlib>
+#include <cstring>
+#if defined(LEAN_WINDOWS)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
 #include <lean/lean.h>
 #include "runtime/thread.h"
 #include "runtime/debug.h"
 #include "runtime/alloc.h"
-
-#ifdef LEAN_RUNTIME_STATS
-#define LEAN_RUNTIME_STAT_CODE(c) c
-#else
-#define LEAN_RUNTIME_STAT_CODE(c)
-#endif
+#include "runtime/allocprof.h"
 
 #if defined(__GNUC__) || defined(__clang__)
 #define LEAN_NOINLINE __attribute__((noinline))
@@ -24,11 +26,16 @@ Author: Leonardo de Moura
 
 #define LEAN_PAGE_SIZE             8192        // 8 Kb
 #define LEAN_SEGMENT_SIZE          8*1024*1024 // 8 Mb
+#define LEAN_HUGE_PAGE_SIZE        2*1024*1024 // 2 Mb
 #define LEAN_NUM_SLOTS             (LEAN_MAX_SMALL_OBJECT_SIZE / LEAN_OBJECT_SIZE_DELTA)
-#define LEAN_MAX_TO_EXPORT_OBJS    1024
+/* Default number of segments a heap may own before it starts returning fully free segments to the OS. */
+#define LEAN_DEFAULT_HEAP_HIGH_WATERMARK 8     // 64 Mb
+/* Minimal number of small allocations between two automatic trims of the same heap. */
+#define LEAN_HEAP_TRIM_INTERVAL    (1u << 22)
 
 LEAN_CASSERT(LEAN_PAGE_SIZE > LEAN_MAX_SMALL_OBJECT_SIZE);
 LEAN_CASSERT(LEAN_SEGMENT_SIZE > LEAN_PAGE_SIZE);
+LEAN_CASSERT(LEAN_SEGMENT_SIZE % LEAN_HUGE_PAGE_SIZE == 0);
 
 namespace lean {
 
@@ -36,14 +43,18 @@ namespace lean {
 
 namespace allocator {
 #ifdef LEAN_RUNTIME_STATS
-static atomic<uint64> g_num_alloc(0);
-static atomic<uint64> g_num_small_alloc(0);
-static atomic<uint64> g_num_dealloc(0);
-static atomic<uint64> g_num_small_dealloc(0);
-static atomic<uint64> g_num_segments(0);
-static atomic<uint64> g_num_pages(0);
-static atomic<uint64> g_num_exports(0);
-static atomic<uint64> g_num_recycled_pages(0);
+static atomic<uint64_t> g_num_alloc(0);
+static atomic<uint64_t> g_num_small_alloc(0);
+static atomic<uint64_t> g_num_dealloc(0);
+static atomic<uint64_t> g_num_small_dealloc(0);
+static atomic<uint64_t> g_num_segments(0);
+static atomic<uint64_t> g_num_released_segments(0);
+static atomic<uint64_t> g_num_huge_segments(0);
+static atomic<uint64_t> g_num_trims(0);
+static atomic<uint64_t> g_num_pages(0);
+static atomic<uint64_t> g_num_remote_frees(0);
+static atomic<uint64_t> g_num_remote_pages(0);
+static atomic<uint64_t> g_num_recycled_pages(0);
 struct alloc_stats {
     ~alloc_stats() {
         std::cerr << "num. alloc.:         " << g_num_alloc << "\n";
@@ -51,9 +62,13 @@ struct alloc_stats {
         std::cerr << "num. dealloc.:       " << g_num_dealloc << "\n";
         std::cerr << "num. small dealloc.: " << g_num_small_dealloc << "\n";
         std::cerr << "num. segments:       " << g_num_segments << "\n";
+        std::cerr << "num. rel. segments:  " << g_num_released_segments << "\n";
+        std::cerr << "num. huge segments:  " << g_num_huge_segments << "\n";
+        std::cerr << "num. trims:          " << g_num_trims << "\n";
         std::cerr << "num. pages:          " << g_num_pages << "\n";
         std::cerr << "num. recycled pages: " << g_num_recycled_pages << "\n";
-        std::cerr << "num. exports:        " << g_num_exports << "\n";
+        std::cerr << "num. remote frees:   " << g_num_remote_frees << "\n";
+        std::cerr << "num. remote pages:   " << g_num_remote_pages << "\n";
     }
 };
 static alloc_stats g_alloc_stats;
@@ -61,15 +76,24 @@ static alloc_stats g_alloc_stats;
 
 struct heap;
 struct page;
+struct segment;
 struct page_header {
     atomic<heap *>   m_heap;
+    segment *        m_segment;
     page *           m_next;
     page *           m_prev;
     void *           m_free_list;
+    /* Objects of this page deallocated by other heaps. They are pushed using compare and swap,
+       and moved to `m_free_list` by the owner heap in `heap::import_objs`. */
+    atomic<void *>   m_remote_free_list{nullptr};
+    /* Next page in the owner's `heap::m_remote_pages` list. */
+    page *           m_next_remote;
     unsigned         m_obj_size;
     unsigned         m_max_free;
     unsigned         m_num_free;
     unsigned         m_slot_idx;
+    /* Number of live objects in this page sampled by the allocation profiler. */
+    atomic<unsigned> m_num_sampled{0};
     bool             m_in_page_free_list;
 };
 
@@ -84,8 +108,10 @@ struct page {
     heap * get_heap() { return m_header.m_heap; }
     bool has_many_free() const { return m_header.m_num_free > m_header.m_max_free / 4; }
     bool in_page_free_list() const { return m_header.m_in_page_free_list; }
+    bool is_empty() const { return m_header.m_num_free == m_header.m_max_free; }
     unsigned get_slot_idx() const { return m_header.m_slot_idx; }
     void push_free_obj(void * o);
+    void push_remote_free_obj(void * o);
 };
 
 inline char * align_ptr(char * p, size_t a) {
@@ -95,7 +121,12 @@ inline char * align_ptr(char * p, size_t a) {
 struct segment {
     segment *    m_next{nullptr};
     char *       m_next_page_mem;
-    char         m_data[LEAN_SEGMENT_SIZE];
+    /* The following two fields are only used by `heap::trim`. */
+    unsigned     m_num_empty_pages{0};
+    bool         m_released{false};
+    /* The whole segment must fit in `LEAN_SEGMENT_SIZE` bytes to be backed by huge pages,
+       and 32 bytes are enough for the fields above. */
+    char         m_data[LEAN_SEGMENT_SIZE - 32];
 
     char * get_first_page_mem() {
         lean_assert(align_ptr(m_data, LEAN_PAGE_SIZE) >= m_data);
@@ -108,26 +139,120 @@ struct segment {
     }
 
     bool is_full() const {
-        return m_next_page_mem + LEAN_PAGE_SIZE > m_data + LEAN_SEGMENT_SIZE;
+        return m_next_page_mem + LEAN_PAGE_SIZE > m_data + sizeof(m_data);
+    }
+
+    unsigned get_num_pages() {
+        return (m_next_page_mem - get_first_page_mem()) / LEAN_PAGE_SIZE;
     }
 };
 
+LEAN_CASSERT(sizeof(segment) <= LEAN_SEGMENT_SIZE);
+
+/* Huge pages reduce TLB misses when traversing large object graphs, but increase memory usage.
+   They are enabled by setting the `LEAN_HUGE_PAGES` environment variable to
+   - `transparent`: segments are 2Mb aligned and marked as eligible for transparent huge pages (Linux), or
+   - `explicit`: segments are allocated from the reserved huge page pool (Linux `MAP_HUGETLB`, Windows large pages).
+   If explicit huge pages are not available, we fall back to transparent huge pages and then to regular pages. */
+enum class huge_pages_mode { None, Transparent, Explicit };
+static huge_pages_mode g_huge_pages = huge_pages_mode::None;
+
+/* Segments are directly allocated from the OS (instead of using `malloc`) to make sure
+   that the memory is really given back to the OS when the segment is released. */
+static void * alloc_segment_os_mem() {
+#if defined(LEAN_WINDOWS)
+    if (g_huge_pages != huge_pages_mode::None) {
+        size_t large_page_size = GetLargePageMinimum();
+        if (large_page_size != 0 && LEAN_SEGMENT_SIZE % large_page_size == 0) {
+            /* Remark: this fails unless the process has the `SeLockMemoryPrivilege` privilege. */
+            if (void * mem = VirtualAlloc(nullptr, LEAN_SEGMENT_SIZE, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE)) {
+                LEAN_RUNTIME_STAT_CODE(g_num_huge_segments++);
+                return mem;
+            }
+        }
+    }
+    void * mem = VirtualAlloc(nullptr, LEAN_SEGMENT_SIZE, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (mem == nullptr) lean_internal_panic_out_of_memory();
+    return mem;
+#else
+#if defined(MAP_HUGETLB)
+    if (g_huge_pages == huge_pages_mode::Explicit) {
+        void * mem = mmap(nullptr, LEAN_SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (mem != MAP_FAILED) {
+            LEAN_RUNTIME_STAT_CODE(g_num_huge_segments++);
+            return mem;
+        }
+    }
+#endif
+#if defined(MADV_HUGEPAGE)
+    if (g_huge_pages != huge_pages_mode::None) {
+        /* Transparent huge pages are only used for 2Mb aligned memory, so we over-allocate and unmap the excess. */
+        size_t sz  = LEAN_SEGMENT_SIZE + LEAN_HUGE_PAGE_SIZE;
+        char * mem = static_cast<char *>(mmap(nullptr, sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        if (mem == MAP_FAILED) lean_internal_panic_out_of_memory();
+        char * aligned = align_ptr(mem, LEAN_HUGE_PAGE_SIZE);
+        if (aligned != mem)
+            lean_always_assert(munmap(mem, aligned - mem) == 0);
+        char * end = aligned + LEAN_SEGMENT_SIZE;
+        if (end != mem + sz)
+            lean_always_assert(munmap(end, mem + sz - end) == 0);
+        /* Remark: this fails if transparent huge pages are disabled, and we just use regular pages then. */
+        if (madvise(aligned, LEAN_SEGMENT_SIZE, MADV_HUGEPAGE) == 0) {
+            LEAN_RUNTIME_STAT_CODE(g_num_huge_segments++);
+        }
+        return aligned;
+    }
+#endif
+    void * mem = mmap(nullptr, LEAN_SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) lean_internal_panic_out_of_memory();
+    return mem;
+#endif
+}
+
+static segment * alloc_segment_mem() {
+    return new (alloc_segment_os_mem()) segment();
+}
+
+static void free_segment_mem(segment * s) {
+#if defined(LEAN_WINDOWS)
+    lean_always_assert(VirtualFree(s, 0, MEM_RELEASE));
+#else
+    lean_always_assert(munmap(s, LEAN_SEGMENT_SIZE) == 0);
+#endif
+}
+
+/* Maximum number of segments a heap retains, see `heap::trim`. */
+static atomic<unsigned> g_heap_high_watermark(LEAN_DEFAULT_HEAP_HIGH_WATERMARK);
+/* Incremented by `trim_heaps` to ask all heaps to trim themselves. */
+static atomic<uint64_t> g_trim_epoch(0);
+/* Average number of small allocations between two samples of the allocation profiler, 0 if it is disabled.
+   Heaps pick up changes on their next allocation slow path using `g_sample_epoch`. */
+static atomic<unsigned> g_sample_rate(0);
+static atomic<uint64_t> g_sample_epoch(0);
+
 struct heap {
     segment * m_curr_segment{nullptr};
     heap *    m_next_orphan{nullptr};
     page *    m_curr_page[LEAN_NUM_SLOTS];
     page *    m_page_free_list[LEAN_NUM_SLOTS];
-    /* Objects that must be sent to other heaps. */
-    void *    m_to_export_list{nullptr};
-    unsigned  m_to_export_list_size{0};
-    mutex     m_mutex; /* for the following fields */
-    /* The following list contains object by this heap that were deallocated
-       by other heaps. */
-    void *    m_to_import_list{nullptr};
+    /* Pages containing objects deallocated by other heaps, linked using `page_header::m_next_remote`.
+       A page is added by the thread making its `m_remote_free_list` non-empty, and only removed by `import_objs`,
+       so a page occurs at most once in this list. */
+    atomic<page *> m_remote_pages{nullptr};
     uint64_t  m_heartbeat{0}; /* Counter for implementing "deterministic timeouts". It is currently the number of small allocations */
+    unsigned  m_num_segments{0};
+    uint64_t  m_next_trim_heartbeat{0};
+    uint64_t  m_trim_epoch{0};
+    /* The next small allocation sampled by the allocation profiler is the one where `m_heartbeat` reaches `m_next_sample`. */
+    uint64_t  m_next_sample{UINT64_MAX};
+    uint64_t  m_sample_epoch{0};
+    uint64_t  m_sample_rng{88172645463325252ull};
     void import_objs();
-    void export_objs();
     void alloc_segment();
+    void trim(unsigned max_segments);
+    void trim_if_needed();
+    void set_next_sample();
+    void update_sampling();
 };
 
 struct heap_manager {
@@ -153,6 +278,12 @@ struct heap_manager {
             return nullptr;
         }
     }
+
+    void trim_orphans() {
+        lock_guard<mutex> lock(m_mutex);
+        for (heap * h = m_orphans; h != nullptr; h = h->m_next_orphan)
+            h->trim(0);
+    }
 };
 
 static inline page * get_page_of(void * o) {
@@ -218,62 +349,147 @@ void page::push_free_obj(void * o) {
     }
 }
 
-void heap::import_objs() {
-    void * to_import = nullptr;
-    {   // TODO(Leo): avoid mutex using compare and swap
-        lock_guard<mutex> lock(m_mutex);
-        to_import = m_to_import_list;
-        m_to_import_list = nullptr;
-    }
-    while (to_import) {
-        page * p = get_page_of(to_import);
-        void * n = get_next_obj(to_import);
-        p->push_free_obj(to_import);
-        to_import = n;
+/* Deallocate an object of this page from a thread that does not own it. This operation is lock-free. */
+void page::push_remote_free_obj(void * o) {
+    lean_assert(get_page_of(o) == this);
+    LEAN_RUNTIME_STAT_CODE(g_num_remote_frees++);
+    void * head = m_header.m_remote_free_list.load();
+    do {
+        set_next_obj(o, head);
+    } while (!m_header.m_remote_free_list.compare_exchange_strong(head, o));
+    if (head == nullptr) {
+        /* We made the remote free list non-empty, so we are responsible for notifying the owner. */
+        LEAN_RUNTIME_STAT_CODE(g_num_remote_pages++);
+        heap * h = get_heap();
+        page * pages = h->m_remote_pages.load();
+        do {
+            m_header.m_next_remote = pages;
+        } while (!h->m_remote_pages.compare_exchange_strong(pages, this));
     }
 }
 
-struct export_entry {
-    heap * m_heap;
-    void * m_head;
-    void * m_tail;
-};
-
-void heap::export_objs() {
-    std::vector<export_entry> to_export;
-    void * o = m_to_export_list;
-    while (o != nullptr) {
-        void * n   = get_next_obj(o);
-        heap * h   = get_page_of(o)->get_heap();
-        bool found = false;
-        for (export_entry & e : to_export) {
-            if (e.m_heap == h) {
-                set_next_obj(o, e.m_head);
-                e.m_head = o;
-                found = true;
-                break;
-            }
-        }
-        if (!found) {
-            set_next_obj(o, nullptr);
-            to_export.push_back(export_entry{h, o, o});
+void heap::import_objs() {
+    page * p = m_remote_pages.exchange(nullptr);
+    while (p) {
+        /* Remark: we must read `m_next_remote` before emptying the remote free list,
+           since another thread may add `p` to `m_remote_pages` again afterwards. */
+        page * next_p   = p->m_header.m_next_remote;
+        void * to_import = p->m_header.m_remote_free_list.exchange(nullptr);
+        while (to_import) {
+            void * n = get_next_obj(to_import);
+            p->push_free_obj(to_import);
+            to_import = n;
         }
-        o = n;
-    }
-    m_to_export_list      = nullptr;
-    m_to_export_list_size = 0;
-    for (export_entry const & e : to_export) {
-        unique_lock<mutex> lock(e.m_heap->m_mutex);
-        set_next_obj(e.m_tail, e.m_heap->m_to_import_list);
-        e.m_heap->m_to_import_list = e.m_head;
+        p = next_p;
     }
 }
 
 void heap::alloc_segment() {
     LEAN_RUNTIME_STAT_CODE(g_num_segments++);
-    segment * s = new segment();
+    segment * s = alloc_segment_mem();
     s->m_next   = m_curr_segment;
     m_curr_segment = s;
+    m_num_segments++;
+}
+
+/* Remove the pages of released segments from the given page list. */
+static void page_list_remove_released(page * & head) {
+    page ** it  = &head;
+    page * prev = nullptr;
+    while (page * p = *it) {
+        if (p->m_header.m_segment->m_released) {
+            *it = p->get_next();
+        } else {
+            p->set_prev(prev);
+            prev = p;
+            it   = &p->m_header.m_next;
+        }
+    }
+}
+
+/* Return segments containing only empty pages to the OS until the heap owns at most `max_segments` segments.
+   The current segment and the segments containing the current page of some slot are never released.
+   This method must only be invoked by the thread owning the heap, or on orphan heaps while holding the heap manager lock.
+
+   Remark: no other thread can access an empty page since it does not contain any live object. */
+void heap::trim(unsigned max_segments) {
+    LEAN_RUNTIME_STAT_CODE(g_num_trims++);
+    import_objs();
+    if (m_num_segments <= max_segments)
+        return;
+    for (segment * s = m_curr_segment; s != nullptr; s = s->m_next)
+        s->m_num_empty_pages = 0;
+    for (unsigned i = 0; i < LEAN_NUM_SLOTS; i++) {
+        /* Remark: the first page in `m_curr_page[i]` is the current page, and we do not count it. */
+        for (page * p = m_curr_page[i]->get_next(); p != nullptr; p = p->get_next()) {
+            if (p->is_empty())
+                p->m_header.m_segment->m_num_empty_pages++;
+        }
+        for (page * p = m_page_free_list[i]; p != nullptr; p = p->get_next()) {
+            if (p->is_empty())
+                p->m_header.m_segment->m_num_empty_pages++;
+        }
+    }
+    bool found = false;
+    for (segment * s = m_curr_segment->m_next; s != nullptr && m_num_segments > max_segments; s = s->m_next) {
+        if (s->m_num_empty_pages == s->get_num_pages()) {
+            s->m_released = true;
+            m_num_segments--;
+            found = true;
+        }
+    }
+    if (!found)
+        return;
+    for (unsigned i = 0; i < LEAN_NUM_SLOTS; i++) {
+        page_list_remove_released(m_curr_page[i]);
+        page_list_remove_released(m_page_free_list[i]);
+    }
+    segment * prev = m_curr_segment;
+    while (segment * s = prev->m_next) {
+        if (s->m_released) {
+            LEAN_RUNTIME_STAT_CODE(g_num_released_segments++);
+            prev->m_next = s->m_next;
+            free_segment_mem(s);
+        } else {
+            prev = s;
+        }
+    }
+}
+
+/* Pick the next allocation to be sampled. We use random intervals to avoid aliasing with periodic allocation patterns. */
+void heap::set_next_sample() {
+    unsigned rate = g_sample_rate.load();
+    if (rate == 0) {
+        m_next_sample = UINT64_MAX;
+    } else {
+        /* xorshift64 */
+        m_sample_rng ^= m_sample_rng << 13;
+        m_sample_rng ^= m_sample_rng >> 7;
+        m_sample_rng ^= m_sample_rng << 17;
+        m_next_sample = m_heartbeat + 1 + m_sample_rng % (2 * static_cast<uint64_t>(rate));
+    }
+}
+
+/* Invoked by the allocation slow path. */
+void heap::update_sampling() {
+    uint64_t epoch = g_sample_epoch.load();
+    if (LEAN_UNLIKELY(m_sample_epoch != epoch)) {
+        m_sample_epoch = epoch;
+        set_next_sample();
+    }
+}
+
+/* Invoked by the allocation slow path. */
+void heap::trim_if_needed() {
+    uint64_t epoch = g_trim_epoch.load();
+    if (LEAN_UNLIKELY(m_trim_epoch != epoch)) {
+        /* `trim_heaps` has been invoked since our last trim. */
+        m_trim_epoch = epoch;
+        trim(0);
+    } else if (m_num_segments > g_heap_high_watermark.load() && m_heartbeat >= m_next_trim_heartbeat) {
+        m_next_trim_heartbeat = m_heartbeat + LEAN_HEAP_TRIM_INTERVAL;
+        trim(g_heap_high_watermark.load());
+    }
 }
 
 static page * alloc_page(heap * h, unsigned obj_size) {
@@ -288,6 +504,7 @@ static page * alloc_page(heap * h, unsigned obj_size) {
     }
     unsigned slot_idx        = lean_get_slot_idx(obj_size);
     p->m_header.m_heap       = h;
+    p->m_header.m_segment    = s;
     page_list_insert(h->m_curr_page[slot_idx], p);
     p->m_header.m_slot_idx   = slot_idx;
     p->m_header.m_obj_size   = obj_size;
@@ -323,7 +540,6 @@ static page * alloc_page(heap * h, unsigned obj_size) {
 
 static void finalize_heap(void * _h) {
     heap * h = static_cast<heap*>(_h);
-    h->export_objs();
     h->import_objs();
     g_heap_manager->push_orphan(h);
 }
@@ -341,6 +557,8 @@ static void init_heap(bool main) {
             g_heap->m_curr_page[i] = nullptr;
             g_heap->m_page_free_list[i] = nullptr;
         }
+        g_heap->m_trim_epoch = g_trim_epoch.load();
+        g_heap->m_sample_rng ^= reinterpret_cast<size_t>(g_heap);
         g_heap->alloc_segment();
         unsigned obj_size = LEAN_OBJECT_SIZE_DELTA;
         for (unsigned i = 0; i < LEAN_NUM_SLOTS; i++) {
@@ -360,24 +578,48 @@ void init_thread_heap() {
     init_heap(false);
 }
 
+static void sample_alloc(void * o, unsigned sz) {
+    g_heap->set_next_sample();
+    get_page_of(o)->m_header.m_num_sampled++;
+    alloc_sampler_record_alloc(o, sz);
+}
+
+static void sample_free(page * p, void * o) {
+    if (alloc_sampler_record_free(o))
+        p->m_header.m_num_sampled--;
+}
+
+static void forget_sample(void * o) {
+    get_page_of(o)->m_header.m_num_sampled--;
+}
+
+/* Invoked when `p` has no free objects, or when the allocation must be sampled. */
 LEAN_NOINLINE
 void * lean_alloc_small_cold(unsigned sz, unsigned slot_idx, page * p) {
-    if (g_heap->m_page_free_list[slot_idx] == nullptr) {
-        g_heap->import_objs();
-        lean_assert(g_heap->m_curr_page[slot_idx] == p);
-        /* g_heap->import_objs() may add objects to p->m_header.m_free_list */
-        if (p->m_header.m_free_list == nullptr)
+    if (p->m_header.m_free_list == nullptr) {
+        g_heap->trim_if_needed();
+        g_heap->update_sampling();
+        if (g_heap->m_page_free_list[slot_idx] == nullptr) {
+            g_heap->import_objs();
+            lean_assert(g_heap->m_curr_page[slot_idx] == p);
+        }
+        if (p->m_header.m_free_list != nullptr) {
+            /* g_heap->import_objs() added objects to p->m_header.m_free_list */
+        } else if (g_heap->m_page_free_list[slot_idx] == nullptr) {
             p = alloc_page(g_heap, sz);
-    } else {
-        p = page_list_pop(g_heap->m_page_free_list[slot_idx]);
-        p->m_header.m_in_page_free_list = false;
-        page_list_insert(g_heap->m_curr_page[slot_idx], p);
+        } else {
+            p = page_list_pop(g_heap->m_page_free_list[slot_idx]);
+            p->m_header.m_in_page_free_list = false;
+            page_list_insert(g_heap->m_curr_page[slot_idx], p);
+        }
     }
     void * r = p->m_header.m_free_list;
     lean_assert(r);
     p->m_header.m_free_list = get_next_obj(r);
     p->m_header.m_num_free--;
     lean_assert(get_page_of(r) == p);
+    if (LEAN_UNLIKELY(g_heap->m_heartbeat >= g_heap->m_next_sample))
+        sample_alloc(r, sz);
     return r;
 }
 
@@ -385,7 +627,7 @@ extern "C" LEAN_EXPORT void * lean_alloc_small(unsigned sz, unsigned slot_idx) {
     page * p = g_heap->m_curr_page[slot_idx];
     g_heap->m_heartbeat++;
     void * r = p->m_header.m_free_list;
-    if (LEAN_UNLIKELY(r == nullptr)) {
+    if (LEAN_UNLIKELY(r == nullptr || g_heap->m_heartbeat >= g_heap->m_next_sample)) {
         return lean_alloc_small_cold(sz, slot_idx, p);
     }
     p->m_header.m_free_list = get_next_obj(r);
@@ -394,7 +636,7 @@ extern "C" LEAN_EXPORT void * lean_alloc_small(unsigned sz, unsigned slot_idx) {
     return r;
 }
 
-void * alloc(size_t sz) {
+void * alloc_object(size_t sz) {
     sz = lean_align(sz, LEAN_OBJECT_SIZE_DELTA);
     LEAN_RUNTIME_STAT_CODE(g_num_alloc++);
     if (LEAN_UNLIKELY(sz > LEAN_MAX_SMALL_OBJECT_SIZE)) {
@@ -408,15 +650,15 @@ void * alloc(size_t sz) {
     return lean_alloc_small(sz, slot_idx);
 }
 
-LEAN_NOINLINE
-static void dealloc_small_core_cold(void * o) {
-    set_next_obj(o, g_heap->m_to_export_list);
-    g_heap->m_to_export_list = o;
-    g_heap->m_to_export_list_size++;
-    if (g_heap->m_to_export_list_size > LEAN_MAX_TO_EXPORT_OBJS) {
-        LEAN_RUNTIME_STAT_CODE(g_num_exports++);
-        g_heap->export_objs();
+void * alloc(size_t sz) {
+    void * r = alloc_object(sz);
+    if (sz <= LEAN_MAX_SMALL_OBJECT_SIZE) {
+        /* `r` is not a Lean object, so the allocation profiler must not read its tag. */
+        page * p = get_page_of(r);
+        if (LEAN_UNLIKELY(atomic_load_explicit(&p->m_header.m_num_sampled, memory_order_relaxed) != 0))
+            alloc_sampler_set_non_object(r);
     }
+    return r;
 }
 
 static inline void dealloc_small_core(void * o) {
@@ -426,10 +668,13 @@ static inline void dealloc_small_core(void * o) {
     }
     lean_assert(g_heap);
     page * p = get_page_of(o);
+    if (LEAN_UNLIKELY(atomic_load_explicit(&p->m_header.m_num_sampled, memory_order_relaxed) != 0)) {
+        sample_free(p, o);
+    }
     if (LEAN_LIKELY(p->get_heap() == g_heap)) {
         p->push_free_obj(o);
     } else {
-        dealloc_small_core_cold(o);
+        p->push_remote_free_obj(o);
     }
 }
 
@@ -453,9 +698,58 @@ extern "C" LEAN_EXPORT unsigned lean_small_mem_size(void * o) {
 
 #endif
 
+void trim_heaps() {
+#ifdef LEAN_SMALL_ALLOCATOR
+    g_trim_epoch++;
+    g_heap_manager->trim_orphans();
+    if (g_heap)
+        g_heap->trim_if_needed();
+#endif
+}
+
+void set_alloc_sampling(unsigned sample_rate, bool backtraces) {
+#ifdef LEAN_SMALL_ALLOCATOR
+    if (sample_rate > 0)
+        alloc_sampler_reset(sample_rate, backtraces, forget_sample);
+    g_sample_rate.store(sample_rate);
+    g_sample_epoch++;
+    if (g_heap)
+        g_heap->update_sampling();
+#endif
+}
+
+void exclude_from_alloc_sampling(void * o) {
+#ifdef LEAN_SMALL_ALLOCATOR
+    page * p = get_page_of(o);
+    if (LEAN_UNLIKELY(atomic_load_explicit(&p->m_header.m_num_sampled, memory_order_relaxed) != 0)) {
+        if (alloc_sampler_discard(o))
+            p->m_header.m_num_sampled--;
+    }
+#endif
+}
+
+void set_heap_high_watermark(size_t num_bytes) {
+#ifdef LEAN_SMALL_ALLOCATOR
+    /* Round up, a nonzero amount below one segment must not be interpreted as "release all segments".
+       Remark: `LEAN_SEGMENT_SIZE` is not parenthesized, so we must not divide by it directly. */
+    size_t segment_size = LEAN_SEGMENT_SIZE;
+    g_heap_high_watermark.store((num_bytes + segment_size - 1) / segment_size);
+#endif
+}
+
 void initialize_alloc() {
 #ifdef LEAN_SMALL_ALLOCATOR
     g_heap_manager = new heap_manager();
+    if (char const * huge_pages = std::getenv("LEAN_HUGE_PAGES")) {
+        if (strcmp(huge_pages, "transparent") == 0)
+            g_huge_pages = huge_pages_mode::Transparent;
+        else if (strcmp(huge_pages, "explicit") == 0)
+            g_huge_pages = huge_pages_mode::Explicit;
+    }
+    if (char const * watermark = std::getenv("LEAN_HEAP_HIGH_WATERMARK")) {
+        /* Value is in megabytes. */
+        set_heap_high_watermark(static_cast<size_t>(std::strtoull(watermark, nullptr, 10)) * 1024 * 1024);
+    }
     init_heap(true);
 #endif
 }
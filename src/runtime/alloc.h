@@ -8,12 +8,35 @@ Author: Leonardo de Moura
 #include <stddef.h>
 #include <stdint.h>
 
+#ifdef LEAN_RUNTIME_STATS
+#define LEAN_RUNTIME_STAT_CODE(c) c
+#else
+#define LEAN_RUNTIME_STAT_CODE(c)
+#endif
+
 namespace lean {
 void init_thread_heap();
 void * alloc(size_t sz);
+/* Similar to `alloc`, but the result is a Lean object, whose tag is reported by the allocation profiler. */
+void * alloc_object(size_t sz);
 void dealloc(void * o, size_t sz);
 void add_heartbeats(uint64_t count);
 uint64_t get_num_heartbeats();
+/* Return fully free segments of the small object allocator to the OS. The heap of the current thread and
+   the heaps of finished threads are trimmed immediately, the heaps of the other threads on their next
+   allocation slow path. */
+void trim_heaps();
+/* Set the amount of memory each thread heap may retain before fully free segments are returned to the OS.
+   The default is 64Mb, and it can also be set in megabytes using the `LEAN_HEAP_HIGH_WATERMARK` environment variable.
+   The amount is rounded up to a whole number of segments (8Mb). */
+void set_heap_high_watermark(size_t num_bytes);
+/* Sample on average one out of `sample_rate` small allocations using the allocation profiler (see `allocprof.h`),
+   discarding the previous profile. If `backtraces` is true, the backtrace of each sampled allocation is recorded.
+   If `sample_rate == 0`, sampling is stopped but the current profile is kept, and sampled objects are still tracked until freed. */
+void set_alloc_sampling(unsigned sample_rate, bool backtraces);
+/* Exclude the small object `o` from the allocation profile. This is used for blocks that are recycled outside of
+   the allocator, whose frees the profiler cannot observe. */
+void exclude_from_alloc_sampling(void * o);
 void initialize_alloc();
 void finalize_alloc();
 }
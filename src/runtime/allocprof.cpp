@@ -4,7 +4,19 @@ Released under Apache 2.0 license as described in the file LICENSE.
 
 Author: Leonardo de Moura
 */
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <sstream>
 #include "runtime/allocprof.h"
+#include "runtime/thread.h"
+
+#ifdef __GLIBC__
+#include <execinfo.h>
+#endif
+
+#define LEAN_ALLOC_SAMPLER_MAX_FRAMES 32
+
 namespace lean {
 allocprof::allocprof(std::ostream & out, char const * msg):
     m_out(out), m_msg(msg) {
@@ -44,4 +56,256 @@ allocprof::~allocprof() {
     m_out << "Allocation profiling data is not available, compile lean using `-D RUNTIME_STATS=ON`\n";
 #endif
 }
+
+// =======================================
+// Sampling allocation profiler
+
+namespace {
+struct sample_counters {
+    uint64_t m_num_alloc{0};
+    uint64_t m_num_freed{0};
+};
+
+struct sampled_obj {
+    unsigned m_obj_size;
+    unsigned m_backtrace_idx;
+    /* Set for blocks that are not Lean objects (e.g., `mpz` limbs), which have no tag. */
+    bool     m_non_object;
+};
+
+struct sampled_backtrace {
+    std::vector<void *> m_frames;
+    sample_counters     m_counters;
+};
+
+class alloc_sampler {
+    mutex                                  m_mutex;
+    unsigned                               m_sample_rate{0};
+    bool                                   m_backtraces{false};
+    std::unordered_map<void *, sampled_obj> m_live;
+    /* object size => counters */
+    std::map<unsigned, sample_counters>    m_sizes;
+    /* The tag of an object is only known after its allocation, so we only track freed objects by tag,
+       and compute the tags of live objects in `to_json`. */
+    uint64_t                               m_num_freed_by_tag[LeanReserved + 1] = {};
+    sample_counters                        m_non_objects;
+    std::vector<sampled_backtrace>         m_backtrace_list;
+    std::map<std::vector<void *>, unsigned> m_backtrace_idx;
+
+    unsigned get_backtrace_idx() {
+#ifdef __GLIBC__
+        void * buf[LEAN_ALLOC_SAMPLER_MAX_FRAMES + 3];
+        int n = backtrace(buf, sizeof(buf) / sizeof(void *));
+        /* skip `get_backtrace_idx`, `record_alloc`, and `alloc_sampler_record_alloc` */
+        int skip = n < 3 ? n : 3;
+        std::vector<void *> frames(buf + skip, buf + n);
+        auto it = m_backtrace_idx.find(frames);
+        if (it != m_backtrace_idx.end())
+            return it->second;
+        unsigned idx = m_backtrace_list.size();
+        m_backtrace_idx.insert(std::make_pair(frames, idx));
+        m_backtrace_list.push_back(sampled_backtrace{frames, sample_counters()});
+        return idx;
+#else
+        return 0;
+#endif
+    }
+
+public:
+    void reset(unsigned sample_rate, bool backtraces, void (*forget)(void * o)) {
+        lock_guard<mutex> lock(m_mutex);
+        for (auto const & p : m_live)
+            forget(p.first);
+        m_live.clear();
+        m_sizes.clear();
+        std::fill(m_num_freed_by_tag, m_num_freed_by_tag + LeanReserved + 1, 0);
+        m_non_objects = sample_counters();
+        m_backtrace_list.clear();
+        m_backtrace_idx.clear();
+        m_sample_rate = sample_rate;
+        m_backtraces  = backtraces;
+    }
+
+    void record_alloc(void * o, unsigned obj_size) {
+        lock_guard<mutex> lock(m_mutex);
+        unsigned bt_idx = 0;
+        if (m_backtraces) {
+            bt_idx = get_backtrace_idx();
+            if (bt_idx < m_backtrace_list.size())
+                m_backtrace_list[bt_idx].m_counters.m_num_alloc++;
+        }
+        m_sizes[obj_size].m_num_alloc++;
+        m_live[o] = sampled_obj{obj_size, bt_idx, false};
+    }
+
+    bool record_free(void * o) {
+        lock_guard<mutex> lock(m_mutex);
+        auto it = m_live.find(o);
+        if (it == m_live.end())
+            return false;
+        sampled_obj const & s = it->second;
+        m_sizes[s.m_obj_size].m_num_freed++;
+        if (s.m_non_object)
+            m_non_objects.m_num_freed++;
+        else
+            m_num_freed_by_tag[lean_ptr_tag(static_cast<lean_object *>(o))]++;
+        if (s.m_backtrace_idx < m_backtrace_list.size())
+            m_backtrace_list[s.m_backtrace_idx].m_counters.m_num_freed++;
+        m_live.erase(it);
+        return true;
+    }
+
+    bool discard(void * o) {
+        lock_guard<mutex> lock(m_mutex);
+        auto it = m_live.find(o);
+        if (it == m_live.end())
+            return false;
+        sampled_obj const & s = it->second;
+        m_sizes[s.m_obj_size].m_num_alloc--;
+        if (s.m_non_object)
+            m_non_objects.m_num_alloc--;
+        if (s.m_backtrace_idx < m_backtrace_list.size())
+            m_backtrace_list[s.m_backtrace_idx].m_counters.m_num_alloc--;
+        m_live.erase(it);
+        return true;
+    }
+
+    void set_non_object(void * o) {
+        lock_guard<mutex> lock(m_mutex);
+        auto it = m_live.find(o);
+        if (it != m_live.end() && !it->second.m_non_object) {
+            it->second.m_non_object = true;
+            m_non_objects.m_num_alloc++;
+        }
+    }
+
+    std::string to_json();
+};
+
+static char const * get_tag_kind(unsigned tag) {
+    switch (tag) {
+    case LeanClosure:     return "closure";
+    case LeanArray:       return "array";
+    case LeanStructArray: return "struct_array";
+    case LeanScalarArray: return "scalar_array";
+    case LeanString:      return "string";
+    case LeanMPZ:         return "mpz";
+    case LeanThunk:       return "thunk";
+    case LeanTask:        return "task";
+    case LeanRef:         return "ref";
+    case LeanExternal:    return "external";
+    case LeanReserved:    return "reserved";
+    default:              return "ctor";
+    }
+}
+
+static void display_json_string(std::ostream & out, char const * s) {
+    out << '"';
+    for (; *s; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out << buf;
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+static void display_counters(std::ostream & out, uint64_t num_alloc, uint64_t num_freed) {
+    out << "\"allocated\": " << num_alloc << ", \"freed\": " << num_freed << ", \"live\": " << num_alloc - num_freed;
+}
+
+std::string alloc_sampler::to_json() {
+    lock_guard<mutex> lock(m_mutex);
+    std::ostringstream out;
+    out << "{\"sample_rate\": " << m_sample_rate << ",\n";
+    out << "\"sizes\": [";
+    bool first = true;
+    for (auto const & p : m_sizes) {
+        out << (first ? "\n" : ",\n") << "  {\"size\": " << p.first << ", ";
+        display_counters(out, p.second.m_num_alloc, p.second.m_num_freed);
+        out << "}";
+        first = false;
+    }
+    out << "],\n";
+    uint64_t num_live_by_tag[LeanReserved + 1] = {};
+    for (auto const & p : m_live) {
+        if (!p.second.m_non_object)
+            num_live_by_tag[lean_ptr_tag(static_cast<lean_object *>(p.first))]++;
+    }
+    out << "\"tags\": [";
+    first = true;
+    for (unsigned tag = 0; tag <= LeanReserved; tag++) {
+        uint64_t num_freed = m_num_freed_by_tag[tag];
+        uint64_t num_live  = num_live_by_tag[tag];
+        if (num_freed == 0 && num_live == 0)
+            continue;
+        out << (first ? "\n" : ",\n") << "  {\"tag\": " << tag << ", \"kind\": \"" << get_tag_kind(tag) << "\", ";
+        display_counters(out, num_freed + num_live, num_freed);
+        out << "}";
+        first = false;
+    }
+    out << "],\n";
+    out << "\"non_objects\": {";
+    display_counters(out, m_non_objects.m_num_alloc, m_non_objects.m_num_freed);
+    out << "},\n";
+    out << "\"backtraces\": [";
+    first = true;
+    for (sampled_backtrace const & bt : m_backtrace_list) {
+        out << (first ? "\n" : ",\n") << "  {";
+        display_counters(out, bt.m_counters.m_num_alloc, bt.m_counters.m_num_freed);
+        out << ", \"frames\": [";
+#ifdef __GLIBC__
+        char ** symbols = backtrace_symbols(bt.m_frames.data(), bt.m_frames.size());
+        for (size_t i = 0; i < bt.m_frames.size(); i++) {
+            if (i > 0) out << ", ";
+            display_json_string(out, symbols ? symbols[i] : "?");
+        }
+        free(symbols);
+#endif
+        out << "]}";
+        first = false;
+    }
+    out << "]}\n";
+    return out.str();
+}
+
+static alloc_sampler * g_alloc_sampler = nullptr;
+}
+
+void alloc_sampler_reset(unsigned sample_rate, bool backtraces, void (*forget)(void * o)) {
+    g_alloc_sampler->reset(sample_rate, backtraces, forget);
+}
+
+void alloc_sampler_record_alloc(void * o, unsigned obj_size) {
+    g_alloc_sampler->record_alloc(o, obj_size);
+}
+
+bool alloc_sampler_record_free(void * o) {
+    return g_alloc_sampler->record_free(o);
+}
+
+bool alloc_sampler_discard(void * o) {
+    return g_alloc_sampler->discard(o);
+}
+
+void alloc_sampler_set_non_object(void * o) {
+    g_alloc_sampler->set_non_object(o);
+}
+
+std::string alloc_sampler_to_json() {
+    return g_alloc_sampler->to_json();
+}
+
+void initialize_allocprof() {
+    g_alloc_sampler = new alloc_sampler();
+}
+
+void finalize_allocprof() {
+}
 }
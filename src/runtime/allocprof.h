@@ -26,4 +26,23 @@ public:
     allocprof(std::ostream & out, char const * msg);
     ~allocprof();
 };
+
+/* Sampling allocation profiler for the small object allocator.
+   It is enabled using `set_alloc_sampling` (see `alloc.h`), and does not require `RUNTIME_STATS=ON`.
+   The following functions are invoked by the allocator for sampled objects only. */
+
+/* Start a new profile, `forget` is invoked on every live object sampled by the previous profile. */
+void alloc_sampler_reset(unsigned sample_rate, bool backtraces, void (*forget)(void * o));
+void alloc_sampler_record_alloc(void * o, unsigned obj_size);
+/* Return true iff `o` is a live sampled object. */
+bool alloc_sampler_record_free(void * o);
+/* Stop tracking `o` as if it had never been sampled. Return true iff `o` is a live sampled object. */
+bool alloc_sampler_discard(void * o);
+/* Record that `o` is not a Lean object. It is counted in a separate bucket instead of by `lean_ptr_tag`. */
+void alloc_sampler_set_non_object(void * o);
+/* Return the current profile in JSON format. */
+std::string alloc_sampler_to_json();
+
+void initialize_allocprof();
+void finalize_allocprof();
 }
@@ -11,6 +11,7 @@ Author: Leonardo de Moura
 #include <cstring>
 #include <lean/lean.h>
 #include "runtime/hash.h"
+#include "runtime/thread.h"
 #include "runtime/compact.h"
 
 #ifndef LEAN_WINDOWS
@@ -19,6 +20,17 @@ Author: Leonardo de Moura
 
 #define LEAN_COMPACTOR_INIT_SZ 1024*1024
 #define LEAN_MAX_SHARING_TABLE_INITIAL_SIZE 1024*1024
+// parallel compaction only splits arrays with at least this many elements, up to the given depth
+#define LEAN_COMPACTOR_MIN_SPLIT_SIZE 64
+#define LEAN_COMPACTOR_MAX_SPLIT_DEPTH 3
+// number of partitions per thread for each split array, for load balancing
+#define LEAN_COMPACTOR_PARTITIONS_PER_THREAD 4
+
+// regions smaller than this are relocated sequentially
+#define LEAN_PARALLEL_RELOCATION_MIN_SIZE 8*1024*1024
+#define LEAN_RELOCATION_CHUNK_SIZE 1024*1024
+// maximal number of references sampled per array for finding chunk boundaries, see `fix_parallel`
+#define LEAN_RELOCATION_MAX_SAMPLES 1024
 
 // uncomment to track the number of each kind of object in an .olean file
 // #define LEAN_TAG_COUNTERS
@@ -95,21 +107,31 @@ void * object_compactor::alloc(size_t sz) {
     return r;
 }
 
+object_offset object_compactor::get_offset(object * new_o) const {
+    return reinterpret_cast<object_offset>(reinterpret_cast<char*>(new_o) - reinterpret_cast<char*>(m_begin) + reinterpret_cast<size_t>(m_base_addr));
+}
+
 void object_compactor::save(object * o, object * new_o) {
     lean_assert(m_begin <= new_o && new_o < m_end);
-    m_obj_table.insert(std::make_pair(o, reinterpret_cast<object_offset>(reinterpret_cast<char*>(new_o) - reinterpret_cast<char*>(m_begin) + reinterpret_cast<size_t>(m_base_addr))));
+    m_obj_table.insert(std::make_pair(o, get_offset(new_o)));
 }
 
-void object_compactor::save_max_sharing(object * o, object * new_o, size_t new_o_sz) {
+/* If an object with the same representation as the last allocated object `new_o` has already been compacted,
+   deallocate `new_o` and return the existing one. Otherwise, return `new_o`. */
+object * object_compactor::max_share(object * new_o, size_t new_o_sz) {
     max_sharing_key k(reinterpret_cast<char*>(new_o) - reinterpret_cast<char*>(m_begin), new_o_sz);
     auto it = m_max_sharing_table->m_table.find(k);
     if (it != m_max_sharing_table->m_table.end()) {
         m_end = new_o;
-        new_o = reinterpret_cast<lean_object*>(reinterpret_cast<char*>(m_begin) + it->m_offset);
+        return reinterpret_cast<lean_object*>(reinterpret_cast<char*>(m_begin) + it->m_offset);
     } else {
         m_max_sharing_table->m_table.insert(k);
+        return new_o;
     }
-    save(o, new_o);
+}
+
+void object_compactor::save_max_sharing(object * o, object * new_o, size_t new_o_sz) {
+    save(o, max_share(new_o, new_o_sz));
 }
 
 object_offset object_compactor::to_offset(object * o) {
@@ -273,6 +295,7 @@ void object_compactor::insert_mpz(object * o) {
     memcpy(data, m._mp_d, data_sz);
     m._mp_d = reinterpret_cast<mp_limb_t *>(reinterpret_cast<char *>(data) - reinterpret_cast<char *>(m_begin) + reinterpret_cast<ptrdiff_t>(m_base_addr));
     m._mp_alloc = nlimbs;
+    m_mpz_log.push_back(std::make_pair(reinterpret_cast<char*>(new_o) - reinterpret_cast<char*>(m_begin), o));
     save(o, (lean_object*)new_o);
 #else
     size_t data_sz = sizeof(mpn_digit) * to_mpz(o)->m_value.m_size;
@@ -283,6 +306,7 @@ void object_compactor::insert_mpz(object * o) {
     void * data = reinterpret_cast<char*>(new_o) + sizeof(mpz_object);
     memcpy(data, to_mpz(o)->m_value.m_digits, data_sz);
     new_o->m_value.m_digits = reinterpret_cast<mpn_digit *>(reinterpret_cast<char *>(data) - reinterpret_cast<char *>(m_begin) + reinterpret_cast<ptrdiff_t>(m_base_addr));
+    m_mpz_log.push_back(std::make_pair(reinterpret_cast<char*>(new_o) - reinterpret_cast<char*>(m_begin), o));
     save(o, (lean_object*)new_o);
 #endif
 }
@@ -324,10 +348,9 @@ tag_counter_manager g_tag_counter_manager;
 
 #endif
 
-void object_compactor::operator()(object * o) {
+/* Compact `o` and all objects reachable from it that have not been compacted yet, in depth-first post-order. */
+void object_compactor::compact(object * o) {
     lean_assert(m_todo.empty());
-    // allocate for root address, see end of function
-    alloc(sizeof(object_offset));
     if (!lean_is_scalar(o)) {
         m_todo.push_back(o);
         while (!m_todo.empty()) {
@@ -358,6 +381,234 @@ void object_compactor::operator()(object * o) {
         }
         m_tmp.clear();
     }
+}
+
+void object_compactor::operator()(object * o) {
+    // allocate for root address, see end of function
+    alloc(sizeof(object_offset));
+    compact(o);
+    *static_cast<object_offset *>(m_begin) = to_offset(o);
+}
+
+/*
+Parallel compaction
+
+The layout produced by `operator()(o)` is the depth-first post-order of the object graph, where an object is skipped
+if it has already been compacted, or if it has the same representation as an already compacted object (max sharing).
+Thus the layout of the objects reachable from the children `c_1, ..., c_n` of an object (in the order they are
+visited) is the concatenation of the layouts of `c_1, ..., c_n`, each without the objects already contained in
+the previous ones, followed by the object itself.
+
+We use this to split the traversal of the root object into a sequence of steps: partitions, which are sequences of
+consecutive children of a split object, and the split objects themselves ("spines"). Each worker thread compacts
+partitions in increasing order into its own `object_compactor`. Meanwhile, the calling thread merges the finished
+partitions in order into the final buffer: we copy the partition's objects, redirect their references using the
+offsets of the previously merged objects, and apply max sharing again. Objects that were already merged from another
+partition are eliminated by max sharing since they have the same representation, except for `mpz` objects, which
+are looked up by identity in `m_obj_table` as in `insert_mpz`. Spines are compacted sequentially after their
+children have been merged.
+
+The merge never traverses the original object graph and performs no object table lookups, which dominate the
+sequential compactor.
+*/
+
+struct object_compactor::compaction_step {
+    // `m_spine != nullptr` for spines, otherwise `m_partition` is the index of the partition
+    object * m_spine;
+    size_t   m_partition;
+};
+
+struct object_compactor::partition {
+    // children of a spine, compacted in this order
+    std::vector<object *> m_roots;
+    // the following fields are set by the worker that compacted the partition
+    unsigned m_worker{0};
+    // offset of `m_data` in the worker's buffer
+    size_t m_begin{0};
+    // copy of the objects compacted for this partition. We cannot read the worker's buffer directly since
+    // it may be reallocated while the worker compacts the next partition.
+    std::vector<char> m_data;
+    std::vector<std::pair<size_t, object*>> m_mpz_log;
+    std::vector<object_offset> m_root_offsets;
+};
+
+static inline void get_children(object * o, std::vector<object *> & r) {
+    r.clear();
+    if (lean_is_ctor(o)) {
+        for (unsigned i = 0; i < lean_ctor_num_objs(o); i++)
+            r.push_back(lean_ctor_get(o, i));
+    } else if (lean_ptr_tag(o) == LeanArray) {
+        for (size_t i = 0; i < lean_array_size(o); i++)
+            r.push_back(lean_array_get_core(o, i));
+    }
+}
+
+static inline bool should_split(object * o, unsigned depth) {
+    return
+        !lean_is_scalar(o) && depth < LEAN_COMPACTOR_MAX_SPLIT_DEPTH &&
+        (depth == 0 ? lean_is_ctor(o) || lean_ptr_tag(o) == LeanArray
+                    : lean_ptr_tag(o) == LeanArray && lean_array_size(o) >= LEAN_COMPACTOR_MIN_SPLIT_SIZE);
+}
+
+void object_compactor::plan(object * o, unsigned depth, unsigned num_threads, std::vector<compaction_step> & steps,
+                            std::vector<partition> & parts, std::unordered_set<object *> & spines) {
+    std::vector<object *> children;
+    get_children(o, children);
+    size_t chunk_sz = std::max(static_cast<size_t>(1), children.size() / (num_threads * LEAN_COMPACTOR_PARTITIONS_PER_THREAD));
+    bool open = false;
+    for (object * c : children) {
+        if (lean_is_scalar(c))
+            continue;
+        if (should_split(c, depth + 1)) {
+            open = false;
+            // if `c` has already been planned, it will be in `m_obj_table` when we get here
+            if (spines.insert(c).second)
+                plan(c, depth + 1, num_threads, steps, parts, spines);
+            continue;
+        }
+        if (!open || parts.back().m_roots.size() >= chunk_sz) {
+            steps.push_back(compaction_step{nullptr, parts.size()});
+            parts.push_back(partition());
+            open = true;
+        }
+        parts.back().m_roots.push_back(c);
+    }
+    steps.push_back(compaction_step{o, 0});
+}
+
+/* Copy the objects of partition `p` into this compactor. `remap` maps offsets in the buffer of the worker that compacted `p`
+   to offsets in this compactor, and must contain the offsets of all objects compacted by the worker before `p`. */
+void object_compactor::merge(partition const & p, std::vector<object_offset> & remap) {
+    auto fix = [&](object * v) {
+        return lean_is_scalar(v) ? v : remap[reinterpret_cast<size_t>(v) / sizeof(void*)];
+    };
+    size_t mpz_idx = 0;
+    size_t off     = p.m_begin;
+    size_t end     = p.m_begin + p.m_data.size();
+    while (off < end) {
+        object * o = reinterpret_cast<object*>(const_cast<char*>(p.m_data.data()) + (off - p.m_begin));
+        size_t sz;
+        if (lean_ptr_tag(o) == LeanMPZ) {
+            lean_assert(p.m_mpz_log[mpz_idx].first == off);
+            object * orig = p.m_mpz_log[mpz_idx++].second;
+#ifdef LEAN_USE_GMP
+            sz = sizeof(mpz_object) + sizeof(mp_limb_t) * to_mpz(o)->m_value.m_val[0]._mp_alloc;
+#else
+            sz = sizeof(mpz_object) + sizeof(mpn_digit) * to_mpz(o)->m_value.m_size;
+#endif
+            // `mpz` objects are shared by identity only, see `insert_mpz`
+            auto it = m_obj_table.find(orig);
+            if (it != m_obj_table.end()) {
+                remap[off / sizeof(void*)] = it->second;
+            } else {
+                object * new_o = static_cast<object*>(alloc(sz));
+                memcpy(new_o, o, sz);
+                char * data = reinterpret_cast<char*>(new_o) + sizeof(mpz_object);
+                ptrdiff_t data_offset = data - reinterpret_cast<char*>(m_begin) + reinterpret_cast<ptrdiff_t>(m_base_addr);
+#ifdef LEAN_USE_GMP
+                to_mpz(new_o)->m_value.m_val[0]._mp_d = reinterpret_cast<mp_limb_t *>(data_offset);
+#else
+                to_mpz(new_o)->m_value.m_digits = reinterpret_cast<mpn_digit *>(data_offset);
+#endif
+                save(orig, new_o);
+                remap[off / sizeof(void*)] = get_offset(new_o);
+            }
+        } else {
+            sz = lean_object_byte_size(o);
+            object * new_o = static_cast<object*>(alloc(sz));
+            memcpy(new_o, o, sz);
+            switch (lean_ptr_tag(new_o)) {
+            case LeanArray:
+                for (size_t i = 0; i < lean_array_size(new_o); i++)
+                    lean_array_set_core(new_o, i, fix(lean_array_get_core(new_o, i)));
+                break;
+            case LeanScalarArray: case LeanString:
+                break;
+            case LeanThunk: lean_to_thunk(new_o)->m_value = fix(lean_to_thunk(new_o)->m_value); break;
+            case LeanTask:  lean_to_task(new_o)->m_value = fix(lean_to_task(new_o)->m_value); break;
+            case LeanRef:   lean_to_ref(new_o)->m_value = fix(lean_to_ref(new_o)->m_value); break;
+            default:
+                lean_assert(lean_is_ctor(new_o));
+                for (unsigned i = 0; i < lean_ctor_num_objs(new_o); i++)
+                    lean_ctor_set(new_o, i, fix(lean_ctor_get(new_o, i)));
+                break;
+            }
+            remap[off / sizeof(void*)] = get_offset(max_share(new_o, sz));
+        }
+        off += (sz + sizeof(void*) - 1) / sizeof(void*) * sizeof(void*);
+    }
+    lean_assert(mpz_idx == p.m_mpz_log.size());
+    for (size_t i = 0; i < p.m_roots.size(); i++)
+        m_obj_table.insert(std::make_pair(p.m_roots[i], remap[reinterpret_cast<size_t>(p.m_root_offsets[i]) / sizeof(void*)]));
+}
+
+void object_compactor::operator()(object * o, unsigned num_threads) {
+    if (num_threads <= 1 || !should_split(o, 0)) {
+        (*this)(o);
+        return;
+    }
+    /* Workers force the thunks and tasks they find using `lean_thunk_get` and `lean_task_get`, so the graph must be
+       marked as multi-threaded: an unevaluated single-threaded thunk must not be evaluated by a foreign thread, and
+       the waiters of a thunk being evaluated by another worker are only woken up for shared thunks. */
+    lean_mark_mt(o);
+    std::vector<compaction_step> steps;
+    std::vector<partition> parts;
+    std::unordered_set<object *> spines;
+    plan(o, 0, num_threads, steps, parts, spines);
+    num_threads = std::min(num_threads, static_cast<unsigned>(std::max(parts.size(), static_cast<size_t>(1))));
+
+    // workers compact the partitions while this thread merges them in order
+    mutex mut;
+    condition_variable done_cv;
+    std::vector<char> done(parts.size(), false);
+    atomic<size_t> next_part(0);
+    std::vector<std::unique_ptr<lthread>> threads;
+    for (unsigned i = 0; i < num_threads; i++) {
+        threads.emplace_back(new lthread([&, i]() {
+            // partitions are taken in increasing order, so a partition only references objects of previous ones
+            object_compactor c;
+            while (true) {
+                size_t j = next_part++;
+                if (j >= parts.size())
+                    break;
+                partition & p = parts[j];
+                size_t begin     = c.size();
+                size_t mpz_begin = c.m_mpz_log.size();
+                for (object * r : p.m_roots)
+                    c.compact(r);
+                p.m_worker = i;
+                p.m_begin  = begin;
+                p.m_data.assign(static_cast<char const *>(c.data()) + begin, static_cast<char const *>(c.data()) + c.size());
+                p.m_mpz_log.assign(c.m_mpz_log.begin() + mpz_begin, c.m_mpz_log.end());
+                for (object * r : p.m_roots)
+                    p.m_root_offsets.push_back(c.m_obj_table.find(r)->second);
+                unique_lock<mutex> lock(mut);
+                done[j] = true;
+                done_cv.notify_all();
+            }
+        }));
+    }
+
+    alloc(sizeof(object_offset));
+    std::vector<std::vector<object_offset>> remaps(num_threads);
+    for (compaction_step const & s : steps) {
+        if (s.m_spine) {
+            compact(s.m_spine);
+        } else {
+            partition & p = parts[s.m_partition];
+            {
+                unique_lock<mutex> lock(mut);
+                done_cv.wait(lock, [&]() { return done[s.m_partition]; });
+            }
+            std::vector<object_offset> & remap = remaps[p.m_worker];
+            remap.resize((p.m_begin + p.m_data.size()) / sizeof(void*));
+            merge(p, remap);
+            // release memory early
+            std::vector<char>().swap(p.m_data);
+        }
+    }
+    for (auto & t : threads)
+        t->join();
     *static_cast<object_offset *>(m_begin) = to_offset(o);
 }
 
@@ -388,17 +639,17 @@ inline object * compacted_region::fix_object_ptr(object * o) {
 
 inline void compacted_region::move(size_t d) {
     lean_assert(m_next < m_end);
+    m_next = static_cast<char*>(m_next) + align_size(d);
+}
+
+inline size_t compacted_region::align_size(size_t d) {
     size_t rem = d % sizeof(void*);
     if (rem != 0)
         d = d + sizeof(void*) - rem;
-    m_next = static_cast<char*>(m_next) + d;
-}
-
-inline void compacted_region::move(object * o) {
-    return move(lean_object_byte_size(o));
+    return d;
 }
 
-inline void compacted_region::fix_constructor(object * o) {
+inline size_t compacted_region::fix_constructor(object * o) {
     lean_assert(!lean_has_rc(o));
     object ** it  = lean_ctor_obj_cptr(o);
     object ** end = it + lean_ctor_num_objs(o);
@@ -406,42 +657,180 @@ inline void compacted_region::fix_constructor(object * o) {
         *it = fix_object_ptr(*it);
     }
     lean_assert(lean_object_byte_size(o) < 4192);
-    move(o);
+    return lean_object_byte_size(o);
 }
 
-inline void compacted_region::fix_array(object * o) {
+inline size_t compacted_region::fix_array(object * o) {
     object ** it  = lean_array_cptr(o);
     object ** end = it + lean_array_size(o);
     for (; it != end; it++) {
         *it = fix_object_ptr(*it);
     }
-    move(o);
+    return lean_object_byte_size(o);
 }
 
-inline void compacted_region::fix_thunk(object * o) {
+inline size_t compacted_region::fix_thunk(object * o) {
     lean_to_thunk(o)->m_value = fix_object_ptr(lean_to_thunk(o)->m_value);
-    move(sizeof(lean_thunk_object));
+    return sizeof(lean_thunk_object);
 }
 
-inline void compacted_region::fix_ref(object * o) {
+inline size_t compacted_region::fix_ref(object * o) {
     lean_to_ref(o)->m_value = fix_object_ptr(lean_to_ref(o)->m_value);
-    move(sizeof(lean_ref_object));
+    return sizeof(lean_ref_object);
 }
 
-inline void compacted_region::fix_task(object * o) {
+inline size_t compacted_region::fix_task(object * o) {
     lean_to_task(o)->m_value = fix_object_ptr(lean_to_task(o)->m_value);
-    move(sizeof(lean_task_object));
+    return sizeof(lean_task_object);
+}
+
+inline size_t compacted_region::mpz_size(object * o) {
+#ifdef LEAN_USE_GMP
+    return sizeof(mpz_object) + sizeof(mp_limb_t) * ::mpz_size(to_mpz(o)->m_value.m_val);
+#else
+    return sizeof(mpz_object) + sizeof(mpn_digit) * to_mpz(o)->m_value.m_size;
+#endif
 }
 
-void compacted_region::fix_mpz(object * o) {
+size_t compacted_region::fix_mpz(object * o) {
 #ifdef LEAN_USE_GMP
     __mpz_struct & m = to_mpz(o)->m_value.m_val[0];
     m._mp_d = reinterpret_cast<mp_limb_t *>(static_cast<char *>(m_begin) + reinterpret_cast<size_t>(m._mp_d) - reinterpret_cast<size_t>(m_base_addr));
-    move(sizeof(mpz_object) + sizeof(mp_limb_t) * mpz_size(to_mpz(o)->m_value.m_val));
 #else
     to_mpz(o)->m_value.m_digits = reinterpret_cast<mpn_digit*>(reinterpret_cast<char*>(o) + sizeof(mpz_object));
-    move(sizeof(mpz_object) + sizeof(mpn_digit) * to_mpz(o)->m_value.m_size);
 #endif
+    return mpz_size(o);
+}
+
+/* Relocate the object `o` and return its size. */
+inline size_t compacted_region::fix_object(object * o) {
+    uint8 tag = lean_ptr_tag(o);
+    if (tag <= LeanMaxCtorTag)
+        return fix_constructor(o);
+    switch (tag) {
+    case LeanClosure:         lean_unreachable();
+    case LeanArray:           return fix_array(o);
+    case LeanScalarArray:     return lean_sarray_byte_size(o);
+    case LeanString:          return lean_string_byte_size(o);
+    case LeanMPZ:             return fix_mpz(o);
+    case LeanThunk:           return fix_thunk(o);
+    case LeanRef:             return fix_ref(o);
+    case LeanTask:            return fix_task(o);
+    case LeanExternal:        lean_unreachable();
+    default:                  lean_unreachable();
+    }
+}
+
+void compacted_region::fix_range(char * begin, char * end) {
+    while (begin < end)
+        begin += align_size(fix_object(reinterpret_cast<object*>(begin)));
+}
+
+/*
+Parallel relocation
+
+Objects in a region have different sizes, so we cannot split it at arbitrary offsets, and finding the object
+boundaries by a sequential scan would be as expensive as the relocation itself. Instead, we use the fact that every
+reference points to the beginning of an object: we collect the (not yet relocated) references stored in the root
+object and in the arrays directly below it, which in .olean files are spread over the whole region, and pick
+chunks of at least `LEAN_RELOCATION_CHUNK_SIZE` bytes starting at them. The chunks are then relocated by the calling
+thread together with helper tasks spawned on the task manager.
+
+The calling thread does not wait for helper tasks that have not started yet: it relocates chunks itself until all
+of them have been claimed, and then only waits for the chunks claimed by running helpers. Thus relocation makes
+progress even if all task manager workers are busy (e.g., importing other modules in parallel).
+*/
+
+struct compacted_region::relocation {
+    compacted_region *   m_region;
+    std::vector<char *>  m_bounds;
+    atomic<size_t>       m_next_chunk{0};
+    atomic<size_t>       m_rc{1};
+    mutex                m_mutex;
+    condition_variable   m_done_cv;
+    size_t               m_num_done{0};
+
+    size_t num_chunks() const { return m_bounds.size() - 1; }
+
+    /* Relocate unclaimed chunks until there are none left. */
+    void run() {
+        while (true) {
+            size_t i = m_next_chunk++;
+            if (i >= num_chunks())
+                return;
+            m_region->fix_range(m_bounds[i], m_bounds[i+1]);
+            unique_lock<mutex> lock(m_mutex);
+            m_num_done++;
+            if (m_num_done == num_chunks())
+                m_done_cv.notify_all();
+        }
+    }
+
+    void dec_ref() {
+        if (--m_rc == 0)
+            delete this;
+    }
+};
+
+obj_res compacted_region::relocation_task_fn(obj_arg r, obj_arg) {
+    relocation * s = reinterpret_cast<relocation *>(lean_unbox_usize(r));
+    lean_dec(r);
+    s->run();
+    s->dec_ref();
+    return box(0);
+}
+
+/* Add the addresses of (a sample of) the objects referenced by the not yet relocated object `o` to `r`, descending into
+   arrays up to `depth` levels. */
+void compacted_region::collect_object_starts(object * o, unsigned depth, std::vector<char *> & r) {
+    object ** it;
+    object ** end;
+    if (lean_is_ctor(o)) {
+        it  = lean_ctor_obj_cptr(o);
+        end = it + lean_ctor_num_objs(o);
+    } else if (lean_ptr_tag(o) == LeanArray) {
+        it  = lean_array_cptr(o);
+        end = it + lean_array_size(o);
+    } else {
+        return;
+    }
+    size_t stride = std::max(static_cast<size_t>(1), static_cast<size_t>(end - it) / LEAN_RELOCATION_MAX_SAMPLES);
+    for (; it < end; it += stride) {
+        if (lean_is_scalar(*it))
+            continue;
+        object * c = fix_object_ptr(*it);
+        r.push_back(reinterpret_cast<char *>(c));
+        if (depth > 0 && lean_ptr_tag(c) == LeanArray)
+            collect_object_starts(c, depth - 1, r);
+    }
+}
+
+void compacted_region::fix_parallel(object * root, char * begin, char * end) {
+    std::vector<char *> starts;
+    collect_object_starts(root, 1, starts);
+    std::sort(starts.begin(), starts.end());
+    relocation * s = new relocation();
+    s->m_region = this;
+    s->m_bounds.push_back(begin);
+    for (char * p : starts) {
+        if (p >= s->m_bounds.back() + LEAN_RELOCATION_CHUNK_SIZE && p < end)
+            s->m_bounds.push_back(p);
+    }
+    s->m_bounds.push_back(end);
+
+    size_t num_helpers = std::min(static_cast<size_t>(hardware_concurrency()), s->num_chunks()) - 1;
+    for (size_t i = 0; i < num_helpers; i++) {
+        s->m_rc++;
+        object * c = lean_alloc_closure((void*)relocation_task_fn, 2, 1);
+        lean_closure_set(c, 0, lean_box_usize(reinterpret_cast<size_t>(s)));
+        lean_dec(lean_task_spawn_core(c, 0, /* keep_alive */ true));
+    }
+    s->run();
+    {
+        unique_lock<mutex> lock(s->m_mutex);
+        s->m_done_cv.wait(lock, [&]() { return s->m_num_done == s->num_chunks(); });
+    }
+    s->dec_ref();
 }
 
 object * compacted_region::read() {
@@ -457,26 +846,13 @@ object * compacted_region::read() {
     }
     lean_assert(!m_is_mmap);
 
-    while (m_next < m_end) {
-        object * curr = reinterpret_cast<object*>(m_next);
-        uint8 tag = lean_ptr_tag(curr);
-        if (tag <= LeanMaxCtorTag) {
-            fix_constructor(curr);
-        } else {
-            switch (tag) {
-            case LeanClosure:         lean_unreachable();
-            case LeanArray:           fix_array(curr); break;
-            case LeanScalarArray:     move(lean_sarray_byte_size(curr)); break;
-            case LeanString:          move(lean_string_byte_size(curr)); break;
-            case LeanMPZ:             fix_mpz(curr); break;
-            case LeanThunk:           fix_thunk(curr); break;
-            case LeanRef:             fix_ref(curr); break;
-            case LeanTask:            fix_task(curr); break;
-            case LeanExternal:        lean_unreachable();
-            default:                  lean_unreachable();
-            }
-        }
-    }
+    char * begin = static_cast<char*>(m_next);
+    char * end   = static_cast<char*>(m_end);
+    if (static_cast<size_t>(end - begin) >= LEAN_PARALLEL_RELOCATION_MIN_SIZE && hardware_concurrency() > 1 && !lean_is_scalar(root))
+        fix_parallel(root, begin, end);
+    else
+        fix_range(begin, end);
+    m_next = m_end;
     return root;
 }
 
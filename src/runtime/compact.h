@@ -8,6 +8,7 @@ Author: Leonardo de Moura
 #include <functional>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 #include "runtime/object.h"
 
 namespace lean {
@@ -15,12 +16,16 @@ typedef lean_object * object_offset;
 
 class LEAN_EXPORT object_compactor {
     struct max_sharing_table;
+    struct compaction_step;
+    struct partition;
     friend struct max_sharing_hash;
     friend struct max_sharing_eq;
     std::unordered_map<object*, object_offset, std::hash<object*>, std::equal_to<object*>> m_obj_table;
     std::unique_ptr<max_sharing_table> m_max_sharing_table;
     std::vector<object*> m_todo;
     std::vector<object_offset> m_tmp;
+    // `mpz` objects are not subject to max sharing, so we log them to preserve their identity in `merge`
+    std::vector<std::pair<size_t, object*>> m_mpz_log;
     // On-disk base address used for `mmap`ing compacted regions without relocations
     // References within the compacted region are rewritten by subtracting `m_begin` and adding `m_base_addr`
     // In the simplest case `base_addr == nullptr`, we get region-relative pointers
@@ -29,7 +34,9 @@ class LEAN_EXPORT object_compactor {
     void * m_end;
     void * m_capacity;
     size_t capacity() const { return static_cast<char*>(m_capacity) - static_cast<char*>(m_begin); }
+    object_offset get_offset(object * new_o) const;
     void save(object * o, object * new_o);
+    object * max_share(object * new_o, size_t new_o_sz);
     void save_max_sharing(object * o, object * new_o, size_t new_o_sz);
     void * alloc(size_t sz);
     object_offset to_offset(object * o);
@@ -43,6 +50,10 @@ class LEAN_EXPORT object_compactor {
     bool insert_task(object * o);
     bool insert_ref(object * o);
     void insert_mpz(object * o);
+    void compact(object * o);
+    void plan(object * o, unsigned depth, unsigned num_threads, std::vector<compaction_step> & steps,
+              std::vector<partition> & parts, std::unordered_set<object *> & spines);
+    void merge(partition const & p, std::vector<object_offset> & remap);
 public:
     object_compactor(void * base_addr = nullptr);
     object_compactor(object_compactor const &) = delete;
@@ -51,6 +62,8 @@ public:
     object_compactor operator=(object_compactor const &) = delete;
     object_compactor operator=(object_compactor &&) = delete;
     void operator()(object * o);
+    /* Compact `o` using `num_threads` threads. The result is byte-identical to `operator()(o)`. */
+    void operator()(object * o, unsigned num_threads);
     size_t size() const { return static_cast<char*>(m_end) - static_cast<char*>(m_begin); }
     void const * data() const { return m_begin; }
 };
@@ -64,14 +77,21 @@ class LEAN_EXPORT compacted_region {
     void * m_next;
     void * m_end;
     void move(size_t d);
-    void move(object * o);
+    static size_t align_size(size_t d);
     object * fix_object_ptr(object * o);
-    void fix_constructor(object * o);
-    void fix_array(object * o);
-    void fix_thunk(object * o);
-    void fix_ref(object * o);
-    void fix_task(object * o);
-    void fix_mpz(object * o);
+    size_t fix_constructor(object * o);
+    size_t fix_array(object * o);
+    size_t fix_thunk(object * o);
+    size_t fix_ref(object * o);
+    size_t fix_task(object * o);
+    static size_t mpz_size(object * o);
+    size_t fix_mpz(object * o);
+    size_t fix_object(object * o);
+    void fix_range(char * begin, char * end);
+    struct relocation;
+    static lean_object * relocation_task_fn(lean_object * r, lean_object *);
+    void collect_object_starts(object * o, unsigned depth, std::vector<char *> & r);
+    void fix_parallel(object * root, char * begin, char * end);
 public:
     /* Creates a compacted object region using the given region in memory.
        This object takes ownership of the region. */
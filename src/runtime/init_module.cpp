@@ -5,6 +5,7 @@ Released under Apache 2.0 license as described in the file LICENSE.
 Author: Leonardo de Moura
 */
 #include "runtime/alloc.h"
+#include "runtime/allocprof.h"
 #include "runtime/debug.h"
 #include "runtime/thread.h"
 #include "runtime/object.h"
@@ -17,6 +18,7 @@ Author: Leonardo de Moura
 namespace lean {
 extern "C" LEAN_EXPORT void lean_initialize_runtime_module() {
     initialize_alloc();
+    initialize_allocprof();
     initialize_debug();
     initialize_object();
     initialize_io();
@@ -36,6 +38,7 @@ void finalize_runtime_module() {
     finalize_io();
     finalize_object();
     finalize_debug();
+    finalize_allocprof();
     finalize_alloc();
 }
 }
@@ -485,6 +485,80 @@ extern "C" LEAN_EXPORT obj_res lean_io_prim_handle_write(b_obj_arg h, b_obj_arg
     }
 }
 
+#ifndef LEAN_LINE_BUFFER_MAX_CAPACITY
+#define LEAN_LINE_BUFFER_MAX_CAPACITY 64*1024
+#endif
+
+/* Buffer used to read lines in `lean_io_prim_handle_get_line` and `lean_io_prim_handle_lines`.
+   It is reused to avoid allocating a buffer per line. */
+struct line_buffer {
+    char * m_data = nullptr;
+    size_t m_capacity = 0;
+    ~line_buffer() { free(m_data); }
+    /* Release the buffer after reading a very long line, we do not want to keep it alive for the
+       rest of the thread. */
+    void shrink() {
+        if (m_capacity > LEAN_LINE_BUFFER_MAX_CAPACITY) {
+            free(m_data);
+            m_data = nullptr;
+            m_capacity = 0;
+        }
+    }
+};
+
+MK_THREAD_LOCAL_GET_DEF(line_buffer, get_line_buffer);
+
+/* Read the next line of `fp`, including the line break, into `get_line_buffer()`. `sz` is set to the number of
+   bytes read, which is zero at the end of the file. Return `false` if an error occurred.
+
+   We rely on `getline` to scan the `FILE` buffer for the line break, instead of copying the line in small chunks
+   using `fgets`. */
+static bool read_line(FILE * fp, char * & line, size_t & sz) {
+    line_buffer & buf = get_line_buffer();
+#ifdef LEAN_WINDOWS
+    // `getline` is not available
+    sz = 0;
+    int c;
+    while ((c = std::getc(fp)) != EOF) {
+        if (sz == buf.m_capacity) {
+            size_t new_capacity = buf.m_capacity == 0 ? 128 : 2 * buf.m_capacity;
+            char * new_data = static_cast<char *>(realloc(buf.m_data, new_capacity));
+            if (!new_data) {
+                errno = ENOMEM;
+                return false;
+            }
+            buf.m_data = new_data;
+            buf.m_capacity = new_capacity;
+        }
+        buf.m_data[sz++] = static_cast<char>(c);
+        if (c == '\n')
+            break;
+    }
+    if (c == EOF && !std::feof(fp))
+        return false;
+#else
+    ssize_t n = getline(&buf.m_data, &buf.m_capacity, fp);
+    if (n == -1) {
+        if (!std::feof(fp))
+            return false;
+        n = 0;
+    }
+    sz = n;
+#endif
+    line = buf.m_data;
+    // EOF does not close the stream, further reads may return more data
+    if (std::feof(fp))
+        clearerr(fp);
+    return true;
+}
+
+/* Return the length of `line` truncated at the first `'\0'` character. */
+static size_t truncate_at_nul(char const * line, size_t sz) {
+    if (char const * nul = static_cast<char const *>(memchr(line, 0, sz)))
+        return nul - line;
+    return sz;
+}
+
 /*
   Handle.getLine : (@& Handle) → IO Unit
   The line returned by `lean_io_prim_handle_get_line`
@@ -492,29 +566,47 @@ extern "C" LEAN_EXPORT obj_res lean_io_prim_handle_write(b_obj_arg h, b_obj_arg
   rest of the line is discarded. */
 extern "C" LEAN_EXPORT obj_res lean_io_prim_handle_get_line(b_obj_arg h, obj_arg /* w */) {
     FILE * fp = io_get_handle(h);
-    const int buf_sz = 64;
-    char buf_str[buf_sz]; // NOLINT
-    std::string result;
-    bool first = true;
+    char * line;
+    size_t sz;
+    if (!read_line(fp, line, sz)) {
+        int errnum = errno;
+        get_line_buffer().shrink();
+        return io_result_mk_error(decode_io_error(errnum, nullptr));
+    }
+    object * r = lean_mk_string_from_bytes(line, truncate_at_nul(line, sz));
+    get_line_buffer().shrink();
+    return io_result_mk_ok(r);
+}
+
+/*
+  Handle.lines : (@& Handle) → IO (Array String)
+  Read the remaining lines of the handle, without the line breaks.
+  As in `lean_io_prim_handle_get_line`, each line is truncated
+  at the first '\0' character. */
+extern "C" LEAN_EXPORT obj_res lean_io_prim_handle_lines(b_obj_arg h, obj_arg /* w */) {
+    FILE * fp = io_get_handle(h);
+    object * r = lean_mk_empty_array();
     while (true) {
-        char * out = std::fgets(buf_str, buf_sz, fp);
-        if (out != nullptr) {
-            if (strlen(buf_str) < buf_sz-1 || buf_str[buf_sz-2] == '\n') {
-                if (first) {
-                    return io_result_mk_ok(mk_string(out));
-                } else {
-                    result.append(out);
-                    return io_result_mk_ok(mk_string(result));
-                }
-            }
-            result.append(out);
-        } else if (std::feof(fp)) {
-            clearerr(fp);
-            return io_result_mk_ok(mk_string(result));
-        } else {
-            return io_result_mk_error(decode_io_error(errno, nullptr));
+        char * line;
+        size_t sz;
+        if (!read_line(fp, line, sz)) {
+            int errnum = errno;
+            dec_ref(r);
+            get_line_buffer().shrink();
+            return io_result_mk_error(decode_io_error(errnum, nullptr));
+        }
+        if (sz == 0) {
+            get_line_buffer().shrink();
+            return io_result_mk_ok(r);
         }
-        first = false;
+        if (line[sz - 1] == '\n') {
+            sz--;
+#ifdef LEAN_WINDOWS
+            if (sz > 0 && line[sz - 1] == '\r')
+                sz--;
+#endif
+        }
+        r = lean_array_push(r, lean_mk_string_from_bytes(line, truncate_at_nul(line, sz)));
     }
 }
 
@@ -528,6 +620,177 @@ extern "C" LEAN_EXPORT obj_res lean_io_prim_handle_put_str(b_obj_arg h, b_obj_ar
     }
 }
 
+static lean_external_class * g_io_mapped_file_external_class = nullptr;
+
+/* Contents of a file opened using `MappedFile.mk`. If the file could not be mapped into memory (e.g., it is empty
+   or not a regular file, or `LEAN_MMAP` is not set), it is read into a `malloc`ed buffer, and `m_is_mmap` is false. */
+struct mapped_file {
+    char *  m_data;
+    size_t  m_size;
+    bool    m_is_mmap;
+};
+
+static void io_mapped_file_finalizer(void * p) {
+    mapped_file * m = static_cast<mapped_file *>(p);
+    if (m->m_is_mmap) {
+#ifdef LEAN_WINDOWS
+        UnmapViewOfFile(m->m_data);
+#else
+        munmap(m->m_data, m->m_size);
+#endif
+    } else {
+        free(m->m_data);
+    }
+    delete m;
+}
+
+static void io_mapped_file_foreach(void * /* mod */, b_obj_arg /* fn */) {
+}
+
+static mapped_file * io_get_mapped_file(b_obj_arg m) {
+    return static_cast<mapped_file *>(lean_get_external_data(m));
+}
+
+#ifndef LEAN_WINDOWS
+/* Read the remaining contents of `fd` into a `malloc`ed buffer. `size_hint` is the expected size of the contents. */
+static bool read_fd_to_end(int fd, size_t size_hint, mapped_file & m) {
+    // The extra byte allows us to detect the end of the file without growing the buffer.
+    size_t capacity = size_hint + 1;
+    char * data = static_cast<char *>(malloc(capacity));
+    if (!data) {
+        errno = ENOMEM;
+        return false;
+    }
+    size_t size = 0;
+    while (true) {
+        if (size == capacity) {
+            capacity *= 2;
+            char * new_data = static_cast<char *>(realloc(data, capacity));
+            if (!new_data) {
+                free(data);
+                errno = ENOMEM;
+                return false;
+            }
+            data = new_data;
+        }
+        ssize_t n = read(fd, data + size, capacity - size);
+        if (n == 0) {
+            break;
+        } else if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            int errnum = errno;
+            free(data);
+            errno = errnum;
+            return false;
+        }
+        size += n;
+    }
+    m.m_data = data;
+    m.m_size = size;
+    m.m_is_mmap = false;
+    return true;
+}
+#endif
+
+/* MappedFile.mk (fname : @& FilePath) : IO MappedFile */
+extern "C" LEAN_EXPORT obj_res lean_io_prim_mapped_file_mk(b_obj_arg fname, obj_arg /* w */) {
+    mapped_file m{nullptr, 0, false};
+#ifdef LEAN_WINDOWS
+    // `FILE_SHARE_DELETE` is necessary to allow the file to (be marked to) be deleted while in use
+    HANDLE h = CreateFile(lean_string_cstr(fname), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (h == INVALID_HANDLE_VALUE) {
+        return io_result_mk_error((sstream() << "failed to open '" << lean_string_cstr(fname) << "': " << GetLastError()).str());
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(h, &size)) {
+        DWORD err = GetLastError();
+        CloseHandle(h);
+        return io_result_mk_error((sstream() << "failed to open '" << lean_string_cstr(fname) << "': " << err).str());
+    }
+    if (size.QuadPart > 0) {
+        // The view keeps the mapping alive after the handles are closed.
+        HANDLE h_map = CreateFileMapping(h, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (h_map != NULL) {
+            m.m_data = static_cast<char *>(MapViewOfFile(h_map, FILE_MAP_READ, 0, 0, 0));
+            CloseHandle(h_map);
+        }
+        if (m.m_data == nullptr) {
+            DWORD err = GetLastError();
+            CloseHandle(h);
+            return io_result_mk_error((sstream() << "failed to map '" << lean_string_cstr(fname) << "': " << err).str());
+        }
+        m.m_size = static_cast<size_t>(size.QuadPart);
+        m.m_is_mmap = true;
+    }
+    CloseHandle(h);
+#else
+    int fd = open(lean_string_cstr(fname), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return io_result_mk_error(decode_io_error(errno, fname));
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        int errnum = errno;
+        close(fd);
+        return io_result_mk_error(decode_io_error(errnum, fname));
+    }
+    bool is_reg = S_ISREG(st.st_mode);
+#ifdef LEAN_MMAP
+    if (is_reg && st.st_size > 0) {
+        void * data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            m.m_data = static_cast<char *>(data);
+            m.m_size = st.st_size;
+            m.m_is_mmap = true;
+        }
+    }
+#endif
+    if (!m.m_is_mmap && !read_fd_to_end(fd, is_reg ? st.st_size : 4096, m)) {
+        int errnum = errno;
+        close(fd);
+        return io_result_mk_error(decode_io_error(errnum, fname));
+    }
+    close(fd);
+#endif
+    return io_result_mk_ok(lean_alloc_external(g_io_mapped_file_external_class, new mapped_file(m)));
+}
+
+/* MappedFile.size : (@& MappedFile) → Nat */
+extern "C" LEAN_EXPORT obj_res lean_io_mapped_file_size(b_obj_arg m) {
+    return lean_usize_to_nat(io_get_mapped_file(m)->m_size);
+}
+
+/* MappedFile.uget : (m : @& MappedFile) → (i : USize) → i.toNat < m.size → UInt8 */
+extern "C" LEAN_EXPORT uint8 lean_io_mapped_file_uget(b_obj_arg m, usize i) {
+    mapped_file * f = io_get_mapped_file(m);
+    lean_assert(i < f->m_size);
+    return f->m_data[i];
+}
+
+/* MappedFile.get! : (@& MappedFile) → (@& Nat) → UInt8 */
+extern "C" LEAN_EXPORT uint8 lean_io_mapped_file_get(b_obj_arg m, b_obj_arg i) {
+    mapped_file * f = io_get_mapped_file(m);
+    if (lean_is_scalar(i) && lean_unbox(i) < f->m_size) {
+        return f->m_data[lean_unbox(i)];
+    } else {
+        lean_panic_fn(lean_box(0), lean_mk_ascii_string_unchecked("Error: index out of bounds at `MappedFile.get!`"));
+        return 0;
+    }
+}
+
+/* MappedFile.extract : (@& MappedFile) → (start stop : @& Nat) → ByteArray */
+extern "C" LEAN_EXPORT obj_res lean_io_mapped_file_extract(b_obj_arg m, b_obj_arg start, b_obj_arg stop) {
+    mapped_file * f = io_get_mapped_file(m);
+    size_t b = lean_is_scalar(start) ? std::min<size_t>(lean_unbox(start), f->m_size) : f->m_size;
+    size_t e = lean_is_scalar(stop) ? std::min<size_t>(lean_unbox(stop), f->m_size) : f->m_size;
+    size_t n = e > b ? e - b : 0;
+    obj_res r = lean_alloc_sarray(1, n, n);
+    if (n > 0)
+        memcpy(lean_sarray_cptr(r), f->m_data + b, n);
+    return r;
+}
+
 /* monoMsNow : BaseIO Nat */
 extern "C" LEAN_EXPORT obj_res lean_io_mono_ms_now(obj_arg /* w */) {
     static_assert(sizeof(std::chrono::milliseconds::rep) <= sizeof(uint64), "size of std::chrono::nanoseconds::rep may not exceed 64");
@@ -634,6 +897,17 @@ extern "C" LEAN_EXPORT obj_res lean_io_allocprof(b_obj_arg msg, obj_arg fn, obj_
     return res;
 }
 
+/* setAllocSampling (sampleRate : UInt32) (backtraces : Bool) : BaseIO Unit */
+extern "C" LEAN_EXPORT obj_res lean_io_set_alloc_sampling(uint32 sample_rate, uint8 backtraces, obj_arg /* w */) {
+    set_alloc_sampling(sample_rate, backtraces);
+    return io_result_mk_ok(box(0));
+}
+
+/* getAllocSamples : BaseIO String */
+extern "C" LEAN_EXPORT obj_res lean_io_get_alloc_samples(obj_arg /* w */) {
+    return io_result_mk_ok(mk_string(alloc_sampler_to_json()));
+}
+
 /* getNumHeartbeats : BaseIO Nat */
 extern "C" LEAN_EXPORT obj_res lean_io_get_num_heartbeats(obj_arg /* w */) {
     return io_result_mk_ok(lean_uint64_to_nat(get_num_heartbeats()));
@@ -645,6 +919,12 @@ extern "C" LEAN_EXPORT obj_res lean_io_add_heartbeats(int64_t count, obj_arg /*
     return io_result_mk_ok(box(0));
 }
 
+/* trimHeap : BaseIO Unit */
+extern "C" LEAN_EXPORT obj_res lean_io_trim_heap(obj_arg /* w */) {
+    trim_heaps();
+    return io_result_mk_ok(box(0));
+}
+
 extern "C" LEAN_EXPORT obj_res lean_io_getenv(b_obj_arg env_var, obj_arg) {
 #if defined(LEAN_EMSCRIPTEN)
     // HACK(WN): getenv doesn't seem to work in Emscripten even though it should
@@ -1095,6 +1375,7 @@ void initialize_io() {
     g_io_error_nullptr_read = lean_mk_io_user_error(mk_ascii_string_unchecked("null reference read"));
     mark_persistent(g_io_error_nullptr_read);
     g_io_handle_external_class = lean_register_external_class(io_handle_finalizer, io_handle_foreach);
+    g_io_mapped_file_external_class = lean_register_external_class(io_mapped_file_finalizer, io_mapped_file_foreach);
 #if defined(LEAN_WINDOWS)
     _setmode(_fileno(stdout), _O_BINARY);
     _setmode(_fileno(stderr), _O_BINARY);
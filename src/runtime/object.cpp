@@ -43,6 +43,10 @@ Author: Leonardo de Moura
 
 // see `Task.Priority.max`
 #define LEAN_MAX_PRIO 8
+// maximal number of freed objects per size kept by the task cache of each thread
+#define LEAN_TASK_CACHE_SIZE 1024
+// the task cache only stores objects of at most `LEAN_TASK_CACHE_SLOTS * LEAN_OBJECT_SIZE_DELTA` bytes
+#define LEAN_TASK_CACHE_SLOTS 8
 
 namespace lean {
 
@@ -234,7 +238,7 @@ extern "C" LEAN_EXPORT lean_object * lean_alloc_object(size_t sz) {
      }
 #endif
 #ifdef LEAN_SMALL_ALLOCATOR
-    return (lean_object*)alloc(sz);
+    return (lean_object*)alloc_object(sz);
 #else
     void * r = malloc(sz);
     if (r == nullptr) lean_internal_panic_out_of_memory();
@@ -316,20 +320,127 @@ extern "C" LEAN_EXPORT void lean_dec_ref_cold(lean_object * o) {
 }
 
 
+// =======================================
+// Task cache
+
+/* Thread-local cache of freed task objects, task records and the closures created by `Task.map` and `Task.bind`.
+   A task is usually allocated by the thread spawning it but freed by the worker that finished it, which would send
+   the memory back to the allocating thread through `heap::export_objs`. Keeping it on the freeing thread instead
+   makes the following tasks spawned from that thread (e.g., task chains created by workers) cheap to allocate. */
+struct task_cache {
+    void *   m_free[LEAN_TASK_CACHE_SLOTS];
+    unsigned m_num_free[LEAN_TASK_CACHE_SLOTS];
+    bool     m_finalizer_registered;
+};
+
+LEAN_THREAD_VALUE(task_cache, g_task_cache, {});
+
+#ifdef LEAN_RUNTIME_STATS
+static atomic<uint64> g_num_task_cache_hits(0);
+static atomic<uint64> g_num_task_cache_misses(0);
+static atomic<uint64> g_num_task_cache_frees(0);
+static atomic<uint64> g_num_task_cache_overflows(0);
+struct task_cache_stats {
+    ~task_cache_stats() {
+        std::cerr << "num. task cache hits:      " << g_num_task_cache_hits << "\n";
+        std::cerr << "num. task cache misses:    " << g_num_task_cache_misses << "\n";
+        std::cerr << "num. task cache frees:     " << g_num_task_cache_frees << "\n";
+        std::cerr << "num. task cache overflows: " << g_num_task_cache_overflows << "\n";
+    }
+};
+static task_cache_stats g_task_cache_stats;
+#endif
+
+static inline unsigned get_task_cache_slot(unsigned sz) {
+    unsigned slot = lean_align(sz, LEAN_OBJECT_SIZE_DELTA) / LEAN_OBJECT_SIZE_DELTA - 1;
+    lean_assert(slot < LEAN_TASK_CACHE_SLOTS);
+    return slot;
+}
+
+static void finalize_task_cache(void *) {
+    task_cache & c = g_task_cache;
+    for (unsigned slot = 0; slot < LEAN_TASK_CACHE_SLOTS; slot++) {
+        void * o = c.m_free[slot];
+        while (o) {
+            void * next = *static_cast<void**>(o);
+            lean_free_small_object(static_cast<lean_object*>(o));
+            o = next;
+        }
+        c.m_free[slot]     = nullptr;
+        c.m_num_free[slot] = 0;
+    }
+    c.m_finalizer_registered = false;
+}
+
+static void * alloc_task_cached(unsigned sz) {
+    task_cache & c = g_task_cache;
+    unsigned slot  = get_task_cache_slot(sz);
+    if (void * o = c.m_free[slot]) {
+        LEAN_RUNTIME_STAT_CODE(g_num_task_cache_hits++);
+        c.m_free[slot] = *static_cast<void**>(o);
+        c.m_num_free[slot]--;
+        /* Remark: we must produce the same number of heartbeats as `lean_alloc_small_object`,
+           otherwise deterministic timeouts would depend on the state of the cache. */
+        add_heartbeats(1);
+        return o;
+    }
+    LEAN_RUNTIME_STAT_CODE(g_num_task_cache_misses++);
+    void * o = lean_alloc_small_object(sz);
+    /* Remark: blocks in the cache are freed and reused without going through the allocator, and some of them
+       (e.g., `lean_task_imp`) are not Lean objects, so we exclude them from the allocation profile. */
+    exclude_from_alloc_sampling(o);
+    return o;
+}
+
+static void free_task_cached(void * o, unsigned sz) {
+    task_cache & c = g_task_cache;
+    unsigned slot  = get_task_cache_slot(sz);
+    if (c.m_num_free[slot] >= LEAN_TASK_CACHE_SIZE) {
+        LEAN_RUNTIME_STAT_CODE(g_num_task_cache_overflows++);
+        lean_free_small_object(static_cast<lean_object*>(o));
+        return;
+    }
+    if (!c.m_finalizer_registered) {
+        /* Remark: thread finalizers are executed in reverse registration order,
+           so the cache is flushed before the thread heap is finalized. */
+        register_thread_finalizer(finalize_task_cache, nullptr);
+        c.m_finalizer_registered = true;
+    }
+    LEAN_RUNTIME_STAT_CODE(g_num_task_cache_frees++);
+    *static_cast<void**>(o) = c.m_free[slot];
+    c.m_free[slot] = o;
+    c.m_num_free[slot]++;
+}
+
 // =======================================
 // Closures
 
 typedef object * (*lean_cfun2)(object *, object *); // NOLINT
 typedef object * (*lean_cfun3)(object *, object *, object *); // NOLINT
 
+static inline unsigned task_closure_size(unsigned num_fixed) {
+    return sizeof(lean_closure_object) + sizeof(void*)*num_fixed;
+}
+
+/* Closures used to implement `Task.map` and `Task.bind`, they are allocated using the task cache and
+   returned to it by `apply_task_closure`. */
+static obj_res alloc_task_closure(void * fn, unsigned arity, unsigned num_fixed) {
+    lean_closure_object * o = (lean_closure_object*)alloc_task_cached(task_closure_size(num_fixed));
+    lean_set_st_header((lean_object*)o, LeanClosure, 0);
+    o->m_fun       = fn;
+    o->m_arity     = arity;
+    o->m_num_fixed = num_fixed;
+    return (lean_object*)o;
+}
+
 static obj_res mk_closure_2_1(lean_cfun2 fn, obj_arg a) {
-    object * c = lean_alloc_closure((void*)fn, 2, 1);
+    object * c = alloc_task_closure((void*)fn, 2, 1);
     lean_closure_set(c, 0, a);
     return c;
 }
 
 static obj_res mk_closure_3_2(lean_cfun3 fn, obj_arg a1, obj_arg a2) {
-    object * c = lean_alloc_closure((void*)fn, 3, 2);
+    object * c = alloc_task_closure((void*)fn, 3, 2);
     lean_closure_set(c, 0, a1);
     lean_closure_set(c, 1, a2);
     return c;
@@ -366,6 +477,9 @@ extern "C" LEAN_EXPORT lean_obj_res lean_array_set_panic(lean_obj_arg a, lean_ob
 // =======================================
 // Thunks
 
+static void wait_for_thunk(lean_thunk_object * t);
+static void unpark_thunk_waiters(lean_thunk_object * t);
+
 extern "C" LEAN_EXPORT b_obj_res lean_thunk_get_core(b_obj_arg t) {
     object * c = lean_to_thunk(t)->m_closure.exchange(nullptr);
     if (c != nullptr) {
@@ -379,16 +493,21 @@ extern "C" LEAN_EXPORT b_obj_res lean_thunk_get_core(b_obj_arg t) {
         object * r = lean_apply_1(c, lean_box(0));
         lean_assert(r != nullptr); /* Closure must return a valid lean object */
         lean_assert(lean_to_thunk(t)->m_value == nullptr);
-        mark_mt(r);
-        lean_to_thunk(t)->m_value = r;
+        /* If `t` is not shared with other threads, `r` does not need to be marked now. If `t` is marked later,
+           `lean_mark_mt` also marks its value. */
+        if (lean_is_st(t)) {
+            lean_to_thunk(t)->m_value = r;
+        } else {
+            mark_mt(r);
+            lean_to_thunk(t)->m_value = r;
+            unpark_thunk_waiters(lean_to_thunk(t));
+        }
         return r;
     } else {
         lean_assert(c == nullptr);
-        /* There is another thread executing the closure. We keep waiting for the m_value to be
-           set by another thread. */
-        while (!lean_to_thunk(t)->m_value) {
-            this_thread::yield();
-        }
+        /* There is another thread executing the closure. We wait for it to set `m_value`. */
+        if (!lean_to_thunk(t)->m_value)
+            wait_for_thunk(lean_to_thunk(t));
         return lean_to_thunk(t)->m_value;
     }
 }
@@ -553,7 +672,7 @@ extern "C" LEAN_EXPORT void lean_mark_mt(object * o) {
 LEAN_THREAD_PTR(lean_task_object, g_current_task_object);
 
 static lean_task_imp * alloc_task_imp(obj_arg c, unsigned prio, bool keep_alive) {
-    lean_task_imp * imp = (lean_task_imp*)lean_alloc_small_object(sizeof(lean_task_imp));
+    lean_task_imp * imp = (lean_task_imp*)alloc_task_cached(sizeof(lean_task_imp));
     imp->m_closure     = c;
     imp->m_head_dep    = nullptr;
     imp->m_next_dep    = nullptr;
@@ -565,18 +684,172 @@ static lean_task_imp * alloc_task_imp(obj_arg c, unsigned prio, bool keep_alive)
 }
 
 static void free_task_imp(lean_task_imp * imp) {
-    lean_free_small_object((lean_object*)imp);
+    free_task_cached(imp, sizeof(lean_task_imp));
 }
 
 static void free_task(lean_task_object * t) {
     if (t->m_imp) free_task_imp(t->m_imp);
-    lean_free_small_object((lean_object*)t);
+    free_task_cached(t, sizeof(lean_task_object));
+}
+
+static obj_res task_map_fn(obj_arg f, obj_arg t, obj_arg);
+static obj_res task_bind_fn1(obj_arg x, obj_arg f, obj_arg);
+static obj_res task_bind_fn2(obj_arg t, obj_arg);
+
+/* Execute the closure of a task. Closures created by `Task.map` and `Task.bind` are invoked directly and their
+   memory is returned to the task cache. As in `lean_apply_1` for an exclusive closure, the ownership of the fixed
+   arguments is transferred to the function. */
+static obj_res apply_task_closure(obj_arg c) {
+    // Remark: task closures are marked as multi-threaded by `alloc_task`, `-1` is the exclusive reference count
+    if (c->m_rc == -1) {
+        void * fn = lean_closure_fun(c);
+        if (fn == (void*)task_map_fn || fn == (void*)task_bind_fn1) {
+            object * a1 = lean_closure_get(c, 0);
+            object * a2 = lean_closure_get(c, 1);
+            free_task_cached(c, task_closure_size(2));
+            return reinterpret_cast<lean_cfun3>(fn)(a1, a2, box(0));
+        } else if (fn == (void*)task_bind_fn2) {
+            object * a = lean_closure_get(c, 0);
+            free_task_cached(c, task_closure_size(1));
+            return task_bind_fn2(a, box(0));
+        }
+    }
+    return lean_apply_1(c, box(0));
 }
 
 struct scoped_current_task_object : flet<lean_task_object *> {
     scoped_current_task_object(lean_task_object * t):flet(g_current_task_object, t) {}
 };
 
+/* Parker used by a thread waiting for one or more tasks to finish. */
+struct task_parker {
+    mutex                                         m_mutex;
+    condition_variable                            m_cv;
+    bool                                          m_unparked{false};
+
+    void park() {
+        unique_lock<mutex> lock(m_mutex);
+        while (!m_unparked)
+            m_cv.wait(lock);
+        m_unparked = false;
+    }
+
+    void unpark() {
+        lock_guard<mutex> lock(m_mutex);
+        m_unparked = true;
+        m_cv.notify_one();
+    }
+};
+
+/* Parking lot for threads blocked in `lean_task_get` and `IO.waitAny`, and for threads forcing a thunk that is
+   being evaluated by another thread. A waiter registers its parker in the bucket of every task (thunk) it is waiting
+   for, and finishing a task (thunk) only wakes up the waiters registered for it.
+
+   Remark: the waiter increments `m_num_waiters` before re-checking `m_value`, and the task manager stores `m_value`
+   before checking `m_num_waiters`, so that either the waiter observes the value or the task manager observes the
+   waiter. In particular, finishing a task nobody is waiting for does not take any lock. */
+template<typename T>
+class parking_lot {
+    static constexpr unsigned num_buckets = 256;
+    struct bucket {
+        mutex                                     m_mutex;
+        atomic<unsigned>                          m_num_waiters{0};
+        std::vector<std::pair<T *, task_parker *>> m_waiters;
+    };
+    bucket m_buckets[num_buckets];
+
+    bucket & get_bucket(T * t) {
+        return m_buckets[hash_ptr(t) % num_buckets];
+    }
+
+    static unsigned hash_ptr(T * t) {
+        size_t h = reinterpret_cast<size_t>(t) / sizeof(T);
+        return static_cast<unsigned>(h ^ (h >> 16));
+    }
+
+public:
+    void add_waiter(T * t, task_parker * p) {
+        bucket & b = get_bucket(t);
+        lock_guard<mutex> lock(b.m_mutex);
+        b.m_waiters.emplace_back(t, p);
+        b.m_num_waiters++;
+    }
+
+    void remove_waiter(T * t, task_parker * p) {
+        bucket & b = get_bucket(t);
+        lock_guard<mutex> lock(b.m_mutex);
+        auto it = std::find(b.m_waiters.begin(), b.m_waiters.end(), std::make_pair(t, p));
+        lean_assert(it != b.m_waiters.end());
+        *it = b.m_waiters.back();
+        b.m_waiters.pop_back();
+        b.m_num_waiters--;
+    }
+
+    /* Wake up all threads waiting for `t`. Remark: `t` must not be dereferenced here, it may have already been
+       freed by `deactivate_task` after `m_value` was set. */
+    void unpark_all(T * t) {
+        bucket & b = get_bucket(t);
+        if (b.m_num_waiters == 0)
+            return;
+        lock_guard<mutex> lock(b.m_mutex);
+        for (auto const & w : b.m_waiters) {
+            if (w.first == t)
+                w.second->unpark();
+        }
+    }
+};
+
+typedef parking_lot<lean_task_object> task_parking_lot;
+
+#ifndef LEAN_THUNK_SPIN_ITERATIONS
+#define LEAN_THUNK_SPIN_ITERATIONS 16
+#endif
+
+static parking_lot<lean_thunk_object> g_thunk_parking_lot;
+
+#ifdef LEAN_RUNTIME_STATS
+static atomic<uint64> g_num_contended_thunks(0);
+static atomic<uint64> g_num_parked_thunk_waits(0);
+struct thunk_stats {
+    ~thunk_stats() {
+        std::cerr << "num. contended thunks:     " << g_num_contended_thunks << "\n";
+        std::cerr << "num. parked thunk waits:   " << g_num_parked_thunk_waits << "\n";
+    }
+};
+static thunk_stats g_thunk_stats;
+#endif
+
+/* Wait for the thread evaluating the closure of `t` to set `m_value`. Most thunks are cheap, so we yield a few
+   times before parking. */
+static void wait_for_thunk(lean_thunk_object * t) {
+    LEAN_RUNTIME_STAT_CODE(g_num_contended_thunks++);
+    for (unsigned i = 0; i < LEAN_THUNK_SPIN_ITERATIONS; i++) {
+        if (t->m_value)
+            return;
+        this_thread::yield();
+    }
+    LEAN_RUNTIME_STAT_CODE(g_num_parked_thunk_waits++);
+    task_parker p;
+    g_thunk_parking_lot.add_waiter(t, &p);
+    while (!t->m_value)
+        p.park();
+    g_thunk_parking_lot.remove_waiter(t, &p);
+}
+
+static void unpark_thunk_waiters(lean_thunk_object * t) {
+    g_thunk_parking_lot.unpark_all(t);
+}
+
+/* Queues of a standard worker in the work-stealing scheduler. The owner pushes and pops at the back,
+   other workers steal from the front. */
+struct task_worker_queue {
+    mutex                                         m_mutex;
+    std::deque<lean_task_object *>                m_queues[LEAN_MAX_PRIO+1];
+};
+
+/* Queue of the standard worker running on the current thread, if any. */
+LEAN_THREAD_PTR(task_worker_queue, g_current_worker_queue);
+
 class task_manager {
     mutex                                         m_mutex;
     std::vector<std::unique_ptr<lthread>>         m_std_workers;
@@ -587,8 +860,23 @@ class task_manager {
     unsigned                                      m_queues_size{0};
     unsigned                                      m_max_prio{0};
     condition_variable                            m_queue_cv;
-    condition_variable                            m_task_finished_cv;
+    task_parking_lot                              m_parking_lot;
     bool                                          m_shutting_down{false};
+    /* Work-stealing scheduler (`LEAN_TASK_SCHEDULER_WORK_STEALING`).
+       Instead of `m_queues`, every standard worker owns a `task_worker_queue`, and tasks enqueued by other threads
+       go to `m_ws_injected`. Queues are protected by their own mutex so that enqueueing and dequeueing does not
+       contend on `m_mutex`, which is still used for all other task state transitions.
+       `m_ws_prio_size[p]` is the number of queued tasks of priority `p` over all queues; workers use it to never
+       run a task while a task of higher priority is queued anywhere. */
+    bool                                          m_work_stealing{false};
+    std::vector<std::unique_ptr<task_worker_queue>> m_ws_queues;
+    task_worker_queue                             m_ws_injected;
+    atomic<unsigned>                              m_ws_prio_size[LEAN_MAX_PRIO+1];
+    atomic<unsigned>                              m_ws_size{0};
+    atomic<unsigned>                              m_ws_num_workers{0};
+    atomic<unsigned>                              m_ws_idle_workers{0};
+    mutex                                         m_ws_idle_mutex;
+    condition_variable                            m_ws_idle_cv;
 
     lean_task_object * dequeue() {
         lean_assert(m_queues_size != 0);
@@ -607,6 +895,70 @@ class task_manager {
         return result;
     }
 
+    /* Remark: `m_mutex` must be held iff `locked` is true. */
+    void ws_enqueue(lean_task_object * t, bool locked) {
+        unsigned prio = t->m_imp->m_prio;
+        lean_assert(prio <= LEAN_MAX_PRIO);
+        task_worker_queue * q = g_current_worker_queue ? g_current_worker_queue : &m_ws_injected;
+        {
+            lock_guard<mutex> lock(q->m_mutex);
+            q->m_queues[prio].push_back(t);
+            m_ws_prio_size[prio]++;
+            m_ws_size++;
+        }
+        if (m_ws_idle_workers > 0) {
+            lock_guard<mutex> lock(m_ws_idle_mutex);
+            m_ws_idle_cv.notify_one();
+        } else if (m_ws_num_workers < m_max_std_workers) {
+            if (locked) {
+                spawn_worker();
+            } else {
+                unique_lock<mutex> lock(m_mutex);
+                if (m_ws_num_workers < m_max_std_workers)
+                    spawn_worker();
+            }
+        }
+    }
+
+    lean_task_object * ws_pop(task_worker_queue & q, unsigned prio, bool front) {
+        lock_guard<mutex> lock(q.m_mutex);
+        std::deque<lean_task_object *> & d = q.m_queues[prio];
+        if (d.empty())
+            return nullptr;
+        lean_task_object * t;
+        if (front) {
+            t = d.front();
+            d.pop_front();
+        } else {
+            t = d.back();
+            d.pop_back();
+        }
+        m_ws_prio_size[prio]--;
+        m_ws_size--;
+        return t;
+    }
+
+    /* Dequeue a task of maximal priority for worker `idx`, preferring its own queue, then the injected tasks,
+       and finally stealing from other workers. */
+    lean_task_object * ws_dequeue(unsigned idx) {
+        unsigned prio = LEAN_MAX_PRIO + 1;
+        while (prio > 0 && m_ws_size > 0) {
+            prio--;
+            if (m_ws_prio_size[prio] == 0)
+                continue;
+            if (lean_task_object * t = ws_pop(*m_ws_queues[idx], prio, false))
+                return t;
+            if (lean_task_object * t = ws_pop(m_ws_injected, prio, true))
+                return t;
+            unsigned num_workers = m_ws_num_workers;
+            for (unsigned i = 1; i < num_workers; i++) {
+                if (lean_task_object * t = ws_pop(*m_ws_queues[(idx + i) % num_workers], prio, true))
+                    return t;
+            }
+        }
+        return nullptr;
+    }
+
     void enqueue_core(lean_task_object * t) {
         lean_assert(t->m_imp);
         unsigned prio = t->m_imp->m_prio;
@@ -614,6 +966,10 @@ class task_manager {
             spawn_dedicated_worker(t);
             return;
         }
+        if (m_work_stealing) {
+            ws_enqueue(t, true);
+            return;
+        }
         if (prio > m_max_prio)
             m_max_prio = prio;
         m_queues[prio].push_back(t);
@@ -642,10 +998,41 @@ class task_manager {
         lock.lock();
     }
 
+    void spawn_ws_worker() {
+        unsigned idx = m_ws_num_workers;
+        m_ws_num_workers++;
+        m_std_workers.emplace_back(new lthread([this, idx]() {
+            save_stack_info(false);
+            g_current_worker_queue = m_ws_queues[idx].get();
+            while (true) {
+                if (lean_task_object * t = ws_dequeue(idx)) {
+                    unique_lock<mutex> lock(m_mutex);
+                    run_task(lock, t);
+                    lock.unlock();
+                    reset_heartbeat();
+                    continue;
+                }
+                unique_lock<mutex> lock(m_ws_idle_mutex);
+                m_ws_idle_workers++;
+                while (m_ws_size == 0 && !m_shutting_down)
+                    m_ws_idle_cv.wait(lock);
+                m_ws_idle_workers--;
+                if (m_ws_size == 0 && m_shutting_down)
+                    break;
+            }
+            g_current_worker_queue = nullptr;
+        }));
+    }
+
     void spawn_worker() {
         if (m_shutting_down)
             return;
 
+        if (m_work_stealing) {
+            spawn_ws_worker();
+            return;
+        }
+
         m_std_workers.emplace_back(new lthread([this]() {
             save_stack_info(false);
             unique_lock<mutex> lock(m_mutex);
@@ -693,7 +1080,10 @@ class task_manager {
             object * c = t->m_imp->m_closure;
             t->m_imp->m_closure = nullptr;
             lock.unlock();
-            v = lean_apply_1(c, box(0));
+            v = apply_task_closure(c);
+            /* Mark the result before taking `m_mutex`, so that other workers are not blocked while we traverse it */
+            if (v != nullptr)
+                mark_mt(v);
             // If deactivation was delayed by `m_keep_alive`, deactivate after the final execution (`v != nulltpr`)
             if (v != nullptr && t->m_imp->m_keep_alive) {
                 lean_dec_ref((lean_object*)t);
@@ -721,15 +1111,17 @@ class task_manager {
         }
     }
 
+    /* `v` must have been marked as multi-threaded, see `run_task` and `resolve`. */
     void resolve_core(lean_task_object * t, object * v) {
         handle_finished(t);
-        mark_mt(v);
-        t->m_value = v;
         /* After the task has been finished and we propagated
            dependencies, we can release `m_imp` and keep just the value */
         free_task_imp(t->m_imp);
         t->m_imp   = nullptr;
-        m_task_finished_cv.notify_all();
+        /* Setting `m_value` is the transition to the Finished state and must be the last access to `t`:
+           from this point on, `deactivate_task` may free `t` without taking `m_mutex`. */
+        t->m_value = v;
+        m_parking_lot.unpark_all(t);
     }
 
     void handle_finished(lean_task_object * t) {
@@ -761,17 +1153,26 @@ class task_manager {
     }
 
 public:
-    task_manager(unsigned max_std_workers):
-        m_max_std_workers(max_std_workers) {
+    task_manager(unsigned max_std_workers, unsigned scheduler):
+        m_max_std_workers(max_std_workers), m_work_stealing(scheduler == LEAN_TASK_SCHEDULER_WORK_STEALING) {
+        for (unsigned prio = 0; prio <= LEAN_MAX_PRIO; prio++)
+            m_ws_prio_size[prio] = 0;
+        if (m_work_stealing) {
+            for (unsigned i = 0; i < max_std_workers; i++)
+                m_ws_queues.emplace_back(new task_worker_queue());
+        }
     }
 
     ~task_manager() {
         {
             unique_lock<mutex> lock(m_mutex);
+            // idle work-stealing workers check `m_shutting_down` under `m_ws_idle_mutex`
+            lock_guard<mutex> idle_lock(m_ws_idle_mutex);
             m_shutting_down = true;
             // we can assume that `m_std_workers` will not be changed after this line
         }
         m_queue_cv.notify_all();
+        m_ws_idle_cv.notify_all();
 #ifndef LEAN_EMSCRIPTEN
         // wait for all workers to finish
         for (auto & t : m_std_workers)
@@ -781,11 +1182,16 @@ public:
     }
 
     void enqueue(lean_task_object * t) {
+        if (m_work_stealing && t->m_imp->m_prio <= LEAN_MAX_PRIO) {
+            ws_enqueue(t, false);
+            return;
+        }
         unique_lock<mutex> lock(m_mutex);
         enqueue_core(t);
     }
 
     void resolve(lean_task_object * t, object * v) {
+        mark_mt(v);
         unique_lock<mutex> lock(m_mutex);
         if (t->m_value) {
             lock.unlock(); // `dec(v)` could lead to `deactivate_task` trying to take the lock
@@ -814,24 +1220,35 @@ public:
     void wait_for(lean_task_object * t) {
         if (t->m_value)
             return;
-        unique_lock<mutex> lock(m_mutex);
-        if (t->m_value)
-            return;
-        m_task_finished_cv.wait(lock, [&]() { return t->m_value != nullptr; });
+        task_parker p;
+        m_parking_lot.add_waiter(t, &p);
+        while (!t->m_value)
+            p.park();
+        m_parking_lot.remove_waiter(t, &p);
     }
 
     object * wait_any(object * task_list) {
         if (object * t = wait_any_check(task_list))
             return t;
-        unique_lock<mutex> lock(m_mutex);
-        while (true) {
-            if (object * t = wait_any_check(task_list))
-                return t;
-            m_task_finished_cv.wait(lock);
-        }
+        task_parker p;
+        for (object * it = task_list; !is_scalar(it); it = cnstr_get(it, 1))
+            m_parking_lot.add_waiter(lean_to_task(lean_ctor_get(it, 0)), &p);
+        object * r;
+        while (!(r = wait_any_check(task_list)))
+            p.park();
+        for (object * it = task_list; !is_scalar(it); it = cnstr_get(it, 1))
+            m_parking_lot.remove_waiter(lean_to_task(lean_ctor_get(it, 0)), &p);
+        return r;
     }
 
     void deactivate_task(lean_task_object * t) {
+        if (object * v = t->m_value) {
+            // Finished tasks are not accessed by the task manager anymore, see `resolve_core`
+            lean_assert(t->m_imp == nullptr);
+            lean_dec(v);
+            free_task(t);
+            return;
+        }
         unique_lock<mutex> lock(m_mutex);
         if (object * v = t->m_value) {
             lean_assert(t->m_imp == nullptr);
@@ -858,15 +1275,29 @@ public:
 
 static task_manager * g_task_manager = nullptr;
 
-extern "C" LEAN_EXPORT void lean_init_task_manager_using(unsigned num_workers) {
+static unsigned get_lean_task_scheduler() {
+#ifndef LEAN_EMSCRIPTEN
+    if (char const * scheduler = std::getenv("LEAN_TASK_SCHEDULER")) {
+        if (strcmp(scheduler, "work_stealing") == 0)
+            return LEAN_TASK_SCHEDULER_WORK_STEALING;
+    }
+#endif
+    return LEAN_TASK_SCHEDULER_GLOBAL_QUEUE;
+}
+
+extern "C" LEAN_EXPORT void lean_init_task_manager_using_scheduler(unsigned num_workers, unsigned scheduler) {
     lean_assert(g_task_manager == nullptr);
 #if defined(LEAN_MULTI_THREAD)
     if (num_workers > 0) {
-        g_task_manager = new task_manager(num_workers);
+        g_task_manager = new task_manager(num_workers, scheduler);
     }
 #endif
 }
 
+extern "C" LEAN_EXPORT void lean_init_task_manager_using(unsigned num_workers) {
+    lean_init_task_manager_using_scheduler(num_workers, get_lean_task_scheduler());
+}
+
 static unsigned get_lean_num_threads() {
 #ifndef LEAN_EMSCRIPTEN
     if (char const * num_threads = std::getenv("LEAN_NUM_THREADS")) {
@@ -888,12 +1319,7 @@ extern "C" LEAN_EXPORT void lean_finalize_task_manager() {
 }
 
 scoped_task_manager::scoped_task_manager(unsigned num_workers) {
-    lean_assert(g_task_manager == nullptr);
-#if defined(LEAN_MULTI_THREAD)
-    if (num_workers > 0) {
-        g_task_manager = new task_manager(num_workers);
-    }
-#endif
+    lean_init_task_manager_using(num_workers);
 }
 
 scoped_task_manager::~scoped_task_manager() {
@@ -922,7 +1348,7 @@ static inline void lean_set_task_header(lean_object * o) {
 
 static lean_task_object * alloc_task(obj_arg c, unsigned prio, bool keep_alive) {
     lean_mark_mt(c);
-    lean_task_object * o = (lean_task_object*)lean_alloc_small_object(sizeof(lean_task_object));
+    lean_task_object * o = (lean_task_object*)alloc_task_cached(sizeof(lean_task_object));
     lean_set_task_header((lean_object*)o);
     o->m_value = nullptr;
     o->m_imp   = alloc_task_imp(c, prio, keep_alive);
@@ -932,7 +1358,7 @@ static lean_task_object * alloc_task(obj_arg c, unsigned prio, bool keep_alive)
 }
 
 static lean_task_object * alloc_task(obj_arg v) {
-    lean_task_object * o = (lean_task_object*)lean_alloc_small_object(sizeof(lean_task_object));
+    lean_task_object * o = (lean_task_object*)alloc_task_cached(sizeof(lean_task_object));
     lean_set_st_header((lean_object*)o, LeanTask, 0);
     o->m_value = v;
     o->m_imp   = nullptr;
@@ -1032,14 +1458,16 @@ extern "C" LEAN_EXPORT void lean_io_cancel_core(b_obj_arg t) {
 
 extern "C" LEAN_EXPORT uint8_t lean_io_get_task_state_core(b_obj_arg t) {
     lean_task_object * o = lean_to_task(t);
-    if (o->m_imp) {
-        if (o->m_imp->m_closure) {
+    if (o->m_value)
+        return 2; // finished
+    if (lean_task_imp * imp = o->m_imp) {
+        if (imp->m_closure) {
             return 0; // waiting (waiting/queued)
         } else {
             return 1; // running (running/promised)
         }
     } else {
-        return 2; // finished
+        return 1; // being resolved, `m_value` is about to be set
     }
 }
 
@@ -1054,7 +1482,7 @@ extern "C" LEAN_EXPORT obj_res lean_io_promise_new(obj_arg) {
     bool keep_alive = false;
     unsigned prio = 0;
     object * closure = nullptr;
-    lean_task_object * o = (lean_task_object*)lean_alloc_small_object(sizeof(lean_task_object));
+    lean_task_object * o = (lean_task_object*)alloc_task_cached(sizeof(lean_task_object));
     lean_set_task_header((lean_object*)o);
     o->m_value = nullptr;
     o->m_imp   = alloc_task_imp(closure, prio, keep_alive);
@@ -1592,12 +2020,30 @@ extern "C" LEAN_EXPORT obj_res lean_float_frexp(double a) {
 
 static inline char * w_string_cstr(object * o) { lean_assert(lean_is_string(o)); return lean_to_string(o)->m_data; }
 
+/* Return true if an object of the given size is allocated using `malloc`, and thus can be resized using `realloc`. */
+static inline bool is_malloc_object_size(size_t sz) {
+#ifdef LEAN_SMALL_ALLOCATOR
+    return lean_align(sz, LEAN_OBJECT_SIZE_DELTA) > LEAN_MAX_SMALL_OBJECT_SIZE;
+#else
+    return true;
+#endif
+}
+
 static object * string_ensure_capacity(object * o, size_t extra) {
     lean_assert(is_exclusive(o));
     size_t sz  = string_size(o);
     size_t cap = string_capacity(o);
     if (sz + extra > cap) {
-        object * new_o = alloc_string(sz, cap + sz + extra, string_len(o));
+        size_t new_cap = cap + sz + extra;
+        if (is_malloc_object_size(lean_string_byte_size(o))) {
+            /* `realloc` may extend the block in place, and moves large blocks by remapping their pages
+               instead of copying them. */
+            object * new_o = static_cast<object *>(realloc(o, sizeof(lean_string_object) + new_cap));
+            if (new_o == nullptr) lean_internal_panic_out_of_memory();
+            lean_to_string(new_o)->m_capacity = new_cap;
+            return new_o;
+        }
+        object * new_o = alloc_string(sz, new_cap, string_len(o));
         lean_assert(string_capacity(new_o) >= sz + extra);
         memcpy(w_string_cstr(new_o), string_cstr(o), sz);
         lean_dealloc(o, lean_string_byte_size(o));
@@ -1711,6 +2157,16 @@ extern "C" LEAN_EXPORT object * lean_string_append(object * s1, object * s2) {
     size_t len2     = lean_string_len(s2);
     size_t new_len  = len1 + len2;
     size_t new_sz   = sz1 + sz2 - 1;
+    if (sz2 == 1) {
+        /* `s2` is empty */
+        return s1;
+    }
+    if (sz1 == 1 && lean_is_exclusive(s1) && lean_string_capacity(s1) < new_sz) {
+        /* `s1` is empty and we would have to copy `s2` anyway, share it instead */
+        lean_dec_ref(s1);
+        lean_inc(s2);
+        return s2;
+    }
     object * r;
     if (!lean_is_exclusive(s1)) {
         r = lean_alloc_string(new_sz, mk_capacity(new_sz), new_len);
@@ -1997,7 +2453,48 @@ extern "C" LEAN_EXPORT obj_res lean_string_utf8_extract(b_obj_arg s, b_obj_arg b
     if (e < sz && !is_utf8_first_byte(str[e])) e = sz;
     usize new_sz = e - b;
     lean_assert(new_sz > 0);
-    return lean_mk_string_from_bytes_unchecked(lean_string_cstr(s) + b, new_sz);
+    if (new_sz == sz) {
+        /* `s.extract 0 s.endPos` is `s` */
+        lean_inc(s);
+        return s;
+    }
+    /* `b` and `e` are character boundaries, so we can count the characters outside the range if there are fewer bytes. */
+    usize len;
+    if (2 * new_sz > sz)
+        len = lean_string_len(s) - utf8_strlen(str, b) - utf8_strlen(str + e, sz - e);
+    else
+        len = utf8_strlen(str + b, new_sz);
+    return lean_mk_string_unchecked(str + b, new_sz, len);
+}
+
+/* The reference implementation is `String.codepointPosToUtf8PosFrom`, i.e., `n0` applications of `String.next`
+   starting at `i0`. */
+extern "C" LEAN_EXPORT obj_res lean_string_codepoint_pos_to_utf8_pos_from(b_obj_arg s, b_obj_arg i0, b_obj_arg n0) {
+    if (!lean_is_scalar(i0)) {
+        /* See comment at string_utf8_get */
+        return lean_nat_add(i0, n0);
+    }
+    usize i  = lean_unbox(i0);
+    usize sz = lean_string_size(s) - 1;
+    usize n  = lean_is_scalar(n0) ? lean_unbox(n0) : SIZE_MAX;
+    usize n_init = n;
+    char const * str = lean_string_cstr(s);
+    /* `next` moves to the next byte if `i` is not a valid position. */
+    while (n > 0 && i < sz && is_utf8_next(str[i])) {
+        i++;
+        n--;
+    }
+    if (i < sz)
+        i += utf8_skip_chars(str + i, sz - i, n);
+    /* `next` moves to the next byte past the end of the string. */
+    if (lean_is_scalar(n0))
+        return lean_usize_to_nat(i + n);
+    obj_res consumed = lean_usize_to_nat(n_init - n);
+    obj_res rest     = lean_nat_sub(n0, consumed);
+    obj_res r        = lean_nat_add(lean_box(i), rest);
+    lean_dec(consumed);
+    lean_dec(rest);
+    return r;
 }
 
 extern "C" LEAN_EXPORT obj_res lean_string_utf8_prev(b_obj_arg s, b_obj_arg i0) {
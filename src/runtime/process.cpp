@@ -35,6 +35,15 @@ Author: Jared Roesch
 #include "runtime/pair_ref.h"
 #include "runtime/buffer.h"
 
+#if !defined(LEAN_WINDOWS) && defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 29))
+/* Use `posix_spawn` instead of `fork` to create processes. We need glibc 2.29 for
+   `posix_spawn_file_actions_addchdir_np`, and for `posix_spawn` to report `exec` failures. */
+#define LEAN_POSIX_SPAWN
+#include <spawn.h>
+#include <unordered_map>
+#include <vector>
+#endif
+
 namespace lean {
 
 enum stdio {
@@ -345,6 +354,118 @@ static optional<pipe> setup_stdio(stdio cfg) {
     lean_unreachable();
 }
 
+#ifdef LEAN_POSIX_SPAWN
+static void close_pipe(optional<pipe> const & p) {
+    if (p) {
+        close(p->m_read_fd);
+        close(p->m_write_fd);
+    }
+}
+
+/*
+  `fork` copies the page tables of the parent process, which is slow when the parent has a large heap or maps many
+  .olean files, while `posix_spawn` creates the child without copying the address space. We still use `fork` when
+  the environment variable `LEAN_PROCESS_SPAWN` is set to `fork`, or when `env` sets `PATH` and `proc_name` must be
+  looked up in it, as `posix_spawnp` searches the `PATH` of the parent process. We also fall back to `fork` when
+  `posix_spawnp` fails with `ENOEXEC`, so that `execvp` runs scripts without a shebang line using `/bin/sh`.
+
+  With `posix_spawn`, a failure to change the working directory or to execute `proc_name` is reported as an error
+  of `spawn`, as on Windows, instead of making the child process exit with code 255.
+*/
+static bool use_posix_spawn(string_ref const & proc_name, array_ref<pair_ref<string_ref, option_ref<string_ref>>> const & env) {
+    static bool enabled = [] {
+        char const * mode = std::getenv("LEAN_PROCESS_SPAWN");
+        return !mode || strcmp(mode, "fork") != 0;
+    }();
+    if (!enabled)
+        return false;
+    if (strchr(proc_name.data(), '/') == nullptr) {
+        for (auto & entry : env) {
+            if (strcmp(entry.fst().data(), "PATH") == 0)
+                return false;
+        }
+    }
+    return true;
+}
+
+extern "C" char ** environ;
+
+static int posix_spawn_process(pid_t & pid, string_ref const & proc_name, array_ref<string_ref> const & args, stdio stdin_mode,
+  stdio stdout_mode, stdio stderr_mode, optional<pipe> const & stdin_pipe, optional<pipe> const & stdout_pipe,
+  optional<pipe> const & stderr_pipe, option_ref<string_ref> const & cwd,
+  array_ref<pair_ref<string_ref, option_ref<string_ref>>> const & env, bool do_setsid) {
+    /* The pipes are created with `O_CLOEXEC`, so we only need to redirect the standard streams of the child.
+       `dup2` clears `FD_CLOEXEC` on the new descriptor. */
+    posix_spawn_file_actions_t actions;
+    int err = posix_spawn_file_actions_init(&actions);
+    if (err) return err;
+    if (stdin_pipe) {
+        err = posix_spawn_file_actions_adddup2(&actions, stdin_pipe->m_read_fd, STDIN_FILENO);
+    } else if (stdin_mode == stdio::NUL) {
+        err = posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    }
+    if (!err && stdout_pipe) {
+        err = posix_spawn_file_actions_adddup2(&actions, stdout_pipe->m_write_fd, STDOUT_FILENO);
+    } else if (!err && stdout_mode == stdio::NUL) {
+        err = posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    }
+    if (!err && stderr_pipe) {
+        err = posix_spawn_file_actions_adddup2(&actions, stderr_pipe->m_write_fd, STDERR_FILENO);
+    } else if (!err && stderr_mode == stdio::NUL) {
+        err = posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+    }
+    if (!err && cwd) {
+        err = posix_spawn_file_actions_addchdir_np(&actions, cwd.get()->data());
+    }
+    if (err) {
+        posix_spawn_file_actions_destroy(&actions);
+        return err;
+    }
+
+    posix_spawnattr_t attr;
+    err = posix_spawnattr_init(&attr);
+    if (!err && do_setsid) {
+        err = posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSID);
+    }
+    if (err) {
+        posix_spawn_file_actions_destroy(&actions);
+        return err;
+    }
+
+    buffer<char *> pargs;
+    pargs.push_back(const_cast<char *>(proc_name.data()));
+    for (auto & arg : args)
+        pargs.push_back(const_cast<char *>(arg.data()));
+    pargs.push_back(NULL);
+
+    std::vector<std::string> vars;
+    buffer<char *> envp;
+    if (env.size()) {
+        std::unordered_map<std::string, option_ref<string_ref>> new_env_vars;
+        for (auto & entry : env) {
+            new_env_vars[entry.fst().to_std_string()] = entry.snd();
+        }
+        for (char ** e = environ; *e; e++) {
+            char const * eq = strchr(*e, '=');
+            if (!eq || !new_env_vars.count(std::string(*e, eq - *e)))
+                envp.push_back(*e);
+        }
+        for (auto & entry : new_env_vars) {
+            if (entry.second)
+                vars.push_back(entry.first + "=" + entry.second.get()->data());
+        }
+        for (std::string & var : vars)
+            envp.push_back(const_cast<char *>(var.c_str()));
+        envp.push_back(NULL);
+    }
+
+    err = posix_spawnp(&pid, proc_name.data(), &actions, &attr, pargs.data(), env.size() ? envp.data() : environ);
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    return err;
+}
+#endif
+
 static obj_res spawn(string_ref const & proc_name, array_ref<string_ref> const & args, stdio stdin_mode, stdio stdout_mode,
   stdio stderr_mode, option_ref<string_ref> const & cwd, array_ref<pair_ref<string_ref, option_ref<string_ref>>> const & env,
   bool do_setsid) {
@@ -353,7 +474,28 @@ static obj_res spawn(string_ref const & proc_name, array_ref<string_ref> const &
     auto stdout_pipe = setup_stdio(stdout_mode);
     auto stderr_pipe = setup_stdio(stderr_mode);
 
-    int pid = fork();
+    pid_t pid;
+#ifdef LEAN_POSIX_SPAWN
+    if (use_posix_spawn(proc_name, env)) {
+        int err = posix_spawn_process(pid, proc_name, args, stdin_mode, stdout_mode, stderr_mode, stdin_pipe,
+                                      stdout_pipe, stderr_pipe, cwd, env, do_setsid);
+        if (err == ENOEXEC) {
+            /* Unlike `execvp`, `posix_spawnp` does not run files without a shebang line using `/bin/sh`. */
+            pid = fork();
+        } else if (err) {
+            close_pipe(stdin_pipe);
+            close_pipe(stdout_pipe);
+            close_pipe(stderr_pipe);
+            // blame the working directory if it cannot be entered, and the executable otherwise
+            b_obj_arg fname = cwd && access(cwd.get()->data(), X_OK) != 0 ? cwd.get()->raw() : proc_name.raw();
+            return io_result_mk_error(decode_io_error(err, fname));
+        }
+    } else {
+        pid = fork();
+    }
+#else
+    pid = fork();
+#endif
 
     if (pid == 0) {
         for (auto & entry : env) {
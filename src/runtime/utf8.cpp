@@ -5,11 +5,23 @@ Released under Apache 2.0 license as described in the file LICENSE.
 Author: Leonardo de Moura
 */
 #include <cstdlib>
+#include <cstring>
 #include <string>
 #include "runtime/debug.h"
 #include "runtime/optional.h"
 #include "runtime/utf8.h"
 
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__)) && !defined(LEAN_EMSCRIPTEN)
+#define LEAN_UTF8_SIMD
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+/* Strings shorter than this are always processed by the scalar code. */
+#ifndef LEAN_UTF8_SIMD_THRESHOLD
+#define LEAN_UTF8_SIMD_THRESHOLD 32
+#endif
+
 namespace lean {
 bool is_utf8_next(unsigned char c) { return (c & 0xC0) == 0x80; }
 
@@ -32,6 +44,281 @@ unsigned get_utf8_size(unsigned char c) {
         return 1; /* invalid */
 }
 
+/*
+Vectorized UTF-8 kernels.
+
+Each kernel processes a prefix of its input and returns its size in bytes, the caller processes the rest
+using the scalar code. The scalar "kernels" process nothing. The implementation is selected the first time
+a kernel is needed, using the best instruction set supported by the CPU. The environment variable
+`LEAN_UTF8_SIMD` (`scalar`, `sse4.2` or `avx2`) can be used to select a less capable implementation,
+e.g., to compare them.
+
+The validation kernels implement the algorithm described in the paper "Validating UTF-8 In Less Than One
+Instruction Per Byte" by John Keiser and Daniel Lemire. Each byte is classified using the high and low
+nibbles of the previous byte and the high nibble of the current one, and the errors in sequences spanning
+3 and 4 bytes are detected by checking that the bytes following a 3 or 4 byte lead are continuation bytes.
+*/
+struct utf8_kernels {
+    /* Return the size of a prefix of `str` that is valid UTF-8 and ends at a character boundary, and store its
+       number of characters in `n`. Errors are detected at block granularity, so the scalar validation must
+       be used on the rest of `str`. */
+    size_t (*m_validate)(uint8_t const * str, size_t size, size_t & n);
+    /* Return the size of a prefix of `str`, and store the number of bytes in it that are not continuation bytes in `n`. */
+    size_t (*m_count)(uint8_t const * str, size_t size, size_t & n);
+    /* Return the size of a prefix of `str` containing at most `n` bytes that are not continuation bytes,
+       and decrease `n` by their number. */
+    size_t (*m_skip)(uint8_t const * str, size_t size, size_t & n);
+};
+
+static size_t scalar_kernel(uint8_t const *, size_t, size_t & n) { n = 0; return 0; }
+static size_t scalar_skip_kernel(uint8_t const *, size_t, size_t &) { return 0; }
+
+#if defined(LEAN_UTF8_SIMD)
+/* Classes of errors, see the paper. */
+#define UTF8_TOO_SHORT      (1 << 0)
+#define UTF8_TOO_LONG       (1 << 1)
+#define UTF8_OVERLONG_3     (1 << 2)
+#define UTF8_TOO_LARGE      (1 << 3)
+#define UTF8_SURROGATE      (1 << 4)
+#define UTF8_OVERLONG_2     (1 << 5)
+#define UTF8_TOO_LARGE_1000 (1 << 6)
+#define UTF8_OVERLONG_4     (1 << 6)
+#define UTF8_TWO_CONTS      (1 << 7)
+#define UTF8_CARRY          (UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTS)
+
+#define UTF8_BYTE_1_HIGH_TABLE                                                            \
+    UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,                           \
+    UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,                           \
+    UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS,                       \
+    UTF8_TOO_SHORT | UTF8_OVERLONG_2,                                                     \
+    UTF8_TOO_SHORT,                                                                       \
+    UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,                                    \
+    UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4
+
+#define UTF8_BYTE_1_LOW_TABLE                                                             \
+    UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4,                     \
+    UTF8_CARRY | UTF8_OVERLONG_2,                                                         \
+    UTF8_CARRY,                                                                           \
+    UTF8_CARRY,                                                                           \
+    UTF8_CARRY | UTF8_TOO_LARGE,                                                          \
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,                                    \
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,                                    \
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,                                    \
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,                                    \
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,                                    \
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,                                    \
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,                                    \
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,                                    \
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE,                   \
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,                                    \
+    UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000
+
+#define UTF8_BYTE_2_HIGH_TABLE                                                                                      \
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,                                                 \
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,                                                 \
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,      \
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE,                             \
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,                              \
+    UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,                              \
+    UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT
+
+/* Given a prefix of size `pos` validated by a kernel, return the start of the last character in the prefix
+   if it may be incomplete, and `pos` otherwise. The sequences spanning the end of the prefix are only checked
+   with the next block. */
+static size_t utf8_validated_prefix(uint8_t const * str, size_t pos, size_t & n) {
+    for (size_t i = pos; i > 0 && i + 3 > pos; i--) {
+        if (!is_utf8_next(str[i - 1])) {
+            n--;
+            return i - 1;
+        }
+    }
+    return pos;
+}
+
+__attribute__((target("sse4.2,popcnt")))
+static inline __m128i utf8_errors_sse42(__m128i input, __m128i prev_input) {
+    __m128i const nibble = _mm_set1_epi8(0x0F);
+    __m128i prev1 = _mm_alignr_epi8(input, prev_input, 16 - 1);
+    __m128i byte_1_high = _mm_shuffle_epi8(_mm_setr_epi8(UTF8_BYTE_1_HIGH_TABLE),
+                                           _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble));
+    __m128i byte_1_low  = _mm_shuffle_epi8(_mm_setr_epi8(UTF8_BYTE_1_LOW_TABLE), _mm_and_si128(prev1, nibble));
+    __m128i byte_2_high = _mm_shuffle_epi8(_mm_setr_epi8(UTF8_BYTE_2_HIGH_TABLE),
+                                           _mm_and_si128(_mm_srli_epi16(input, 4), nibble));
+    __m128i special     = _mm_and_si128(_mm_and_si128(byte_1_high, byte_1_low), byte_2_high);
+    __m128i prev2 = _mm_alignr_epi8(input, prev_input, 16 - 2);
+    __m128i prev3 = _mm_alignr_epi8(input, prev_input, 16 - 3);
+    /* Only the bytes following `111_____` and `1111____` by 2 and 3 positions respectively get the high bit. */
+    __m128i must23 = _mm_or_si128(_mm_subs_epu8(prev2, _mm_set1_epi8(static_cast<char>(0xE0 - 0x80))),
+                                  _mm_subs_epu8(prev3, _mm_set1_epi8(static_cast<char>(0xF0 - 0x80))));
+    __m128i must23_80 = _mm_and_si128(must23, _mm_set1_epi8(static_cast<char>(0x80)));
+    return _mm_xor_si128(must23_80, special);
+}
+
+__attribute__((target("sse4.2,popcnt")))
+static inline unsigned utf8_leads_sse42(__m128i input) {
+    /* Continuation bytes are the ones in [0x80, 0xBF], i.e., [-128, -65] as signed bytes. */
+    return __builtin_popcount(_mm_movemask_epi8(_mm_cmpgt_epi8(input, _mm_set1_epi8(-65))));
+}
+
+__attribute__((target("sse4.2,popcnt")))
+static size_t validate_utf8_sse42(uint8_t const * str, size_t size, size_t & n) {
+    size_t pos = 0;
+    n = 0;
+    __m128i prev_input = _mm_setzero_si128();
+    while (pos + 16 <= size) {
+        __m128i input = _mm_loadu_si128(reinterpret_cast<__m128i const *>(str + pos));
+        if (_mm_movemask_epi8(_mm_or_si128(input, prev_input)) != 0) {
+            __m128i errors = utf8_errors_sse42(input, prev_input);
+            if (!_mm_testz_si128(errors, errors))
+                break;
+        }
+        n += utf8_leads_sse42(input);
+        prev_input = input;
+        pos += 16;
+    }
+    return utf8_validated_prefix(str, pos, n);
+}
+
+__attribute__((target("sse4.2,popcnt")))
+static size_t count_utf8_sse42(uint8_t const * str, size_t size, size_t & n) {
+    size_t pos = 0;
+    n = 0;
+    for (; pos + 16 <= size; pos += 16)
+        n += utf8_leads_sse42(_mm_loadu_si128(reinterpret_cast<__m128i const *>(str + pos)));
+    return pos;
+}
+
+__attribute__((target("sse4.2,popcnt")))
+static size_t skip_utf8_sse42(uint8_t const * str, size_t size, size_t & n) {
+    size_t pos = 0;
+    for (; pos + 16 <= size; pos += 16) {
+        unsigned c = utf8_leads_sse42(_mm_loadu_si128(reinterpret_cast<__m128i const *>(str + pos)));
+        if (c > n)
+            break;
+        n -= c;
+    }
+    return pos;
+}
+
+__attribute__((target("avx2,popcnt")))
+static inline __m256i utf8_prev_avx2(__m256i input, __m256i prev_input, int k) {
+    /* `_mm256_alignr_epi8` shifts each 128-bit lane independently, so we first build the vector whose low lane
+       is the high lane of `prev_input` and whose high lane is the low lane of `input`. */
+    __m256i t = _mm256_permute2x128_si256(prev_input, input, 0x21);
+    switch (k) {
+    case 1: return _mm256_alignr_epi8(input, t, 16 - 1);
+    case 2: return _mm256_alignr_epi8(input, t, 16 - 2);
+    default: return _mm256_alignr_epi8(input, t, 16 - 3);
+    }
+}
+
+__attribute__((target("avx2,popcnt")))
+static inline __m256i utf8_errors_avx2(__m256i input, __m256i prev_input) {
+    __m256i const nibble = _mm256_set1_epi8(0x0F);
+    __m256i prev1 = utf8_prev_avx2(input, prev_input, 1);
+    __m256i byte_1_high = _mm256_shuffle_epi8(_mm256_setr_epi8(UTF8_BYTE_1_HIGH_TABLE, UTF8_BYTE_1_HIGH_TABLE),
+                                              _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble));
+    __m256i byte_1_low  = _mm256_shuffle_epi8(_mm256_setr_epi8(UTF8_BYTE_1_LOW_TABLE, UTF8_BYTE_1_LOW_TABLE),
+                                              _mm256_and_si256(prev1, nibble));
+    __m256i byte_2_high = _mm256_shuffle_epi8(_mm256_setr_epi8(UTF8_BYTE_2_HIGH_TABLE, UTF8_BYTE_2_HIGH_TABLE),
+                                              _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble));
+    __m256i special     = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+    __m256i prev2 = utf8_prev_avx2(input, prev_input, 2);
+    __m256i prev3 = utf8_prev_avx2(input, prev_input, 3);
+    __m256i must23 = _mm256_or_si256(_mm256_subs_epu8(prev2, _mm256_set1_epi8(static_cast<char>(0xE0 - 0x80))),
+                                     _mm256_subs_epu8(prev3, _mm256_set1_epi8(static_cast<char>(0xF0 - 0x80))));
+    __m256i must23_80 = _mm256_and_si256(must23, _mm256_set1_epi8(static_cast<char>(0x80)));
+    return _mm256_xor_si256(must23_80, special);
+}
+
+__attribute__((target("avx2,popcnt")))
+static inline unsigned utf8_leads_avx2(__m256i input) {
+    return __builtin_popcount(static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpgt_epi8(input, _mm256_set1_epi8(-65)))));
+}
+
+__attribute__((target("avx2,popcnt")))
+static size_t validate_utf8_avx2(uint8_t const * str, size_t size, size_t & n) {
+    size_t pos = 0;
+    n = 0;
+    __m256i prev_input = _mm256_setzero_si256();
+    while (pos + 32 <= size) {
+        __m256i input = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(str + pos));
+        if (_mm256_movemask_epi8(_mm256_or_si256(input, prev_input)) != 0) {
+            __m256i errors = utf8_errors_avx2(input, prev_input);
+            if (!_mm256_testz_si256(errors, errors))
+                break;
+        }
+        n += utf8_leads_avx2(input);
+        prev_input = input;
+        pos += 32;
+    }
+    return utf8_validated_prefix(str, pos, n);
+}
+
+__attribute__((target("avx2,popcnt")))
+static size_t count_utf8_avx2(uint8_t const * str, size_t size, size_t & n) {
+    size_t pos = 0;
+    n = 0;
+    for (; pos + 32 <= size; pos += 32)
+        n += utf8_leads_avx2(_mm256_loadu_si256(reinterpret_cast<__m256i const *>(str + pos)));
+    return pos;
+}
+
+__attribute__((target("avx2,popcnt")))
+static size_t skip_utf8_avx2(uint8_t const * str, size_t size, size_t & n) {
+    size_t pos = 0;
+    for (; pos + 32 <= size; pos += 32) {
+        unsigned c = utf8_leads_avx2(_mm256_loadu_si256(reinterpret_cast<__m256i const *>(str + pos)));
+        if (c > n)
+            break;
+        n -= c;
+    }
+    return pos;
+}
+
+static bool cpu_has_sse42() {
+    unsigned a, b, c, d;
+    if (!__get_cpuid(1, &a, &b, &c, &d))
+        return false;
+    return (c & bit_SSE4_2) && (c & bit_POPCNT);
+}
+
+static bool cpu_has_avx2() {
+    unsigned a, b, c, d;
+    if (!__get_cpuid(1, &a, &b, &c, &d))
+        return false;
+    if (!(c & bit_OSXSAVE) || !(c & bit_AVX) || !(c & bit_POPCNT))
+        return false;
+    /* Check that the OS saves the AVX registers. */
+    unsigned xcr0_lo, xcr0_hi;
+    __asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+    if ((xcr0_lo & 6) != 6)
+        return false;
+    if (!__get_cpuid_count(7, 0, &a, &b, &c, &d))
+        return false;
+    return b & bit_AVX2;
+}
+#endif
+
+static utf8_kernels select_utf8_kernels() {
+    utf8_kernels scalar{scalar_kernel, scalar_kernel, scalar_skip_kernel};
+#if defined(LEAN_UTF8_SIMD)
+    char const * max = std::getenv("LEAN_UTF8_SIMD");
+    if (max && strcmp(max, "scalar") == 0)
+        return scalar;
+    if ((!max || strcmp(max, "avx2") == 0) && cpu_has_avx2())
+        return utf8_kernels{validate_utf8_avx2, count_utf8_avx2, skip_utf8_avx2};
+    if (cpu_has_sse42())
+        return utf8_kernels{validate_utf8_sse42, count_utf8_sse42, skip_utf8_sse42};
+#endif
+    return scalar;
+}
+
+static utf8_kernels const & get_utf8_kernels() {
+    static utf8_kernels kernels = select_utf8_kernels();
+    return kernels;
+}
+
 extern "C" LEAN_EXPORT size_t lean_utf8_strlen(char const * str) {
     size_t r = 0;
     while (*str != 0) {
@@ -49,10 +336,11 @@ size_t utf8_strlen(char const * str) {
 extern "C" LEAN_EXPORT size_t lean_utf8_n_strlen(char const * str, size_t sz) {
     size_t r = 0;
     size_t i = 0;
-    while (i < sz) {
-        unsigned d = get_utf8_size(str[i]);
-        r++;
-        i += d;
+    if (sz >= LEAN_UTF8_SIMD_THRESHOLD)
+        i = get_utf8_kernels().m_count(reinterpret_cast<uint8_t const *>(str), sz, r);
+    for (; i < sz; i++) {
+        if (!is_utf8_next(str[i]))
+            r++;
     }
     return r;
 }
@@ -65,17 +353,27 @@ size_t utf8_strlen(std::string const & str) {
     return utf8_strlen(str.data(), str.size());
 }
 
-optional<size_t> utf8_char_pos(char const * str, size_t char_idx) {
-    size_t r = 0;
-    while (*str != 0) {
-        if (char_idx == 0)
-            return some<size_t>(r);
-        char_idx--;
-        unsigned sz = get_utf8_size(*str);
-        r += sz;
-        str += sz;
+size_t utf8_skip_chars(char const * str, size_t size, size_t & n) {
+    size_t i = 0;
+    if (size >= LEAN_UTF8_SIMD_THRESHOLD)
+        i = get_utf8_kernels().m_skip(reinterpret_cast<uint8_t const *>(str), size, n);
+    for (; i < size; i++) {
+        if (!is_utf8_next(str[i])) {
+            if (n == 0)
+                return i;
+            n--;
+        }
     }
-    return optional<size_t>();
+    return size;
+}
+
+optional<size_t> utf8_char_pos(char const * str, size_t char_idx) {
+    size_t size = strlen(str);
+    size_t r    = utf8_skip_chars(str, size, char_idx);
+    if (r < size)
+        return some<size_t>(r);
+    else
+        return optional<size_t>();
 }
 
 char const * get_utf8_last_char(char const * str) {
@@ -268,6 +566,11 @@ bool validate_utf8_one(uint8_t const * str, size_t size, size_t & pos) {
 }
 
 bool validate_utf8(uint8_t const * str, size_t size, size_t & pos, size_t & i) {
+    if (pos + LEAN_UTF8_SIMD_THRESHOLD <= size) {
+        size_t n;
+        pos += get_utf8_kernels().m_validate(str + pos, size - pos, n);
+        i   += n;
+    }
     while (pos < size) {
         if (!validate_utf8_one(str, size, pos)) return false;
         i++;
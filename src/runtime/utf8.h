@@ -21,9 +21,15 @@ LEAN_EXPORT size_t utf8_strlen(char const * str);
    `str` may contain null characters. */
 LEAN_EXPORT size_t utf8_strlen(std::string const & str);
 /* Return the length of the string `str` encoded using UTF8.
-   `str` may contain null characters. */
+   `str` may contain null characters. If `str` is not valid UTF8, every byte that is
+   not a continuation byte is counted as a character. */
 LEAN_EXPORT size_t utf8_strlen(char const * str, size_t sz);
+/* Return the position of the character with index `char_idx` in the null terminated string `str`
+   encoded using UTF8, or `none` if `str` has at most `char_idx` characters. */
 LEAN_EXPORT optional<size_t> utf8_char_pos(char const * str, size_t char_idx);
+/* Return the position of the character with index `n` in the string `str` of size `size` encoded using UTF8.
+   If `str` has at most `n` characters, return `size` and decrease `n` by the number of characters in `str`. */
+LEAN_EXPORT size_t utf8_skip_chars(char const * str, size_t size, size_t & n);
 LEAN_EXPORT char const * get_utf8_last_char(char const * str);
 LEAN_EXPORT std::string utf8_trim(std::string const & s);
 LEAN_EXPORT unsigned utf8_to_unicode(uchar const * begin, uchar const * end);
@@ -0,0 +1,22 @@
+/-!
+Pipelines of tasks, each stage of which allocates a new list and drops the one produced by the previous stage.
+Since consecutive stages usually run on different worker threads, most objects are freed by a thread other
+than the one that allocated them.
+-/
+
+def stage (l : List Nat) : List Nat :=
+  l.map (· + 1)
+
+def pipeline (n : Nat) (numStages : Nat) : Task (List Nat) := Id.run do
+  let mut t := Task.spawn fun _ => List.range n
+  for _ in [0:numStages] do
+    t := t.map stage
+  return t
+
+def main : List String → IO UInt32
+  | [s] => do
+    let n := s.toNat!
+    let ts := (List.range 8).map fun _ => pipeline n 50
+    IO.println s!"sum: {ts.foldl (fun acc t => acc + t.get.foldl (· + ·) 0) 0}"
+    return 0
+  | _ => return 1
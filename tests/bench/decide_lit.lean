@@ -0,0 +1,40 @@
+import Lean
+open Lean Elab Command Meta
+
+/-!
+`decide` proofs over `Int`, `Fin`, `UInt64` and `BitVec` literals. The propositions are elaborated,
+and the proofs `of_decide_eq_true _ (Eq.refl true)` are added directly, so the `Decidable` instances
+are only evaluated by the kernel.
+-/
+
+def addDecideThm (declName : Name) (prop : String) : CommandElabM Unit := liftTermElabM do
+  let stx ← ofExcept <| Parser.runParserCategory (← getEnv) `term prop
+  let p ← Term.elabTerm stx (some (mkSort levelZero))
+  Term.synthesizeSyntheticMVarsNoPostponing
+  let p ← instantiateMVars p
+  let inst ← synthInstance (mkApp (mkConst ``Decidable) p)
+  addDecl <| .thmDecl {
+    name := declName, levelParams := [], type := p
+    value := mkApp3 (mkConst ``of_decide_eq_true) p inst (← mkEqRefl (toExpr true))
+  }
+
+def props (i : Nat) : List String :=
+  let a : Int := Int.ofNat (i * 7919 % 100003) - 50000
+  let b : Int := Int.ofNat (i * 104729 % 65521) - 32768
+  let x : Nat := i * 11400714819323198485 % 2^64
+  let y : Nat := (i + 1) * 14029467366897019727 % 2^64
+  let u := x.toUInt64
+  let v := y.toUInt64
+  let f := x % 1009
+  let g := y % 1009
+  [ s!"({a} : Int) * ({b}) + ({a}) / ({b}) - ({a}) % ({b}) = ({a * b + a / b - a % b})",
+    s!"({b} : Int) ^ 9 - ({a}) ^ 4 = ({b ^ 9 - a ^ 4})",
+    s!"({f} : Fin 1009) * {g} + {g} - {f} = {(f * g + g + (1009 - f)) % 1009}",
+    s!"({x} : UInt64) * {y} + ({x} ^^^ {y}) - ({y} >>> 7) = {(u * v + (u ^^^ v) - (v >>> 7)).toNat}",
+    s!"BitVec.ofNat 256 {x} * BitVec.ofNat 256 {y} * BitVec.ofNat 256 {x} - BitVec.ofNat 256 {y} = \
+       BitVec.ofNat 256 {(x * y * x + 2^256 - y) % 2^256}" ]
+
+#eval show CommandElabM Unit from do
+  for i in [0:300] do
+    for p in props i, j in [0:5] do
+      addDecideThm (Name.mkSimple s!"decide_lit_{i}_{j}") p
@@ -0,0 +1,41 @@
+/-!
+Reads a log file line by line with `IO.FS.Handle.getLine`, or all at once with `IO.FS.Handle.lines`.
+The file `get_line_<n>.tmp` with `n` lines is created first if it does not exist yet, so that it can be created
+before benchmarking by running `get_line write <n>`.
+-/
+
+def ensureFile (n : Nat) : IO System.FilePath := do
+  let file : System.FilePath := s!"get_line_{n}.tmp"
+  unless (← file.pathExists) do
+    IO.FS.withFile file .write fun h => do
+      for i in [0:n] do
+        h.putStrLn s!"2024-01-01 12:00:{i % 60} INFO request {i} handled in {i % 997} ms"
+  return file
+
+partial def readLines (h : IO.FS.Handle) (count len : Nat) : IO (Nat × Nat) := do
+  let line ← h.getLine
+  if line.isEmpty then
+    return (count, len)
+  else
+    readLines h (count + 1) (len + line.length - 1)
+
+def report (count len : Nat) : IO Unit := do
+  IO.println s!"lines: {count}"
+  IO.println s!"length: {len}"
+
+def main : List String → IO UInt32
+  | [mode, n] => do
+    let file ← ensureFile n.toNat!
+    match mode with
+    | "write" => pure ()
+    | "getLine" =>
+      let (count, len) ← IO.FS.withFile file .read fun h => readLines h 0 0
+      report count len
+    | "lines" =>
+      let lines ← IO.FS.withFile file .read fun h => h.lines
+      report lines.size (lines.foldl (· + ·.length) 0)
+    | _ => return 1
+    return 0
+  | _ => do
+    IO.println "usage: get_line (write|getLine|lines) <n>"
+    return 1
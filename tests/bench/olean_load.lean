@@ -0,0 +1,30 @@
+import Lean
+open Lean
+
+/-!
+Writes a large .olean file and reports its size and the time needed to load it. Set `LEAN_OLEAN_COMPRESSION` to
+a zstd compression level to measure compressed .olean files, which requires Lean to be built with `USE_ZSTD`.
+-/
+
+unsafe def main : List String → IO UInt32
+  | [file, n] => do
+    let (data, region) ← readModuleData file
+    let out : System.FilePath := "olean_load.tmp.olean"
+    saveModuleData out `olean_load data
+    region.free
+    if (← IO.getEnv "LEAN_OLEAN_COMPRESSION").isSome then
+      -- make sure we do not silently measure uncompressed files when zstd support is not built in
+      let header ← IO.FS.readBinFile out
+      unless header.size > 5 && header.get! 5 == 2 do
+        throw <| IO.userError "LEAN_OLEAN_COMPRESSION is set, but the file was not compressed (is Lean built with `USE_ZSTD`?)"
+    IO.println s!"size: {(← out.metadata).byteSize}"
+    let start ← IO.monoNanosNow
+    for _ in [0:n.toNat!] do
+      let (_, region) ← readModuleData out
+      region.free
+    IO.println s!"load: {(← IO.monoNanosNow) - start} ns"
+    IO.FS.removeFile out
+    return 0
+  | _ => do
+    IO.println "usage: olean_load <file.olean> <iterations>"
+    return 1
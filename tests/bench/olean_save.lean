@@ -0,0 +1,20 @@
+import Lean
+open Lean
+
+/-!
+Repeatedly compacts and writes a large .olean file. Set `LEAN_COMPACTOR_THREADS` to compact in parallel; the
+resulting file must not depend on it.
+-/
+
+def main : List String → IO UInt32
+  | [file, n] => do
+    let (data, _) ← readModuleData file
+    let out : System.FilePath := "olean_save.tmp.olean"
+    for _ in [0:n.toNat!] do
+      saveModuleData out `olean_save data
+    IO.println s!"size: {(← out.metadata).byteSize}"
+    IO.FS.removeFile out
+    return 0
+  | _ => do
+    IO.println "usage: olean_save <file.olean> <iterations>"
+    return 1
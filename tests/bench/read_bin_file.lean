@@ -0,0 +1,44 @@
+/-!
+Reads a large file with `IO.FS.readBinFile`, or maps it with `IO.FS.readBinFileMapped`, and reads one byte of
+every page. The file `read_bin_file.tmp` of the given size is created first if it does not exist yet, so that it
+can be created before benchmarking by running `read_bin_file write <MiB>`.
+-/
+
+def file : System.FilePath := "read_bin_file.tmp"
+def chunkSize := 1024 * 1024
+def pageSize := 4096
+
+def ensureFile (mib : Nat) : IO Unit := do
+  if (← file.pathExists) then
+    if (← file.metadata).byteSize == (mib * chunkSize).toUInt64 then
+      return
+  let chunk := ByteArray.mk <| (Array.range chunkSize).map fun i => (i % 251).toUInt8
+  IO.FS.withFile file .write fun h => do
+    for _ in [0:mib] do
+      h.write chunk
+
+def main : List String → IO UInt32
+  | [mode, mib] => do
+    let mib := mib.toNat!
+    ensureFile mib
+    match mode with
+    | "write" => pure ()
+    | "read" =>
+      let bytes ← IO.FS.readBinFile file
+      let mut sum := 0
+      for i in [0:bytes.size:pageSize] do
+        sum := sum + (bytes.get! i).toNat
+      IO.println s!"size: {bytes.size}"
+      IO.println s!"checksum: {sum}"
+    | "mapped" =>
+      let m ← IO.FS.readBinFileMapped file
+      let mut sum := 0
+      for i in [0:m.size:pageSize] do
+        sum := sum + (m.get! i).toNat
+      IO.println s!"size: {m.size}"
+      IO.println s!"checksum: {sum}"
+    | _ => return 1
+    return 0
+  | _ => do
+    IO.println "usage: read_bin_file (write|read|mapped) <MiB>"
+    return 1
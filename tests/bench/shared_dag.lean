@@ -0,0 +1,38 @@
+import Lean
+open Lean
+
+/-!
+Kernel traversals on a deeply shared term. Layer `i + 1` of the term has `width` nodes, and node `j`
+of that layer is `f x_j x_(j+1)`, where `x` is layer `i`. Each node is shared by two parents, and the
+term has more shared subterms than the initial capacity of the `replace` and `expr_eq_fn` caches,
+so any subterm evicted from these caches is visited again once per path reaching it.
+-/
+
+def f : Expr := mkConst `f
+
+def mkLayer (xs : Array Expr) : Array Expr := Id.run do
+  let mut ys := Array.mkEmpty xs.size
+  for j in [0:xs.size] do
+    ys := ys.push (mkApp2 f xs[j]! xs[(j + 1) % xs.size]!)
+  return ys
+
+def mkDag (width depth : Nat) : Expr := Id.run do
+  let mut xs := (Array.range width).map fun j => mkApp2 f (.bvar 0) (mkNatLit j)
+  for _ in [0:depth] do
+    xs := mkLayer xs
+  return xs.foldl (mkApp2 f) (mkNatLit width)
+
+def main (args : List String) : IO Unit := do
+  let width := (args.get? 0 >>= String.toNat?).getD 20000
+  let depth := (args.get? 1 >>= String.toNat?).getD 24
+  let e := mkDag width depth
+  let start ← IO.monoNanosNow
+  for _ in [0:10] do
+    -- `liftLooseBVars` and `lowerLooseBVars` use `replace`, and return a copy of `e` that is not pointer equal to it
+    let e' := (e.liftLooseBVars 0 1).lowerLooseBVars 1 1
+    unless e.eqv e' do
+      throw <| IO.userError "unexpected result"
+    unless (e.instantiate1 (mkConst `a)).hasLooseBVars == false do
+      throw <| IO.userError "unexpected result"
+  let secs := ((← IO.monoNanosNow) - start).toFloat / 1e9
+  IO.println s!"shared DAG with {width * depth} nodes traversed in {secs} s"
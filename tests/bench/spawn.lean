@@ -0,0 +1,20 @@
+/-!
+Spawns and waits for `n` trivial processes while holding `mib` MiB of heap, to measure how the latency of
+`IO.Process.spawn` depends on the size of the parent process.
+Run with `LEAN_PROCESS_SPAWN=fork` to benchmark `fork`/`exec` instead of `posix_spawn`.
+-/
+
+def main : List String → IO UInt32
+  | [mib, n] => do
+    -- 8 bytes per element
+    let ballast := Array.mkArray (mib.toNat! * 131072) (0 : Nat)
+    for _ in [0:n.toNat!] do
+      let child ← IO.Process.spawn { cmd := "true" }
+      unless (← child.wait) == 0 do
+        return 1
+    IO.println s!"ballast: {ballast.size}"
+    IO.println s!"spawned: {n}"
+    return 0
+  | _ => do
+    IO.println "usage: spawn <MiB> <n>"
+    return 1
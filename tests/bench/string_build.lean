@@ -0,0 +1,23 @@
+/-!
+Building and slicing large strings as the pretty printer and message formatting do: renders a large
+`Format`, splits the result into lines, joins them again, and takes suffixes of the result.
+-/
+
+def doc (n : Nat) : Std.Format :=
+  .nest 2 <| .joinSep ((List.range n).map fun i => s!"item{i % 10}") .line
+
+def main : List String → IO UInt32
+  | [s] => do
+    let n := s.toNat!
+    let text := (doc n).pretty
+    IO.println s!"pretty: {text.length}"
+    let lines := (text.splitOn "\n").map (·.trimLeft)
+    IO.println s!"lines: {lines.length}, {lines.foldl (fun acc l => acc + l.length) 0}"
+    let joined := "\n".intercalate lines
+    IO.println s!"joined: {joined.length}"
+    let mut len := 0
+    for i in [0:100] do
+      len := len + (text.toSubstring.drop i).toString.length
+    IO.println s!"suffixes: {len}"
+    return 0
+  | _ => return 1
@@ -0,0 +1,27 @@
+/-!
+Returns large structures from tasks and thunks. Task results are marked as multi-threaded by the worker
+that computed them, thunk results only if the thunk is shared with other threads.
+-/
+
+inductive Tree where
+  | leaf
+  | node (l : Tree) (v : Nat) (r : Tree)
+
+def Tree.build : Nat → Nat → Tree
+  | 0,   _ => .leaf
+  | d+1, v => .node (build d (2*v)) v (build d (2*v+1))
+
+def Tree.sum : Tree → Nat
+  | .leaf       => 0
+  | .node l v r => l.sum + v + r.sum
+
+def main : List String → IO UInt32
+  | [n, d] => do
+    let n := n.toNat!
+    let d := d.toNat!
+    let ts := (List.range n).map fun i => Task.spawn fun _ => Tree.build d (i+1)
+    IO.println s!"tasks: {ts.foldl (fun acc t => acc + t.get.sum) 0}"
+    let ts := (List.range 4).map fun i => Thunk.mk fun _ => Tree.build (d+2) (i+1)
+    IO.println s!"thunks: {ts.foldl (fun acc t => acc + t.get.sum) 0}"
+    return 0
+  | _ => return 1
@@ -0,0 +1,31 @@
+/-!
+Spawns, maps and joins many tiny tasks to measure the overhead of the task manager.
+Run with `LEAN_TASK_SCHEDULER=work_stealing` to benchmark the work-stealing scheduler.
+-/
+
+def spawnAll (n : Nat) (prio := Task.Priority.default) : Array (Task Nat) := Id.run do
+  let mut ts := Array.mkEmpty n
+  for i in [0:n] do
+    ts := ts.push (Task.spawn (prio := prio) fun _ => i)
+  return ts
+
+def sumAll (ts : Array (Task Nat)) : Nat :=
+  ts.foldl (fun acc t => acc + t.get) 0
+
+def main : List String → IO UInt32
+  | [s] => do
+    let n := s.toNat!
+    -- independent tasks spawned from the main thread
+    let ts := spawnAll n
+    IO.println s!"spawn: {sumAll ts}"
+    -- short chains of dependent tasks
+    let ms := ts.map fun t => (t.map (· + 1)).map (· * 2)
+    IO.println s!"map: {sumAll ms}"
+    -- all non-dedicated priorities at once
+    let ps := (Array.range (Task.Priority.max + 1)).map fun p => spawnAll (n / (Task.Priority.max + 1)) (prio := p)
+    IO.println s!"prio: {ps.foldl (fun acc ts => acc + sumAll ts) 0}"
+    -- tasks spawned from within tasks, i.e. by worker threads
+    let outer := (Array.range 64).map fun _ => Task.spawn fun _ => spawnAll (n / 64)
+    IO.println s!"nested: {outer.foldl (fun acc t => acc + sumAll t.get) 0}"
+    return 0
+  | _ => return 1
@@ -0,0 +1,19 @@
+/-!
+Alternates between phases that allocate a large list and phases that only use a small amount of memory,
+calling `IO.trimHeap` in between. Segments freed after a large phase are returned to the OS, so this
+measures the cost of releasing and later reacquiring them.
+-/
+
+def phase (n : Nat) : Nat :=
+  (List.range n).foldl (· + ·) 0
+
+def main : List String → IO UInt32
+  | [s] => do
+    let n := s.toNat!
+    let mut acc := 0
+    for i in [0:20] do
+      acc := acc + phase (if i % 2 == 0 then n else n / 100)
+      IO.trimHeap
+    IO.println s!"sum: {acc}"
+    return 0
+  | _ => return 1
@@ -0,0 +1,54 @@
+/-!
+  Universe polymorphic definitions used at a few fixed universe levels.
+  Type checking the theorems below unfolds the same constants at the same
+  universe instantiation many times. -/
+
+universe u v w
+
+def idf {α : Sort u} (a : α) : α := a
+
+def comp {α : Sort u} {β : Sort v} {γ : Sort w} (f : β → γ) (g : α → β) : α → γ :=
+  fun a => f (g a)
+
+def f0 {α : Sort u} : α → α := idf
+def f1 {α : Sort u} : α → α := comp (@f0 α) (@f0 α)
+def f2 {α : Sort u} : α → α := comp (@f1 α) (@f1 α)
+def f3 {α : Sort u} : α → α := comp (@f2 α) (@f2 α)
+def f4 {α : Sort u} : α → α := comp (@f3 α) (@f3 α)
+def f5 {α : Sort u} : α → α := comp (@f4 α) (@f4 α)
+def f6 {α : Sort u} : α → α := comp (@f5 α) (@f5 α)
+def f7 {α : Sort u} : α → α := comp (@f6 α) (@f6 α)
+def f8 {α : Sort u} : α → α := comp (@f7 α) (@f7 α)
+def f9 {α : Sort u} : α → α := comp (@f8 α) (@f8 α)
+def f10 {α : Sort u} : α → α := comp (@f9 α) (@f9 α)
+def f11 {α : Sort u} : α → α := comp (@f10 α) (@f10 α)
+def f12 {α : Sort u} : α → α := comp (@f11 α) (@f11 α)
+
+theorem f6_nat (a : Nat) : f6 a = a := rfl
+theorem f6_type (a : Type) : f6 a = a := rfl
+theorem f6_prop (p : Prop) (h : p) : f6 h = h := rfl
+theorem f6_list (a : List (Type 2)) : f6 a = a := rfl
+theorem f7_nat (a : Nat) : f7 a = a := rfl
+theorem f7_type (a : Type) : f7 a = a := rfl
+theorem f7_prop (p : Prop) (h : p) : f7 h = h := rfl
+theorem f7_list (a : List (Type 2)) : f7 a = a := rfl
+theorem f8_nat (a : Nat) : f8 a = a := rfl
+theorem f8_type (a : Type) : f8 a = a := rfl
+theorem f8_prop (p : Prop) (h : p) : f8 h = h := rfl
+theorem f8_list (a : List (Type 2)) : f8 a = a := rfl
+theorem f9_nat (a : Nat) : f9 a = a := rfl
+theorem f9_type (a : Type) : f9 a = a := rfl
+theorem f9_prop (p : Prop) (h : p) : f9 h = h := rfl
+theorem f9_list (a : List (Type 2)) : f9 a = a := rfl
+theorem f10_nat (a : Nat) : f10 a = a := rfl
+theorem f10_type (a : Type) : f10 a = a := rfl
+theorem f10_prop (p : Prop) (h : p) : f10 h = h := rfl
+theorem f10_list (a : List (Type 2)) : f10 a = a := rfl
+theorem f11_nat (a : Nat) : f11 a = a := rfl
+theorem f11_type (a : Type) : f11 a = a := rfl
+theorem f11_prop (p : Prop) (h : p) : f11 h = h := rfl
+theorem f11_list (a : List (Type 2)) : f11 a = a := rfl
+theorem f12_nat (a : Nat) : f12 a = a := rfl
+theorem f12_type (a : Type) : f12 a = a := rfl
+theorem f12_prop (p : Prop) (h : p) : f12 h = h := rfl
+theorem f12_list (a : List (Type 2)) : f12 a = a := rfl
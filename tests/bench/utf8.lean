@@ -0,0 +1,31 @@
+import Lean.Data.Lsp.Utf16
+
+/-!
+UTF-8 primitives on a large string: validation and conversion with `String.fromUTF8?`, counting characters
+with `String.extract`, and converting codepoint indices into byte offsets with
+`String.codepointPosToUtf8PosFrom` as the language server does.
+Run with `LEAN_UTF8_SIMD=scalar` to benchmark the scalar implementations.
+-/
+
+def line : String := "def foo (α : Type) (x : α) : α := x -- λ → ∀ 英語 𐍈\n"
+
+def main : List String → IO UInt32
+  | [s] => do
+    let n := s.toNat!
+    let text := String.join (List.replicate n line)
+    let bytes := text.toUTF8
+    let mut len := 0
+    for _ in [0:20] do
+      let some t := String.fromUTF8? bytes | return 1
+      len := len + t.length
+    IO.println s!"fromUTF8?: {len}"
+    let mut len := 0
+    for i in [0:8] do
+      len := len + (text.extract ⟨i⟩ text.endPos).length
+    IO.println s!"extract: {len}"
+    let mut sum := 0
+    for i in [0:100] do
+      sum := sum + (text.codepointPosToUtf8PosFrom 0 (i * text.length / 100)).byteIdx
+    IO.println s!"codepointPosToUtf8PosFrom: {sum}"
+    return 0
+  | _ => return 1
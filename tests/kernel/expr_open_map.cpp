@@ -0,0 +1,77 @@
+/*
+Copyright (c) 2026 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: agent
+*/
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <unordered_map>
+#include "kernel/expr_open_map.h"
+
+/* Differential test of `open_hash_map` against `std::unordered_map`, using keys whose hash codes collide
+   often, so that long probe sequences, wraparound at the end of the slot array, growth and `clear` are
+   exercised. Only the generic template is used, so no Lean object needs to be created. */
+
+using namespace lean;
+
+#define check(c) do { if (!(c)) { std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #c "\n"; std::exit(1); } } while (0)
+
+struct colliding_key_ops {
+    /* Only 16 different hash codes, all with the same low bits. */
+    static unsigned hash(unsigned k) { return (k % 16) << 20; }
+    static bool eq(unsigned a, unsigned b) { return a == b; }
+};
+
+struct identity_key_ops {
+    static unsigned hash(unsigned k) { return k; }
+    static bool eq(unsigned a, unsigned b) { return a == b; }
+};
+
+template<typename KeyOps>
+static void run(unsigned seed, unsigned num_ops, unsigned key_range) {
+    std::mt19937 rng(seed);
+    open_hash_map<unsigned, unsigned, KeyOps> m;
+    std::unordered_map<unsigned, unsigned> ref;
+    for (unsigned i = 0; i < num_ops; i++) {
+        unsigned k = rng() % key_range;
+        unsigned op = rng() % 100;
+        if (op < 50) {
+            unsigned v = rng();
+            auto r = m.insert(std::make_pair(k, v));
+            auto s = ref.insert(std::make_pair(k, v));
+            check(r.second == s.second);
+            /* An existing entry is not overwritten. */
+            check(r.first->first == k && r.first->second == s.first->second);
+        } else if (op < 99) {
+            auto it = m.find(k);
+            auto s  = ref.find(k);
+            check((it == m.end()) == (s == ref.end()));
+            if (it != m.end())
+                check(it->first == k && it->second == s->second);
+        } else {
+            m.clear();
+            ref.clear();
+            check(m.find(k) == m.end());
+        }
+        check(m.size() == ref.size());
+        check(m.empty() == ref.empty());
+    }
+    /* Every entry of the reference map is found after all the growth steps. */
+    for (auto const & p : ref) {
+        auto it = m.find(p.first);
+        check(it != m.end() && it->second == p.second);
+    }
+}
+
+int main() {
+    for (unsigned seed = 0; seed < 4; seed++) {
+        run<colliding_key_ops>(seed, 20000, 300);
+        run<identity_key_ops>(seed, 200000, 100000);
+        /* Consecutive keys fill consecutive slots, so probe sequences wrap around the end of the array. */
+        run<identity_key_ops>(seed, 20000, 64);
+    }
+    std::cout << "ok\n";
+    return 0;
+}
@@ -0,0 +1,71 @@
+/*
+Copyright (c) 2026 Lean FRO, LLC. All rights reserved.
+Released under Apache 2.0 license as described in the file LICENSE.
+
+Author: agent
+*/
+#include <cstdlib>
+#include <iostream>
+#include "kernel/growable_cache.h"
+
+/* Growth policy of `growable_cache`: traversals of trees, which never hit the cache, must not make it grow,
+   while traversals of terms with shared subterms must. */
+
+using namespace lean;
+
+#define check(c) do { if (!(c)) { std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #c "\n"; std::exit(1); } } while (0)
+
+struct entry {
+    unsigned m_key;
+    unsigned m_hash;
+    entry():m_key(0) {}
+    entry(unsigned k):m_key(k), m_hash(k * 2654435761u) {}
+    bool empty() const { return m_key == 0; }
+    void reset() { m_key = 0; }
+};
+
+static growable_cache_stats g_stats("test");
+
+/* Look up `k`, inserting it if it is not in the cache as the traversals in the kernel do. */
+static bool visit(growable_cache<entry> & c, unsigned k) {
+    entry e(k);
+    entry & r = c.get(e.m_hash);
+    if (r.m_key == k) {
+        c.record_hit();
+        return true;
+    }
+    c.insert(std::move(e));
+    return false;
+}
+
+/* Visit the nodes of a binary DAG of the given depth where node `(i, j)` has children `(i + 1, j)` and
+   `(i + 1, j + 1)`, as a traversal that does not revisit cached nodes does. Return the number of visits. */
+static unsigned long visit_dag(growable_cache<entry> & c, unsigned i, unsigned j, unsigned depth) {
+    if (visit(c, 1 + i * (depth + 1) + j) || i == depth)
+        return 1;
+    return 1 + visit_dag(c, i + 1, j, depth) + visit_dag(c, i + 1, j + 1, depth);
+}
+
+int main() {
+    unsigned const initial = 1024;
+    {
+        growable_cache<entry> c(initial, g_stats);
+        /* A tree: every key is visited once. */
+        for (unsigned k = 1; k <= 100 * initial; k++)
+            check(!visit(c, k));
+        check(c.capacity() == initial);
+    }
+    {
+        growable_cache<entry> c(initial, g_stats);
+        /* The DAG has `(depth + 1) * (depth + 2) / 2` nodes, more than the initial capacity, and
+           `2^(depth + 1) - 1` paths. */
+        unsigned const depth = 200;
+        unsigned long visits = visit_dag(c, 0, 0, depth);
+        check(c.capacity() > initial);
+        check(visits < 4ul * (depth + 1) * (depth + 2));
+        c.clear();
+        check(c.capacity() == initial);
+    }
+    std::cout << "ok\n";
+    return 0;
+}
@@ -138,3 +138,54 @@ check_eq "2" [] ys.toList
 /-- info: -/
 #guard_msgs in
 #eval test4
+
+def test5 : IO Unit := do
+let fn5 := "foo5.txt"
+let xs : ByteArray := ⟨#[1,2,3,4,5,6,7,8]⟩
+writeBinFile fn5 xs
+let m ← readBinFileMapped fn5
+check_eq "1" 8 m.size
+check_eq "2" xs.toList m.toByteArray.toList
+check_eq "3" [3,4,5] (m.extract 2 5).toList
+check_eq "4" [7,8] (m.extract 6 100).toList
+check_eq "5" [] (m.extract 5 2).toList
+check_eq "6" 4 (m.get! 3)
+check_eq "7" 8 (m.get! 7)
+let fn6 := "foo6.txt"
+writeBinFile fn6 ByteArray.empty
+let m ← readBinFileMapped fn6
+check_eq "8" 0 m.size
+check_eq "9" [] m.toByteArray.toList
+
+/-- info: -/
+#guard_msgs in
+#eval test5
+
+def test6 : IO Unit := do
+let fn7 := "foo7.txt"
+writeFile fn7 "abc\ndef"
+check_eq "1" #["abc", "def"] (← lines fn7)
+writeFile fn7 "abc\r\ndef\r\n"
+let crlf := if System.Platform.isWindows then #["abc", "def"] else #["abc\r", "def\r"]
+check_eq "2" crlf (← lines fn7)
+-- lines are truncated at the first NUL character, the following lines are still read
+-- (`writeBinFile` is used since `writeFile` stops at the first NUL character)
+writeBinFile fn7 "a\x00b\n\x00\nc\n".toUTF8
+check_eq "3" #["a", "", "c"] (← lines fn7)
+withFile fn7 Mode.read fun h => do
+  check_eq "4" "a" (← h.getLine)
+  check_eq "5" "" (← h.getLine)
+  check_eq "6" "c\n" (← h.getLine)
+  check_eq "7" "" (← h.getLine)
+-- the line buffer is released after very long lines
+let long := String.mk (List.replicate 100000 'x')
+writeFile fn7 (long ++ "\nabc\n" ++ long)
+check_eq "8" #[long, "abc", long] (← lines fn7)
+withFile fn7 Mode.read fun h => do
+  check_eq "9" (long ++ "\n") (← h.getLine)
+  check_eq "10" "abc\n" (← h.getLine)
+  check_eq "11" long (← h.getLine)
+
+/-- info: -/
+#guard_msgs in
+#eval test6
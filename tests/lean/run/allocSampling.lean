@@ -0,0 +1,26 @@
+import Lean.Data.Json
+open Lean
+
+def assertBEq [BEq α] [ToString α] (caption : String) (actual expected : α) : IO Unit := do
+  unless actual == expected do
+    throw <| IO.userError <|
+      s!"{caption}: expected '{expected}', got '{actual}'"
+
+def test (n : Nat) : IO Unit := do
+  IO.setAllocSampling 1 false
+  let xs := (List.range n).map (· + 1)
+  assertBEq "length" xs.length n
+  IO.setAllocSampling 0 false
+  let json ← IO.ofExcept <| Json.parse (← IO.getAllocSamples)
+  assertBEq "sample_rate" (json.getObjValAs? Nat "sample_rate").toOption (some 1)
+  let .ok (tags : Array Json) := json.getObjValAs? (Array Json) "tags" | throw <| IO.userError "tags"
+  let ctors := tags.filter fun t => (t.getObjValAs? String "kind").toOption == some "ctor"
+  let allocated := ctors.foldl (fun acc t => acc + (t.getObjValAs? Nat "allocated").toOption.getD 0) 0
+  unless allocated ≥ xs.length do
+    throw <| IO.userError s!"expected at least {xs.length} sampled constructors, got {allocated}"
+  -- blocks that are not Lean objects are not reported by tag
+  let .ok nonObjs := json.getObjVal? "non_objects" | throw <| IO.userError "non_objects"
+  let .ok (_ : Nat) := nonObjs.getObjValAs? Nat "allocated" | throw <| IO.userError "non_objects.allocated"
+  IO.trimHeap
+
+#eval test 1000
@@ -0,0 +1,23 @@
+import Lean
+open Lean
+
+/-!
+The kernel caches instantiations of universe polymorphic constants. Such constants from imported modules live in
+compacted regions, so their cached instantiations must not survive `Environment.freeRegions`. We import modules,
+type check declarations using universe polymorphic constants at fixed levels, free the regions, and do it again.
+-/
+
+def recheckDecls : List Name := [``List.map_map, ``List.length_append, ``Prod.ext, ``List.append_assoc]
+
+unsafe def checkAfterImport : IO Unit := do
+  for _ in [0:3] do
+    withImportModules #[{ module := `Init }] {} 0 fun env => do
+      for n in recheckDecls do
+        let some info := env.find? n | throw <| IO.userError s!"unknown constant {n}"
+        let decl := Declaration.thmDecl {
+          name := n ++ `recheck, levelParams := info.levelParams, type := info.type, value := info.value! }
+        match env.addDecl {} decl with
+        | .ok _ => pure ()
+        | .error _ => throw <| IO.userError s!"failed to recheck {n}"
+
+#eval checkAfterImport
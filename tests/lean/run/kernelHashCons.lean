@@ -0,0 +1,40 @@
+/-!
+The kernel hash-consing mode (see `LEAN_KERNEL_HASH_CONS`) must not change which declarations are accepted.
+We use a tiny table in a child process so that its shards are flushed all the time.
+-/
+
+def kernelHashConsChild := "
+import Lean
+open Lean Meta
+
+def hashConsF (n : Nat) : Nat := (List.range n).foldl (· + ·) 0
+theorem hashCons1 : hashConsF 30 = 435 := by decide
+theorem hashCons2 (xs ys : List Nat) : (xs ++ ys).length = ys.length + xs.length := by
+  rw [List.length_append, Nat.add_comm]
+example : (fun (x : Nat) => x + 0) = (fun y => y) := rfl
+
+run_meta do
+  let type ← mkEq (mkApp (mkConst ``hashConsF) (mkNatLit 30)) (mkNatLit 436)
+  let decl := Declaration.thmDecl {
+    name := `hashCons3, levelParams := [], type, value := (← mkDecideProof type) }
+  match (← getEnv).addDecl {} decl with
+  | .ok _ => throwError \"declaration should have been rejected\"
+  | .error _ => IO.println \"rejected\"
+"
+
+#eval show IO Unit from do
+  let fname := "kernelHashConsChild.lean"
+  IO.FS.writeFile fname kernelHashConsChild
+  let out ← IO.Process.output {
+    cmd := (← IO.appPath).toString, args := #[fname],
+    env := #[("LEAN_KERNEL_HASH_CONS", some "64"), ("LEAN_KERNEL_HASH_CONS_STATS", some "1")] }
+  IO.FS.removeFile fname
+  unless out.exitCode == 0 && out.stdout == "rejected\n" do
+    throw <| IO.userError s!"unexpected result: {out.exitCode}, {out.stdout}, {out.stderr}"
+  -- make sure shards were flushed
+  let some line := out.stderr.splitOn "\n" |>.find? (·.startsWith "kernel hash-cons table: ")
+    | throw <| IO.userError s!"missing hash-cons statistics: {out.stderr}"
+  let some flushes := (line.splitOn ", ").find? (·.endsWith " flushed shards")
+    | throw <| IO.userError s!"unexpected statistics: {line}"
+  unless (flushes.takeWhile Char.isDigit).toNat! > 0 do
+    throw <| IO.userError s!"no shard was flushed: {line}"
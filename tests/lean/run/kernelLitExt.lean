@@ -0,0 +1,168 @@
+import Lean
+
+/-!
+Kernel reduction of `Int`, `Fin`, `UIntN` and `BitVec` operations on literals.
+The expected values match the definitions in `Init`, including the edge cases.
+
+`#check_lit a = b` checks that a single `Kernel.whnf` call reduces `a` to a literal value, which only happens
+when the extension is used: unfolding the operations produces unreduced arguments such as `(3 + 4) % 5`. It also
+checks that the kernel considers `a` and `b` definitionally equal. `#check_lit a ≠ b` checks that they are not.
+-/
+
+open Lean Meta Elab
+
+def isLitValue (e : Expr) : Bool :=
+  match e.getAppFnArgs with
+  | (``Int.ofNat, #[.lit (.natVal _)]) => true
+  | (``Int.negSucc, #[.lit (.natVal _)]) => true
+  | (``Fin.mk, #[.lit (.natVal _), .lit (.natVal _), h]) => h.isAppOf ``of_decide_eq_true
+  | (``BitVec.ofFin, #[.lit (.natVal _), v]) => isLitValue v
+  | (``UInt8.mk, #[v]) | (``UInt16.mk, #[v]) | (``UInt32.mk, #[v]) | (``UInt64.mk, #[v]) => isLitValue v
+  | _ => false
+
+elab "#check_lit " t:term : command => Command.liftTermElabM do
+  let e ← Term.elabTerm t (mkSort .zero)
+  Term.synthesizeSyntheticMVarsNoPostponing
+  let e ← instantiateMVars e
+  let env ← getEnv
+  let isDefEq (a b : Expr) : TermElabM Bool := do
+    match Kernel.isDefEq env {} a b with
+    | .ok r => pure r
+    | .error ex => throwKernelException ex
+  match e.getAppFnArgs with
+  | (``Eq, #[_, a, b]) =>
+    match Kernel.whnf env {} a with
+    | .ok r => unless isLitValue r do throwError "not reduced to a literal value: {r}"
+    | .error ex => throwKernelException ex
+    unless (← isDefEq a b) do throwError "kernel rejected {e}"
+  | (``Ne, #[_, a, b]) =>
+    if (← isDefEq a b) then throwError "kernel accepted {a} = {b}"
+  | _ => throwError "expected `a = b` or `a ≠ b`"
+
+#check_lit (7 : Int) + -10 = -3
+#check_lit (-7 : Int) - -10 = 3
+#check_lit (-7 : Int) * -6 = 42
+#check_lit -(-7 : Int) = 7
+#check_lit (-7 : Int) / 2 = -4
+#check_lit (-7 : Int) % 2 = 1
+#check_lit (7 : Int) / -2 = -3
+#check_lit Int.div (-7) 2 = -3
+#check_lit Int.div (-7) 2 ≠ -4
+#check_lit Int.mod (-7) 2 = -1
+#check_lit Int.mod (-7) 2 ≠ 1
+#check_lit (-2 : Int) ^ 7 = -128
+#check_lit (-2 : Int) ^ 0 = 1
+#check_lit (-2 : Int) ^ 7 ≠ 128
+#check_lit (2 : Int) ^ 64 * 2 ^ 64 = 340282366920938463463374607431768211456
+#check_lit (2 : Int) ^ 64 * 2 ^ 64 ≠ 0
+
+/-! Division and modulus by zero. -/
+#check_lit (-7 : Int) / 0 = 0
+#check_lit (-7 : Int) % 0 = -7
+#check_lit Int.div (-7) 0 = 0
+#check_lit Int.mod (-7) 0 = -7
+#check_lit (-7 : Int) / 0 ≠ -7
+#check_lit (4 : Fin 5) / 0 = 0
+#check_lit (4 : Fin 5) % 0 = 4
+#check_lit (7 : UInt8) / 0 = 0
+#check_lit (7 : UInt8) % 0 = 7
+#check_lit (7 : UInt64) / 0 = 0
+#check_lit (7 : UInt64) / 0 ≠ 7
+#check_lit BitVec.udiv (7#4) 0#4 = 0#4
+#check_lit BitVec.umod (7#4) 0#4 = 7#4
+
+#check_lit (3 : Fin 5) + 4 = 2
+#check_lit (1 : Fin 5) - 3 = 3
+#check_lit (3 : Fin 5) * 4 = 2
+#check_lit (3 : Fin 5) * 4 ≠ 12
+
+#check_lit (200 : UInt8) + 100 = 44
+#check_lit (3 : UInt8) - 5 = 254
+#check_lit (0xF0 : UInt8) ^^^ 0xFF = 0x0F
+
+/-! `UInt64` wraparound. -/
+#check_lit (0xFFFFFFFFFFFFFFFF : UInt64) + 2 = 1
+#check_lit (0xFFFFFFFFFFFFFFFF : UInt64) + 2 ≠ 0
+#check_lit (0 : UInt64) - 1 = 0xFFFFFFFFFFFFFFFF
+#check_lit (0 : UInt64) - 1 ≠ 0
+#check_lit (0xFFFFFFFFFFFFFFFF : UInt64) * 0xFFFFFFFFFFFFFFFF = 1
+#check_lit (0x100000000 : UInt64) * 0x100000000 = 0
+#check_lit (0x100000000 : UInt64) * 0x100000000 ≠ 1
+
+/-! Shifts by at least the width: `UIntN` shifts take the amount modulo `N`, `BitVec` shifts do not. -/
+#check_lit (1 : UInt8) <<< 9 = 2
+#check_lit (1 : UInt8) <<< 9 ≠ 0
+#check_lit (128 : UInt8) >>> 15 = 1
+#check_lit (1 : UInt64) <<< 64 = 1
+#check_lit (1 : UInt64) <<< 64 ≠ 0
+#check_lit (0x8000000000000000 : UInt64) >>> 127 = 1
+#check_lit (0b1100#4) <<< 3 = 0#4
+#check_lit (0b1100#4) <<< 4 = 0#4
+#check_lit (0b1100#4) <<< 4 ≠ 0b1100#4
+#check_lit (0b1100#4) >>> 2 = 0b0011#4
+#check_lit (0b1100#4) >>> 7 = 0#4
+
+#check_lit (5#8) + 255#8 = 4#8
+#check_lit (5#8) - 6#8 = 255#8
+#check_lit (0b1100#4) &&& 0b1010#4 = 0b1000#4
+#check_lit (0b1100#4) ||| 0b1010#4 = 0b1110#4
+
+/-! `BitVec` widths above 64. -/
+#check_lit -(1#128) = BitVec.ofNat 128 (2^128 - 1)
+#check_lit -(1#128) ≠ BitVec.ofNat 128 (2^64 - 1)
+#check_lit (1#65) <<< 64 = BitVec.ofNat 65 (2^64)
+#check_lit (1#65) <<< 64 ≠ 0#65
+#check_lit BitVec.ofNat 128 (2^64) * BitVec.ofNat 128 (2^64) = 0#128
+#check_lit BitVec.ofNat 128 (2^64) * BitVec.ofNat 128 (2^63) ≠ 0#128
+#check_lit BitVec.ofNat 100 (2^99) + BitVec.ofNat 100 (2^99) = 0#100
+#check_lit BitVec.ofNat 100 (2^99) + BitVec.ofNat 100 (2^99) ≠ BitVec.ofNat 100 (2^64)
+
+theorem int_pow_40 : (-3 : Int) ^ 40 = 12157665459056928801 := by decide
+
+/-- info: 'int_pow_40' does not depend on any axioms -/
+#guard_msgs in
+#print axioms int_pow_40
+
+/-!
+The following declarations are only accepted because of the extension: unfolding `Int.pow` performs one
+step per unit of the exponent, which exceeds the heartbeat budget. They bypass `decide`, which reduces the
+instance using `Meta.whnf` before the kernel sees the proof, and are checked in a new task, which starts
+with a fresh heartbeat counter.
+-/
+
+def addRflThm (declName : Name) (lhs rhs : Expr) : MetaM Unit := do
+  let decl := Declaration.thmDecl {
+    name := declName, levelParams := [], type := ← mkEq lhs rhs, value := ← mkEqRefl lhs }
+  let env ← getEnv
+  let t := Task.spawn fun _ => env.addDeclCore 10000 decl none
+  match t.get with
+  | .ok env => setEnv env
+  | .error ex => throwKernelException ex
+
+run_meta addRflThm `int_pow_big
+  (mkApp2 (mkConst ``Int.pow) (toExpr (2 : Int)) (mkNatLit 100000))
+  (toExpr (Int.ofNat (2 ^ 100000)))
+
+run_meta addRflThm `int_pow_big_neg
+  (mkApp2 (mkConst ``Int.pow) (toExpr (-3 : Int)) (mkNatLit 50001))
+  (toExpr (-Int.ofNat (3 ^ 50001)))
+
+/-- info: 'int_pow_big' does not depend on any axioms -/
+#guard_msgs in
+#print axioms int_pow_big
+
+/-- info: 'int_pow_big_neg' does not depend on any axioms -/
+#guard_msgs in
+#print axioms int_pow_big_neg
+
+/-! A wrong result must be rejected when the declaration is checked. -/
+
+run_meta do
+  let accepted ← try
+      addRflThm `int_pow_big_wrong
+        (mkApp2 (mkConst ``Int.pow) (toExpr (2 : Int)) (mkNatLit 100000))
+        (toExpr (Int.ofNat (2 ^ 100000 + 1)))
+      pure true
+    catch _ => pure false
+  if accepted then
+    throwError "wrong result was accepted"
@@ -0,0 +1,38 @@
+/-!
+The kernel cache shared across declarations (see `LEAN_KERNEL_SHARED_CACHE`) must not change which declarations
+are accepted. We check two declarations sharing closed subterms over imported constants in a child process with
+the cache enabled, followed by one that reuses those subterms but must be rejected.
+-/
+
+def kernelSharedCacheChild := "
+import Lean
+open Lean Meta
+
+theorem sharedCache1 : (List.range 40).length = 40 := by decide
+theorem sharedCache2 : (List.range 40).length + 0 = 40 := by decide
+
+run_meta do
+  let type := mkApp3 (mkConst ``Eq [1]) (mkConst ``Nat)
+    (mkApp (mkConst ``List.length [0]) (mkApp (mkConst ``List.range) (mkNatLit 40))) (mkNatLit 41)
+  let decl := Declaration.thmDecl {
+    name := `sharedCache3, levelParams := [], type, value := (← mkDecideProof type) }
+  match (← getEnv).addDecl {} decl with
+  | .ok _ => throwError \"declaration should have been rejected\"
+  | .error _ => IO.println \"rejected\"
+"
+
+#eval show IO Unit from do
+  let fname := "kernelSharedCacheChild.lean"
+  IO.FS.writeFile fname kernelSharedCacheChild
+  let out ← IO.Process.output {
+    cmd := (← IO.appPath).toString, args := #[fname],
+    env := #[("LEAN_KERNEL_SHARED_CACHE", some "1000"), ("LEAN_KERNEL_SHARED_CACHE_STATS", some "1")] }
+  IO.FS.removeFile fname
+  unless out.exitCode == 0 && out.stdout == "rejected\n" do
+    throw <| IO.userError s!"unexpected result: {out.exitCode}, {out.stdout}, {out.stderr}"
+  -- make sure the cache was actually used
+  let some line := out.stderr.splitOn "\n" |>.find? (·.startsWith "kernel shared cache (whnf): ")
+    | throw <| IO.userError s!"missing cache statistics: {out.stderr}"
+  let hits := (line.drop "kernel shared cache (whnf): ".length).takeWhile Char.isDigit
+  unless hits.toNat! > 0 do
+    throw <| IO.userError s!"no cache hits: {line}"
@@ -0,0 +1,50 @@
+import Lean
+open Lean
+
+/-!
+Round trip of zstd-compressed .olean files (see `LEAN_OLEAN_COMPRESSION`), which is only checked if Lean is built
+with `USE_ZSTD`, and clean failures when loading compressed files that are invalid or not supported.
+-/
+
+def oleanZstdChild := "
+import Lean
+open Lean
+def oleanZstdTest := 42
+#eval show CoreM Unit from do
+  saveModuleData \"oleanZstd.olean\" `oleanZstd (← mkModuleData (← getEnv))
+"
+
+def saveInChild (compression : Option String) : IO Unit := do
+  IO.FS.writeFile "oleanZstdChild.lean" oleanZstdChild
+  let out ← IO.Process.output {
+    cmd := (← IO.appPath).toString, args := #["oleanZstdChild.lean"], env := #[("LEAN_OLEAN_COMPRESSION", compression)] }
+  IO.FS.removeFile "oleanZstdChild.lean"
+  unless out.exitCode == 0 do
+    throw <| IO.userError s!"failed to save: {out.stdout}{out.stderr}"
+
+def checkLoad : IO Unit := do
+  let (data, _) ← readModuleData "oleanZstd.olean"
+  unless data.constNames.contains `oleanZstdTest do
+    throw <| IO.userError "unexpected module data"
+
+def expectLoadError (msg : String) : IO Unit := do
+  match (← (readModuleData "oleanZstd.olean").toBaseIO) with
+  | .ok _ => throw <| IO.userError "loading should have failed"
+  | .error e =>
+    unless (toString e).splitOn msg |>.length > 1 do
+      throw <| IO.userError s!"unexpected error: {e}"
+
+#eval show IO Unit from do
+  saveInChild none
+  let bytes ← IO.FS.readBinFile "oleanZstd.olean"
+  unless bytes.get! 5 == 1 do
+    throw <| IO.userError "file should not be compressed"
+  checkLoad
+  saveInChild (some "3")
+  let zstd := (← IO.FS.readBinFile "oleanZstd.olean").get! 5 == 2
+  if zstd then
+    checkLoad
+  -- an uncompressed file marked as compressed
+  IO.FS.writeBinFile "oleanZstd.olean" (bytes.set! 5 2)
+  expectLoadError (if zstd then "invalid zstd frame" else "not supported by this build of Lean")
+  IO.FS.removeFile "oleanZstd.olean"
@@ -0,0 +1,55 @@
+import Lean
+open Lean
+
+set_option profiler true
+set_option profiler.kernel true
+set_option profiler.threshold 0
+
+def fib : Nat → Nat
+  | 0 => 0
+  | 1 => 1
+  | n+2 => fib n + fib (n+1)
+
+theorem fib_10 : fib 10 = 55 := by decide
+
+example : fib 10 = 55 := rfl
+
+set_option profiler false
+
+/-!
+The kernel profile is printed to `stderr`, so we capture it with `withIsolatedStreams`
+and check the fields documented for `profiler.kernel`.
+-/
+
+def checkKernelProfile (declName : Name) : CoreM Unit := do
+  let info ← getConstInfo declName
+  let decl := Declaration.thmDecl {
+    name := declName ++ `copy, levelParams := info.levelParams, type := info.type, value := info.value! }
+  let env ← getEnv
+  let (out, r) ← IO.FS.withIsolatedStreams do
+    return env.addDeclProfiled 0 decl none 0
+  let .ok _ := r | throwError "failed to add declaration"
+  let json ← IO.ofExcept <| Json.parse out
+  let name ← IO.ofExcept <| json.getObjValAs? String "declaration"
+  unless name == toString (declName ++ `copy) do
+    throwError "unexpected declaration name: {name}"
+  let total ← IO.ofExcept <| json.getObjValAs? Float "total"
+  unless total ≥ 0 do
+    throwError "unexpected total: {total}"
+  let phases ← IO.ofExcept <| json.getObjVal? "phases"
+  for phase in ["whnf", "is_def_eq_core", "lazy_delta_reduction_step", "reduce_recursor", "reduce_nat"] do
+    discard <| IO.ofExcept <| phases.getObjValAs? Float phase
+  let caches ← IO.ofExcept <| json.getObjVal? "caches"
+  for cache in ["whnf", "infer_type", "failure"] do
+    let c ← IO.ofExcept <| caches.getObjVal? cache
+    discard <| IO.ofExcept <| c.getObjValAs? Nat "hits"
+    discard <| IO.ofExcept <| c.getObjValAs? Nat "misses"
+    discard <| IO.ofExcept <| c.getObjValAs? Float "hit_rate"
+  let unfolded ← IO.ofExcept <| json.getObjValAs? (Array Json) "top_unfolded"
+  if unfolded.isEmpty then
+    throwError "expected unfolded constants"
+  for u in unfolded do
+    discard <| IO.ofExcept <| u.getObjValAs? String "name"
+    discard <| IO.ofExcept <| u.getObjValAs? Nat "count"
+
+#eval checkKernelProfile ``fib_10
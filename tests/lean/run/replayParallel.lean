@@ -0,0 +1,39 @@
+import Lean
+open Lean
+
+inductive Color where
+  | red
+  | green
+
+def Color.next : Color → Color
+  | .red   => .green
+  | .green => .red
+
+theorem Color.next_next (c : Color) : c.next.next = c := by
+  cases c <;> rfl
+
+def colorConstants (f : ConstantInfo → ConstantInfo) : CoreM (HashMap Name ConstantInfo) := do
+  let mut r := {}
+  for (n, ci) in (← getEnv).constants.map₂.toList do
+    if (`Color).isPrefixOf n then
+      r := r.insert n (f ci)
+  return r
+
+unsafe def replayColor (f : ConstantInfo → ConstantInfo := id) : CoreM Unit := do
+  let newConstants ← colorConstants f
+  withImportModules #[{ module := `Init }] {} 0 fun env => do
+    try
+      let (env, times) ← env.replayParallel newConstants
+      IO.println s!"{env.contains ``Color.next_next} {times.any (·.1 == ``Color.next_next)}"
+    catch _ =>
+      IO.println "rejected"
+
+/-- info: true true -/
+#guard_msgs in
+#eval replayColor
+
+/-- info: rejected -/
+#guard_msgs in
+#eval replayColor fun
+  | .thmInfo val => .thmInfo { val with value := mkConst ``True.intro }
+  | ci => ci
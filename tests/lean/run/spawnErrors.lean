@@ -0,0 +1,28 @@
+/-!
+Failures of `IO.Process.spawn`. When the child is created with `posix_spawn` (and on Windows), a missing
+executable or working directory makes `spawn` throw an error mentioning it. When it is created with `fork`,
+the child process exits with code 255 instead.
+-/
+open IO.Process
+
+def checkSpawnFails (tag : String) (cfg : SpawnArgs) (fname : String) : IO Unit := do
+  let ok ← tryCatch (do
+      let child ← spawn cfg
+      pure ((← child.wait) == 255))
+    fun e => pure (System.Platform.isWindows || (toString e).splitOn fname |>.length > 1)
+  unless ok do
+    throw <| IO.userError s!"spawn failure \"{tag}\" was not reported"
+
+#eval checkSpawnFails "1" { cmd := "spawnErrorsMissingExecutable" } "spawnErrorsMissingExecutable"
+#eval checkSpawnFails "2" { cmd := "sh", args := #["-c", "exit 0"], cwd := "spawnErrorsMissingDir" } "spawnErrorsMissingDir"
+
+/-! Like `execvp`, scripts without a shebang line are executed using `/bin/sh`. -/
+#eval show IO Unit from do
+  unless System.Platform.isWindows do
+    let fname := "spawnErrorsScript.sh"
+    IO.FS.writeFile fname "echo script\n"
+    IO.setAccessRights fname { user := { read := true, write := true, execution := true } }
+    let out ← output { cmd := "./" ++ fname }
+    IO.FS.removeFile fname
+    unless out.exitCode == 0 && out.stdout == "script\n" do
+      throw <| IO.userError s!"unexpected result: {out.exitCode}, {out.stdout}, {out.stderr}"
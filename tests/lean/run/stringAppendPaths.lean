@@ -0,0 +1,60 @@
+/-!
+Fast paths of `String.append` and `String.extract` that return one of their arguments, and growth of large
+strings using `realloc`. Results must be equal to the expected strings, and mutating a result must never
+change a string that is still shared.
+-/
+
+def check (msg : String) (b : Bool) : IO Unit :=
+  unless b do throw <| IO.userError s!"check failed: {msg}"
+
+/-- A fresh string, not shared with any other value. -/
+@[noinline] def fresh (s : String) : String := String.mk s.toList
+
+#eval show IO Unit from do
+  let s := fresh "hello"
+  -- shared operands
+  let r₁ := "" ++ s
+  let r₂ := s ++ ""
+  check "empty ++ shared" (r₁ == "hello")
+  check "shared ++ empty" (r₂ == "hello")
+  check "mutate empty ++ shared" (r₁.push '!' == "hello!" && s == "hello")
+  check "mutate shared ++ empty" (r₂.set 0 'j' == "jello" && s == "hello")
+  -- unshared operands
+  check "empty ++ unshared" (("" ++ fresh "abc").push 'd' == "abcd")
+  check "unshared ++ empty" ((fresh "abc" ++ "").push 'd' == "abcd")
+  check "unshared empty ++ empty" ((fresh "" ++ fresh "").isEmpty)
+  -- an empty string with spare capacity
+  let e := (fresh "xyz").dropRight 3
+  check "empty with capacity ++ shared" ((e ++ s).push '?' == "hello?" && s == "hello")
+  check "shared ++ empty with capacity" (s ++ e == "hello")
+
+#eval show IO Unit from do
+  -- grow the string well beyond the largest small object, so that it is resized using `realloc`
+  let chunk := String.mk ((List.range 1000).map fun i => Char.ofNat ('a'.toNat + i % 26))
+  let mut acc := ""
+  let mut snapshot := ""
+  for i in [0:300] do
+    acc := acc ++ chunk
+    if i == 10 then
+      -- keep a shared copy across the following appends
+      snapshot := acc
+  check "length" (acc.length == 300 * 1000)
+  check "snapshot" (snapshot.length == 11 * 1000 && snapshot == "".intercalate (List.replicate 11 chunk))
+  check "contents" ((List.range 300).all fun i => (acc.extract ⟨i * 1000⟩ ⟨(i + 1) * 1000⟩) == chunk)
+  -- many small appends to a large string
+  let mut big := acc
+  for _ in [0:10000] do
+    big := big.push 'z'
+  check "pushes" (big.length == 310000 && big.startsWith acc && acc.length == 300000)
+
+#eval show IO Unit from do
+  let s := fresh "héllo wörld"
+  -- full range extract shares the string
+  let t := s.extract 0 s.endPos
+  check "full extract" (t == s)
+  check "mutate full extract" (t.set 0 'H' == "Héllo wörld" && s == "héllo wörld")
+  check "mutate full substring" ((s.toSubstring.toString.push '!') == "héllo wörld!" && s == "héllo wörld")
+  -- slices covering more than half of the string
+  check "large slice" (s.extract ⟨1⟩ s.endPos == "éllo wörld" && (s.extract ⟨1⟩ s.endPos).length == 10)
+  check "large prefix" (s.extract 0 ⟨s.endPos.byteIdx - 1⟩ == "héllo wörl")
+  check "small slice" ((s.extract ⟨7⟩ ⟨11⟩).length == 3)
@@ -0,0 +1,25 @@
+/-!
+Many tasks forcing the same slow thunk: all but one of them must wait for the value, which must be computed
+exactly once.
+-/
+
+@[noinline] def slowValue (evalCount : IO.Ref Nat) (n : Nat) : Nat := unsafe unsafeBaseIO do
+  evalCount.modify (· + 1)
+  IO.sleep 200
+  return (List.range n).foldl (· + ·) 0
+
+#eval show IO Unit from do
+  for round in [0:3] do
+    let evalCount ← IO.mkRef 0
+    let n := 100000 + round
+    let t : Thunk Nat := Thunk.mk fun _ => slowValue evalCount n
+    let tasks := (List.range 32).map fun _ => Task.spawn (prio := .dedicated) fun _ => t.get
+    for task in tasks do
+      let v := task.get
+      unless v == n * (n - 1) / 2 do
+        throw <| IO.userError s!"unexpected value {v}"
+    unless t.get == n * (n - 1) / 2 do
+      throw <| IO.userError "unexpected value"
+    let count ← evalCount.get
+    unless count == 1 do
+      throw <| IO.userError s!"thunk was evaluated {count} times"
@@ -0,0 +1,36 @@
+/-!
+`IO.trimHeap` returns fully free segments of the current thread heap to the OS. Allocation must keep
+working afterwards, both with the default high-water mark and with one below the segment size, which is
+rounded up to one segment.
+-/
+
+def allocAndTrim (n : Nat) : IO Unit := do
+  for _ in [0:3] do
+    let l := List.range n
+    unless l.foldl (· + ·) 0 == n * (n - 1) / 2 do
+      throw <| IO.userError "unexpected sum"
+    IO.trimHeap
+    let a := Array.range n
+    unless a.size == n && a[n - 1]! == n - 1 do
+      throw <| IO.userError "unexpected array"
+    IO.trimHeap
+
+#eval allocAndTrim 1000000
+
+#eval show IO Unit from do
+  let fname := "trimHeapChild.lean"
+  IO.FS.writeFile fname "
+def main : IO Unit := pure ()
+#eval show IO Unit from do
+  for _ in [0:3] do
+    let l := List.range 1000000
+    IO.trimHeap
+    unless l.length == 1000000 do throw <| IO.userError \"unexpected length\"
+    IO.trimHeap
+  IO.println \"ok\"
+"
+  let out ← IO.Process.output {
+    cmd := (← IO.appPath).toString, args := #[fname], env := #[("LEAN_HEAP_HIGH_WATERMARK", some "1")] }
+  IO.FS.removeFile fname
+  unless out.exitCode == 0 && out.stdout == "ok\n" do
+    throw <| IO.userError s!"unexpected result: {out.exitCode}, {out.stdout}, {out.stderr}"
@@ -1,4 +1,5 @@
 import Lean.Util.TestExtern
+import Lean.Data.Lsp.Utf16
 
 deriving instance DecidableEq for ByteArray
 
@@ -41,6 +42,17 @@ validate ⟨#[0xf1, 0x81, 0x81, 0x81]⟩ => "񁁁"
 validate ⟨#[0xf8, 0x81, 0x81, 0x81, 0x81]⟩ => ↯
 validate ⟨#[0x24, 0xc2, 0xa3, 0xe2, 0x82, 0xac, 0xf0, 0x90, 0x8d, 0x88]⟩ => "$£€𐍈"
 
+-- long enough to be validated by the vectorized code
+validate "The quick brown fox jumps over the lazy dog: λ → ∀ 英語 𐍈 $£€".toUTF8 => "The quick brown fox jumps over the lazy dog: λ → ∀ 英語 𐍈 $£€"
+validate ("The quick brown fox jumps over the lazy dog".toUTF8.push 0xc3) => ↯
+validate ("The quick brown fox jumps over the lazy dog".toUTF8 ++ ⟨#[0xed, 0xa0, 0x80]⟩ ++ "The quick brown fox".toUTF8) => ↯
+validate ("The quick brown fox jumps over the λ".toUTF8 ++ ⟨#[0xf4, 0x90, 0x80, 0x80]⟩ ++ "The quick brown fox".toUTF8) => ↯
+
+test_extern String.codepointPosToUtf8PosFrom "The quick brown fox jumps over the lazy dog: λ → ∀ 英語 𐍈 $£€" 0 53
+test_extern String.codepointPosToUtf8PosFrom "The quick brown fox jumps over the lazy dog: λ → ∀ 英語 𐍈 $£€" ⟨45⟩ 8
+test_extern String.codepointPosToUtf8PosFrom "The quick brown fox jumps over the lazy dog: λ → ∀ 英語 𐍈 $£€" ⟨46⟩ 3
+test_extern String.codepointPosToUtf8PosFrom "The quick brown fox jumps over the lazy dog: λ → ∀ 英語 𐍈 $£€" 0 100
+
 def check_eq {α} [BEq α] [Repr α] (tag : String) (expected actual : α) : IO Unit :=
   unless (expected == actual) do
     throw $ IO.userError $